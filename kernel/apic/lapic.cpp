@@ -0,0 +1,114 @@
+/**
+ * Local Advanced Programmable Interrupt Controller (LAPIC)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "apic/lapic.h"
+#include "cpu/cpu.h"
+
+namespace apic {
+
+/**
+ * Construct the LAPIC from the IA32_APIC_BASE msr value
+ *
+ * The register page is below 4GiB, which the bootloader already identity maps
+ */
+lapic::lapic(uint64_t msr)
+  : base(msr & ~0xfffUL)
+{}
+
+/**
+ * Software enable the LAPIC
+ *
+ * @param spurious vector used for spurious interrupts
+ */
+void
+lapic::enable(uint8_t spurious)
+{
+    /* Accept every interrupt priority */
+    this->write(reg_e::tpr, 0);
+    this->write(reg_e::spurious, SVR_ENABLE | spurious);
+}
+
+/**
+ * Signal end of interrupt
+ */
+void
+lapic::eoi()
+{
+    this->write(reg_e::eoi, 0);
+}
+
+/**
+ * Get the LAPIC ID of the running CPU
+ */
+uint32_t
+lapic::id()
+{
+    return this->read(reg_e::id) >> 24;
+}
+
+/**
+ * Configure the LVT timer entry (unmasked)
+ *
+ * @param mode one-shot, periodic or TSC-deadline
+ * @param vector interrupt vector raised on expiration
+ */
+void
+lapic::timer(timer_e mode, uint8_t vector)
+{
+    this->write(reg_e::timer_divide, TIMER_DIVIDE_16);
+    this->write(reg_e::lvt_timer, static_cast<uint32_t>(mode) | vector);
+}
+
+/**
+ * Arm the timer with an initial count (0 stops it)
+ */
+void
+lapic::timer_count(uint32_t count)
+{
+    this->write(reg_e::timer_initial, count);
+}
+
+/**
+ * Read the timer current count
+ */
+uint32_t
+lapic::timer_current()
+{
+    return this->read(reg_e::timer_current);
+}
+
+/**
+ * Mask and stop the timer
+ */
+void
+lapic::timer_mask()
+{
+    this->write(reg_e::lvt_timer, LVT_MASKED);
+    this->write(reg_e::timer_initial, 0);
+}
+
+/**
+ * Send a fixed inter-processor interrupt
+ *
+ * @param apic_id destination LAPIC id (physical destination mode)
+ * @param vector interrupt vector raised on the destination
+ */
+void
+lapic::send_ipi(uint32_t apic_id, uint8_t vector)
+{
+    /* The two ICR writes must not be split by an interrupt sending its own IPI */
+    auto flags = cpu::irq_save();
+
+    while (this->read(reg_e::icr_low) & ICR_PENDING)
+        cpu::pause();
+
+    this->write(reg_e::icr_high, apic_id << 24);
+    this->write(reg_e::icr_low, ICR_ASSERT | vector);
+
+    cpu::irq_restore(flags);
+}
+
+} // namespace apic
@@ -0,0 +1,101 @@
+/**
+ * Local Advanced Programmable Interrupt Controller (LAPIC)
+ *
+ * Each CPU has its own LAPIC mapped at the same physical address, so a single object serves every
+ * core (each one sees its own registers)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace apic {
+
+/**
+ * LAPIC register offsets (xAPIC MMIO mode)
+ *
+ * Intel SDM Vol. 3A, 10.4.1 (Local APIC Register Address Map)
+ */
+enum class reg_e
+{
+    id            = 0x20,
+    version       = 0x30,
+    tpr           = 0x80,
+    eoi           = 0xb0,
+    spurious      = 0xf0,
+    icr_low       = 0x300,
+    icr_high      = 0x310,
+    lvt_timer     = 0x320,
+    timer_initial = 0x380,
+    timer_current = 0x390,
+    timer_divide  = 0x3e0,
+};
+
+/**
+ * LVT timer modes (bits 17-18 of the LVT timer register)
+ */
+enum class timer_e
+{
+    oneshot  = 0b00 << 17,
+    periodic = 0b01 << 17,
+    deadline = 0b10 << 17,
+};
+
+/** LVT mask bit */
+const uint32_t LVT_MASKED = 1 << 16;
+/** Spurious vector register software enable bit */
+const uint32_t SVR_ENABLE = 1 << 8;
+/** Timer divide configuration for a divisor of 16 */
+const uint32_t TIMER_DIVIDE_16 = 0b0011;
+/** ICR delivery status (previous IPI not accepted yet) */
+const uint32_t ICR_PENDING = 1 << 12;
+/** ICR level assert (must be set for fixed IPIs) */
+const uint32_t ICR_ASSERT = 1 << 14;
+
+/**
+ * Local APIC class
+ */
+class lapic
+{
+  public:
+    lapic() = default;
+    lapic(uint64_t);
+    void enable(uint8_t);
+    void eoi();
+    uint32_t id();
+    void timer(timer_e, uint8_t);
+    void timer_count(uint32_t);
+    uint32_t timer_current();
+    void timer_mask();
+    void send_ipi(uint32_t, uint8_t);
+
+    /** Gets the MMIO base address */
+    uint64_t get_base() const
+    {
+        return this->base;
+    }
+
+    /**
+     * Read a LAPIC register (MMIO)
+     */
+    uint32_t read(reg_e reg)
+    {
+        return *(volatile uint32_t *)(this->base + static_cast<uint64_t>(reg));
+    }
+
+    /**
+     * Write a LAPIC register (MMIO)
+     */
+    void write(reg_e reg, uint32_t value)
+    {
+        *(volatile uint32_t *)(this->base + static_cast<uint64_t>(reg)) = value;
+    }
+
+  private:
+    /** MMIO base address */
+    uint64_t base = 0;
+};
+
+} // namespace apic
@@ -0,0 +1,95 @@
+/**
+ * Awaitable events
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "async/event.h"
+#include "cpu/cpu.h"
+#include "kernel.h"
+
+namespace async {
+
+/**
+ * Consume the event or queue the flow until set()
+ *
+ * @return false to continue right away (the event was set)
+ */
+bool
+event::awaiter::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+    auto flags = this->owner->lock.lock_irqsave();
+    if (this->owner->signaled) {
+        this->owner->signaled = false;
+        this->owner->lock.unlock_irqrestore(flags);
+        return false;
+    }
+
+    this->node.handle = handle;
+    this->node.next   = nullptr;
+    if (this->owner->tail == nullptr)
+        this->owner->head = &this->node;
+    else
+        this->owner->tail->next = &this->node;
+    this->owner->tail = &this->node;
+
+    /* Once queued the flow may be resumed (and the awaiter gone) as soon as the lock is free */
+    this->owner->lock.unlock_irqrestore(flags);
+    return true;
+}
+
+/**
+ * Resume the oldest waiting flow, or remember the event (can be called from interrupt context)
+ */
+void
+event::set()
+{
+    auto flags       = this->lock.lock_irqsave();
+    ready_node *node = this->head;
+    if (node != nullptr) {
+        this->head = node->next;
+        if (this->head == nullptr)
+            this->tail = nullptr;
+    } else {
+        this->signaled = true;
+    }
+    this->lock.unlock_irqrestore(flags);
+
+    if (node != nullptr)
+        schedule(node);
+}
+
+/**
+ * Timer of a sleeping flow expired (timer interrupt context)
+ */
+static void
+sleep_expired(time::timer *timer)
+{
+    schedule((ready_node *)timer->data);
+}
+
+/**
+ * Arm a timer that queues the flow at the deadline
+ *
+ * Without a calibrated clock there is no deadline to wait for, the flow only goes to the back of
+ * the queue (like sched::sleep())
+ */
+void
+sleep::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+    this->node.handle = handle;
+    if (!kernel::clock.is_calibrated()) {
+        schedule(&this->node);
+        return;
+    }
+
+    this->timer       = time::timer(sleep_expired, &this->node);
+    uint64_t deadline = kernel::clock.now() + this->ns;
+
+    /* Wheel operations run on the owner CPU, the timer interrupt can't fire until the restore */
+    auto flags = cpu::irq_save();
+    time::local().add(&this->timer, deadline);
+    cpu::irq_restore(flags);
+}
+
+} // namespace async
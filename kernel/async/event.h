@@ -0,0 +1,90 @@
+/**
+ * Awaitable events
+ *
+ * - event: set by an interrupt handler (or anyone else), awaited by flows
+ * - sleep(): resume the flow after a delay (wheel timer of the calling CPU)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "async/executor.h"
+#include "lib/coroutine.h"
+#include "sync/spinlock.h"
+#include "time/wheel.h"
+#include <stdint.h>
+
+namespace async {
+
+/**
+ * Auto-reset event
+ *
+ * set() hands the event to the oldest waiting flow, or keeps it for the next wait() if nobody
+ * waits (several set() calls without a waiter count once)
+ */
+class event
+{
+  public:
+    event() = default;
+    event(const event &) = delete;
+    event &operator=(const event &) = delete;
+
+    /**
+     * co_await ev.wait()
+     */
+    struct awaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<>) noexcept;
+        void await_resume() const noexcept {}
+
+        event *owner;
+        ready_node node;
+    };
+
+    awaiter wait()
+    {
+        return awaiter{ this, {} };
+    }
+
+    void set();
+
+  private:
+    /** Taken with interrupts disabled, set() runs in interrupt handlers */
+    sync::ticket_lock lock;
+    bool signaled = false;
+    /** Waiting flows, oldest first */
+    ready_node *head = nullptr;
+    ready_node *tail = nullptr;
+};
+
+/**
+ * co_await async::sleep(ns)
+ */
+class sleep
+{
+  public:
+    sleep(uint64_t ns)
+      : ns(ns)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return this->ns == 0;
+    }
+
+    void await_suspend(std::coroutine_handle<>) noexcept;
+    void await_resume() const noexcept {}
+
+  private:
+    uint64_t ns;
+    time::timer timer;
+    ready_node node;
+};
+
+} // namespace async
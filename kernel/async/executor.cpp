@@ -0,0 +1,166 @@
+/**
+ * Coroutine executor
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "async/executor.h"
+#include "kernel.h"
+#include "klog/klog.h"
+#include "lib/atomic.h"
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+#include "sync/wait.h"
+
+namespace async {
+
+static sync::lock_stats queue_stats("async queue");
+/** FIFO of ready flows, taken with interrupts disabled (interrupt handlers queue flows) */
+static sync::ticket_lock queue_lock(&queue_stats);
+static ready_node *head = nullptr;
+static ready_node *tail = nullptr;
+/** Workers sleep here while the queue is empty */
+static sync::wait_queue idle_workers;
+
+static uint32_t worker_count             = 0;
+static std::atomic<uint64_t> live_flows  = 0;
+static std::atomic<uint64_t> resumptions = 0;
+
+/**
+ * Queue a flow to be resumed by a worker (any context)
+ */
+void
+schedule(ready_node *node)
+{
+    node->next = nullptr;
+
+    auto flags = queue_lock.lock_irqsave();
+    if (tail == nullptr)
+        __atomic_store_n(&head, node, __ATOMIC_RELAXED);
+    else
+        tail->next = node;
+    tail = node;
+    queue_lock.unlock_irqrestore(flags);
+
+    idle_workers.wake_one();
+}
+
+/**
+ * Take the oldest ready flow
+ *
+ * @return the node or nullptr if the queue is empty
+ */
+static ready_node *
+pop()
+{
+    auto flags       = queue_lock.lock_irqsave();
+    ready_node *node = head;
+    if (node != nullptr) {
+        __atomic_store_n(&head, node->next, __ATOMIC_RELAXED);
+        if (head == nullptr)
+            tail = nullptr;
+    }
+    queue_lock.unlock_irqrestore(flags);
+    return node;
+}
+
+/**
+ * Worker thread: resumes ready flows until the queue is empty, then sleeps
+ */
+static void
+worker(void *)
+{
+    while (true) {
+        idle_workers.wait([] { return __atomic_load_n(&head, __ATOMIC_RELAXED) != nullptr; });
+
+        ready_node *node;
+        while ((node = pop()) != nullptr) {
+            /* The node lives in the frame, the flow may free it before resume() returns */
+            std::coroutine_handle<> handle = node->handle;
+            resumptions.fetch_add(1, std::memory_order_relaxed);
+            handle.resume();
+        }
+    }
+}
+
+/**
+ * Start the workers (the scheduler must be initialised)
+ */
+void
+init(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (sched::create("async", worker, nullptr) == nullptr) {
+            klog::fmt(klog::level_e::error, "async: can't create a worker thread");
+            break;
+        }
+        worker_count++;
+    }
+}
+
+/**
+ * Allocate a coroutine frame
+ *
+ * @return the frame or nullptr if the heap is exhausted
+ */
+void *
+frame_alloc(uint64_t size)
+{
+    return kernel::heap.malloc(size);
+}
+
+/**
+ * Free a coroutine frame
+ */
+void
+frame_free(void *frame)
+{
+    kernel::heap.free(frame);
+}
+
+/**
+ * Account a spawned flow
+ */
+void
+flow_started()
+{
+    live_flows.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Account a spawned flow that finished
+ */
+void
+flow_finished()
+{
+    live_flows.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Spawned flows that didn't finish yet
+ */
+uint64_t
+flows()
+{
+    return live_flows.load(std::memory_order_relaxed);
+}
+
+/**
+ * Flows resumed by the workers
+ */
+uint64_t
+resumes()
+{
+    return resumptions.load(std::memory_order_relaxed);
+}
+
+/**
+ * Worker threads
+ */
+uint32_t
+workers()
+{
+    return worker_count;
+}
+
+} // namespace async
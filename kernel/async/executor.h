@@ -0,0 +1,72 @@
+/**
+ * Coroutine executor
+ *
+ * Asynchronous flows (async::task coroutines) don't own a stack: a suspended flow is only its
+ * coroutine frame on the heap. Flows that can continue are queued as ready_node and resumed by a
+ * pool of kernel threads (one per CPU), which sleep while the queue is empty
+ *
+ * Nodes are embedded in the awaiter that suspended the flow (it lives in the frame while the flow
+ * is suspended), queueing never allocates and can be done from interrupt context
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/coroutine.h"
+#include <stdint.h>
+
+namespace async {
+
+/**
+ * Flow ready to be resumed
+ */
+struct ready_node
+{
+    ready_node *next = nullptr;
+    std::coroutine_handle<> handle;
+};
+
+void init(uint32_t);
+void schedule(ready_node *);
+
+void *frame_alloc(uint64_t);
+void frame_free(void *);
+void flow_started();
+void flow_finished();
+
+uint64_t flows();
+uint64_t resumes();
+uint32_t workers();
+
+/**
+ * Give the worker up, the flow goes to the back of the queue
+ */
+struct yield_awaiter
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        this->node.handle = handle;
+        schedule(&this->node);
+    }
+
+    void await_resume() const noexcept {}
+
+    ready_node node;
+};
+
+/**
+ * co_await async::yield()
+ */
+inline yield_awaiter
+yield()
+{
+    return {};
+}
+
+} // namespace async
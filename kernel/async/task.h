@@ -0,0 +1,248 @@
+/**
+ * Asynchronous tasks
+ *
+ * task<T> is a coroutine producing a T. It is lazy: it starts when awaited, and the awaiting flow
+ * continues when it finishes (symmetric transfer, no trip through the executor). Top level flows
+ * are started with spawn(), they run on the executor and free themselves at the end
+ *
+ *     async::task<bool> reset();
+ *
+ *     async::task<> driver()
+ *     {
+ *         if (!co_await reset())
+ *             co_return;
+ *         while (true) {
+ *             co_await irq.wait();
+ *             ...
+ *         }
+ *     }
+ *
+ *     async::spawn(driver());
+ *
+ * Frames come from the kernel heap. When it is exhausted the task is empty (valid() is false),
+ * awaiting it gives a default T and spawning it fails
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "async/executor.h"
+#include "lib/coroutine.h"
+#include <stddef.h>
+
+namespace async {
+
+/**
+ * Promise part shared by every task
+ */
+struct promise_base
+{
+    /** Flow awaiting this task, resumed when it finishes */
+    std::coroutine_handle<> continuation;
+    /** Spawned flow: nobody awaits it and it frees its frame at the end */
+    bool detached = false;
+    /** Executor link of a spawned flow */
+    ready_node node;
+
+    static void *operator new(size_t size) noexcept
+    {
+        return frame_alloc(size);
+    }
+
+    static void operator delete(void *frame)
+    {
+        frame_free(frame);
+    }
+
+    /**
+     * Continue with the awaiting flow when the task finishes
+     */
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> self) noexcept
+        {
+            promise_base &promise = self.promise();
+            if (promise.detached) {
+                self.destroy();
+                flow_finished();
+                return std::noop_coroutine();
+            }
+            if (promise.continuation)
+                return promise.continuation;
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    final_awaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    /** Built without exceptions, never called */
+    void unhandled_exception() {}
+};
+
+/**
+ * Result of a task
+ */
+template<typename T>
+struct promise_value
+{
+    T value{};
+
+    void return_value(T result)
+    {
+        this->value = result;
+    }
+
+    T result()
+    {
+        return this->value;
+    }
+};
+
+template<>
+struct promise_value<void>
+{
+    void return_void() {}
+    void result() {}
+};
+
+/**
+ * Coroutine producing a T
+ */
+template<typename T = void>
+class task
+{
+  public:
+    struct promise_type
+      : promise_base
+      , promise_value<T>
+    {
+        task get_return_object()
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        static task get_return_object_on_allocation_failure()
+        {
+            return task();
+        }
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task(handle_type handle = nullptr)
+      : handle(handle)
+    {}
+
+    task(task &&other)
+      : handle(other.handle)
+    {
+        other.handle = nullptr;
+    }
+
+    task &operator=(task &&other)
+    {
+        if (this != &other) {
+            if (this->handle)
+                this->handle.destroy();
+            this->handle  = other.handle;
+            other.handle = nullptr;
+        }
+        return *this;
+    }
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    ~task()
+    {
+        if (this->handle)
+            this->handle.destroy();
+    }
+
+    /** The frame could be allocated */
+    bool valid() const
+    {
+        return (bool)this->handle;
+    }
+
+    /**
+     * Give up ownership of the frame
+     */
+    handle_type release()
+    {
+        handle_type handle = this->handle;
+        this->handle       = nullptr;
+        return handle;
+    }
+
+    /**
+     * Start the task and suspend the awaiting flow until it finishes
+     */
+    struct awaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return !this->handle || this->handle.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            this->handle.promise().continuation = awaiting;
+            return this->handle;
+        }
+
+        T await_resume()
+        {
+            return this->handle ? this->handle.promise().result() : T();
+        }
+
+        handle_type handle;
+    };
+
+    awaiter operator co_await() const noexcept
+    {
+        return awaiter{ this->handle };
+    }
+
+  private:
+    handle_type handle;
+};
+
+/**
+ * Run a task as an independent flow on the executor
+ *
+ * @return false if the task is empty (its frame couldn't be allocated)
+ */
+inline bool
+spawn(task<> &&flow)
+{
+    auto handle = flow.release();
+    if (!handle)
+        return false;
+
+    promise_base &promise = handle.promise();
+    promise.detached      = true;
+    promise.node.handle   = handle;
+    flow_started();
+    schedule(&promise.node);
+    return true;
+}
+
+} // namespace async
@@ -5,12 +5,19 @@
  */
 
 #include "bootstrap/startup.h"
+#include "async/executor.h"
 #include "bootstrap/stivale_hdrs.h"
+#include "cpu/cpu.h"
 #include "io/bus.h"
 #include "kernel.h"
+#include "klog/klog.h"
 #include "lib/stdlib.h"
 #include "paging/BPFA.h"
+#include "paging/pcid.h"
 #include "pci/pci.h"
+#include "sched/thread.h"
+#include "sync/rcu.h"
+#include "user/syscall.h"
 
 namespace bootstrap {
 
@@ -35,17 +42,18 @@ screen(stivale2_struct *st)
     frame.height      = fb->framebuffer_height;
     frame.buffer_size = frame.ppscl * frame.height * sizeof(uint32_t);
 
-    /* Get the font module from stivale */
-    fonts::specification::psf1 *font_ptr =
-      (fonts::specification::psf1 *)stivale2_get_mod(mod, "font");
-
-    /* Create the font */
-    fonts::specification::psf1 font;
-    font.header = *(fonts::specification::psf1_header *)font_ptr;
-    font.buffer = (uint8_t *)font_ptr + sizeof(fonts::specification::psf1_header);
+    /* Get the font module from stivale (PSF2 or PSF1, glyph size read from its header) */
+    fonts::specification::psf2 font;
+    uint64_t font_size = 0;
+    void *font_data    = stivale2_get_mod(mod, "font", &font_size);
+    if (!fonts::specification::parse(font_data, font_size, font)) {
+        /* Nothing can be shown without a font */
+        while (true)
+            asm volatile("cli; hlt");
+    }
 
     /* Create the tty */
-    kernel::tty = fonts::psf1<screen::fast_renderer_i>(frame, font, 0, 0, screen::color_e::WHITE);
+    kernel::tty = fonts::psf2(frame, font, 0, 0, screen::color_e::WHITE);
 }
 
 void
@@ -61,13 +69,16 @@ allocator(stivale2_struct *st)
 void
 gdt()
 {
-    using namespace segmentation;
+    /*
+     * The BSP is CPU 0. It keeps running on the stivale2 stack, its TSS gets a ring 0 stack only
+     * when it switches to a user thread (the stack of that thread)
+     */
+    if (!percpu::create(0))
+        klog::fmt(klog::level_e::warning, "no memory for the per CPU area, using the template");
 
-    /* Create an empty GDT */
-    kernel::gdt.size   = sizeof(table) - 1;
-    kernel::gdt.offset = (uint64_t)&table;
-    /* Load it (assembly) */
-    load_gdt(&kernel::gdt);
+    smp::processor *bsp = &kernel::cpus[0];
+    bsp->fault_stack    = smp::alloc_stack(smp::FAULT_STACK_PAGES);
+    smp::init(bsp, 0);
 }
 
 void
@@ -96,6 +107,17 @@ interrupts()
 
     /* Load the interrupt handlers */
     kernel::idtr.add_handle(interrupts::vector_e::reserved, interrupts::reserved);
+    kernel::idtr.add_handle(interrupts::vector_e::divide_error, interrupts::divide_error);
+    kernel::idtr.add_handle(interrupts::vector_e::invalid_opcode, interrupts::invalid_opcode);
+    kernel::idtr.add_handle(interrupts::vector_e::general_protection,
+                            interrupts::general_protection);
+    kernel::idtr.add_handle(interrupts::vector_e::page_fault, interrupts::page_fault);
+    kernel::idtr.add_handle(interrupts::vector_e::fpu_missing, interrupts::fpu_missing);
+    kernel::idtr.add_handle(
+      interrupts::vector_e::double_fault, interrupts::double_fault, segmentation::IST_FAULT);
+
+    /* System calls through int 0x80 (slower than SYSCALL, see user/syscall.h) */
+    kernel::idtr.add_user_gate(interrupts::vector_e::syscall, user::syscall_int80);
 
     /*
      * From OSDev:
@@ -114,8 +136,11 @@ interrupts()
 void
 enable_virtualaddr()
 {
-    /* Enable virtual addresses */
-    asm("mov %0, %%cr3" : : "r"(kernel::translator.get_PGDT()));
+    /* Enable virtual addresses (the BSP is CPU 0) */
+    kernel::translator.load(0);
+
+    /* Global kernel pages and PCID tagged address spaces */
+    paging::pcid::init();
 }
 
 void
@@ -131,16 +156,79 @@ enable_interrupts()
 void
 keyboard()
 {
-    /* Reserve keyboard buffer memory */
+    /* Reserve keyboard buffer memory, split between the consoles */
     auto size   = KEYBOARD_BUFF_SIZE;
     auto buffer = kernel::allocator.request_cont_page(size / kernel::page_size + 1);
 
-    /* Bootstrap the keyboard and enable it */
-    kernel::keyboard.set_buffer(static_cast<char *>(buffer));
-    kernel::keyboard.set_maxsize(size);
+    /* Bootstrap the keyboards and enable them */
+    for (uint32_t i = 0; i < screen::CONSOLES; i++) {
+        kernel::keyboards[i].set_buffer(static_cast<char *>(buffer) + i * size / screen::CONSOLES);
+        kernel::keyboards[i].set_maxsize(size / screen::CONSOLES);
+    }
     io::PS2::enable_keyboard();
 };
 
+/**
+ * Value of a name=value option of the kernel command line
+ *
+ * @return false if the option is not there
+ */
+static bool
+cmdline_option(stivale2_struct *st, const char *name, char *value, uint32_t size)
+{
+    auto *tag =
+      (stivale2_struct_tag_cmdline *)stivale2_get_tag(st, STIVALE2_STRUCT_TAG_CMDLINE_ID);
+    if (tag == nullptr)
+        return false;
+
+    const char *cmdline = (const char *)tag->cmdline;
+    uint64_t length     = strlen(name);
+    while (*cmdline != '\0') {
+        const char *option = cmdline;
+        while (*cmdline != '\0' && *cmdline != ' ')
+            cmdline++;
+
+        if ((uint64_t)(cmdline - option) > length && option[length] == '=' &&
+            strncmp(option, name, length) == 0) {
+            uint32_t i = 0;
+            for (option += length + 1; option < cmdline && i + 1 < size; option++)
+                value[i++] = *option;
+            value[i] = '\0';
+            return true;
+        }
+
+        while (*cmdline == ' ')
+            cmdline++;
+    }
+    return false;
+}
+
+void
+serial(stivale2_struct *st)
+{
+    /* serial=<baud> sets the line rate, serial=off leaves the port alone */
+    uint32_t baud = io::UART_BASE_BAUD;
+    char value[16];
+    if (cmdline_option(st, "serial", value, sizeof(value))) {
+        if (strcmp(value, "off") == 0)
+            return;
+        baud = strol(value, 10);
+    }
+
+    if (!kernel::serial.init(io::COM1, baud)) {
+        klog::fmt(klog::level_e::warning, "serial: no UART on COM1 or bad baud rate %i", (int)baud);
+        return;
+    }
+
+    /* COM1 is IRQ4 of the master PIC */
+    kernel::idtr.add_handle(interrupts::vector_e::serial, interrupts::serial);
+    io::outb(io::PIC1_DATA, io::inb(io::PIC1_DATA) & ~(1 << 4));
+    kernel::serial.enable_irq();
+
+    /* Copy the kernel log (from the first record still in the ring) to the port */
+    klog::attach_serial();
+}
+
 void
 acpi(stivale2_struct *st)
 {
@@ -159,10 +247,10 @@ pci()
 }
 
 void
-heap(size_t size)
+heap(size_t size, heap::simple_allocator::expansion_e mode)
 {
     /* Create the heap */
-    kernel::heap = heap::simple_allocator(size);
+    kernel::heap = heap::simple_allocator(size, mode);
 }
 
 void
@@ -178,4 +266,68 @@ rtl8139()
     }
 }
 
+void
+clock()
+{
+    /* Find the HPET and start its counter */
+    kernel::hpet = time::hpet(kernel::rsdp.find_table("HPET"));
+
+    /* Calibrate the TSC against it */
+    if (!kernel::clock.calibrate(kernel::hpet)) {
+        klog::fmt(klog::level_e::warning, "no HPET found, clock not available");
+        return;
+    }
+
+    /* Enable this CPU's local APIC */
+    kernel::lapic = apic::lapic(cpu::rdmsr(cpu::MSR_APIC_BASE));
+    kernel::lapic.enable(static_cast<uint8_t>(interrupts::vector_e::apic_spurious));
+    kernel::idtr.add_handle(interrupts::vector_e::apic_spurious, interrupts::apic_spurious);
+
+    /* Calibrate the LAPIC timer and hook its interrupt */
+    kernel::timer.calibrate(
+      &kernel::lapic, &kernel::clock, static_cast<uint8_t>(interrupts::vector_e::apic_timer));
+    kernel::idtr.add_handle(interrupts::vector_e::apic_timer, interrupts::apic_timer);
+
+    /* Timers of this CPU are driven by its LAPIC timer */
+    time::local().start(&kernel::clock, &kernel::timer);
+    kernel::timer.set_handler(time::tick);
+}
+
+void
+sched()
+{
+    /* The boot flow becomes the idle thread of the BSP */
+    sched::init_cpu();
+
+    /* CPUs wake each other up when they queue work */
+    kernel::idtr.add_handle(interrupts::vector_e::reschedule, interrupts::reschedule);
+    /* and when they change translations the others may have cached */
+    kernel::idtr.add_handle(interrupts::vector_e::tlb_shootdown, interrupts::tlb_shootdown);
+
+    /* Deferred frees of RCU protected data */
+    sync::rcu_init();
+}
+
+void
+smp(stivale2_struct *st)
+{
+    /* The bootloader already woke the APs, they wait for a goto_address */
+    auto *tag = (stivale2_struct_tag_smp *)stivale2_get_tag(st, STIVALE2_STRUCT_TAG_SMP_ID);
+    smp::start(tag);
+}
+
+void
+async()
+{
+    /* One worker thread per CPU resumes the coroutine flows */
+    async::init(smp::count());
+}
+
+void
+klog()
+{
+    /* Print what was logged during the boot and from now on */
+    klog::init();
+}
+
 } // namespace bootstrap
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "acpi/acpi.h"
+#include "heap/simple_allocator.h"
 #include "interrupts/interrupts.h"
 #include "screen/fonts/psf1.h"
 #include "screen/framebuffer.h"
@@ -39,7 +40,13 @@ void enable_interrupts();
 void keyboard();
 void acpi(stivale2_struct *);
 void pci();
-void heap(size_t);
+void heap(size_t, heap::simple_allocator::expansion_e);
 void rtl8139();
+void clock();
+void sched();
+void smp(stivale2_struct *);
+void async();
+void klog();
+void serial(stivale2_struct *);
 
 } // namespace bootstrap
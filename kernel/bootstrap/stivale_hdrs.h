@@ -31,14 +31,17 @@ stivale2_get_tag(struct stivale2_struct *stivale2_struct, uint64_t id)
     }
 }
 
+// size (optional) gets the size of the module in bytes
 static void *
-stivale2_get_mod(struct stivale2_struct_tag_modules *mod, const char *str)
+stivale2_get_mod(struct stivale2_struct_tag_modules *mod, const char *str, uint64_t *size = nullptr)
 {
     void *ptr = nullptr;
     for (int i = 0; i < mod->module_count; i++) {
         // TODO: can be changed to strncmp?
         if (strcmp(mod->modules[i].string, str) == 0) {
             ptr = (void *)mod->modules[i].begin;
+            if (size != nullptr)
+                *size = mod->modules[i].end - mod->modules[i].begin;
             break;
         }
     }
@@ -0,0 +1,355 @@
+/**
+ * x86-64 CPU helpers (cpuid, model specific registers, time stamp counter)
+ *
+ * Small wrappers around single instructions, they live in the header so they can be inlined in
+ * hot paths (reading the TSC, writing the TSC deadline...)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace cpu {
+
+/** Upper bound of CPUs the kernel keeps per-CPU state for */
+const uint32_t MAX_CPUS = 64;
+
+/* Model Specific Registers */
+const uint32_t MSR_APIC_BASE      = 0x1b;
+const uint32_t MSR_TSC_DEADLINE   = 0x6e0;
+const uint32_t MSR_EFER           = 0xc0000080;
+const uint32_t MSR_STAR           = 0xc0000081;
+const uint32_t MSR_LSTAR          = 0xc0000082;
+const uint32_t MSR_SFMASK         = 0xc0000084;
+const uint32_t MSR_GS_BASE        = 0xc0000101;
+const uint32_t MSR_KERNEL_GS_BASE = 0xc0000102;
+
+/** EFER: SYSCALL/SYSRET enable */
+const uint64_t EFER_SCE = 1UL << 0;
+
+/**
+ * Registers returned by the cpuid instruction
+ */
+struct cpuid_t
+{
+    uint32_t eax;
+    uint32_t ebx;
+    uint32_t ecx;
+    uint32_t edx;
+};
+
+/**
+ * Query a cpuid leaf (and subleaf)
+ */
+inline cpuid_t
+cpuid(uint32_t leaf, uint32_t subleaf = 0)
+{
+    cpuid_t regs;
+    asm volatile("cpuid"
+                 : "=a"(regs.eax), "=b"(regs.ebx), "=c"(regs.ecx), "=d"(regs.edx)
+                 : "a"(leaf), "c"(subleaf));
+    return regs;
+}
+
+/**
+ * Read a model specific register
+ */
+inline uint64_t
+rdmsr(uint32_t msr)
+{
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * Write a model specific register
+ */
+inline void
+wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+/**
+ * Read the time stamp counter
+ *
+ * lfence keeps earlier instructions from being reordered after the read
+ */
+inline uint64_t
+rdtsc()
+{
+    uint32_t low, high;
+    asm volatile("lfence; rdtsc" : "=a"(low), "=d"(high) : : "memory");
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * Spin loop hint
+ */
+inline void
+pause()
+{
+    asm volatile("pause" : : : "memory");
+}
+
+/**
+ * Disable interrupts and return the previous rflags
+ */
+inline uint64_t
+irq_save()
+{
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/**
+ * Restore the interrupt flag saved by irq_save()
+ */
+inline void
+irq_restore(uint64_t flags)
+{
+    asm volatile("push %0; popfq" : : "r"(flags) : "memory", "cc");
+}
+
+/** RFLAGS interrupt enable flag */
+const uint64_t RFLAGS_IF = 1UL << 9;
+/** RFLAGS trap, direction and alignment check flags */
+const uint64_t RFLAGS_TF = 1UL << 8;
+const uint64_t RFLAGS_DF = 1UL << 10;
+const uint64_t RFLAGS_AC = 1UL << 18;
+
+/**
+ * Maskable interrupts are enabled on the calling CPU
+ */
+inline bool
+irq_enabled()
+{
+    uint64_t flags;
+    asm volatile("pushfq; pop %0" : "=r"(flags));
+    return (flags & RFLAGS_IF) != 0;
+}
+
+/**
+ * Set the base of the gs segment (per CPU data)
+ *
+ * @warning Reloading the gs selector (load_gdt) clears it
+ */
+inline void
+set_gs_base(uint64_t base)
+{
+    wrmsr(MSR_GS_BASE, base);
+}
+
+/**
+ * Enable SSE (fxsave/fxrstor, SIMD exceptions), the compiler freely emits SSE instructions
+ */
+inline void
+enable_sse()
+{
+    uint64_t cr0, cr4;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~(1UL << 2); /* EM */
+    cr0 |= (1UL << 1);  /* MP */
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= (1UL << 9) | (1UL << 10); /* OSFXSR, OSXMMEXCPT */
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+}
+
+/** CR0 Task Switched bit (FPU/SSE instructions raise #NM while set) */
+const uint64_t CR0_TS = 1UL << 3;
+
+/**
+ * Read CR0
+ */
+inline uint64_t
+read_cr0()
+{
+    uint64_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+/**
+ * Make the next FPU/SSE instruction raise #NM
+ */
+inline void
+set_ts()
+{
+    asm volatile("mov %0, %%cr0" : : "r"(read_cr0() | CR0_TS) : "memory");
+}
+
+/**
+ * Allow FPU/SSE instructions again
+ */
+inline void
+clts()
+{
+    asm volatile("clts" : : : "memory");
+}
+
+/* CR4 bits */
+const uint64_t CR4_PGE   = 1UL << 7;
+const uint64_t CR4_PCIDE = 1UL << 17;
+
+/**
+ * Read CR4
+ */
+inline uint64_t
+read_cr4()
+{
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+/**
+ * Write CR4 (changing PGE or PCIDE flushes the whole TLB)
+ */
+inline void
+write_cr4(uint64_t cr4)
+{
+    asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+/**
+ * Halt until the next interrupt, forever
+ */
+[[noreturn]] inline void
+park()
+{
+    while (true)
+        asm volatile("sti; hlt");
+}
+
+/**
+ * TSC runs at a constant rate in every P/C state (cpuid 0x80000007 edx bit 8)
+ */
+inline bool
+has_invariant_tsc()
+{
+    if (cpuid(0x80000000).eax < 0x80000007)
+        return false;
+    return (cpuid(0x80000007).edx & (1 << 8)) != 0;
+}
+
+/**
+ * MONITOR/MWAIT are available (cpuid 1 ecx bit 3)
+ */
+inline bool
+has_monitor()
+{
+    return (cpuid(1).ecx & (1 << 3)) != 0;
+}
+
+/**
+ * MWAIT hint of the deepest C-state enumerated by cpuid 5 (sub-state 0), C1 if there is none
+ *
+ * edx holds the number of sub-states of C0..C7 (4 bits each), the hint of Cn is (n - 1) << 4
+ */
+inline uint32_t
+mwait_deepest()
+{
+    if (cpuid(0).eax < 5)
+        return 0;
+
+    uint32_t substates = cpuid(5).edx;
+    for (uint32_t c = 7; c >= 2; c--) {
+        if (((substates >> (c * 4)) & 0xf) != 0)
+            return (c - 1) << 4;
+    }
+    return 0;
+}
+
+/**
+ * Local APIC timer keeps running in every C-state (ARAT, cpuid 6 eax bit 2)
+ *
+ * Without it C3 and deeper stop the timer, in one-shot and TSC-deadline modes
+ */
+inline bool
+has_arat()
+{
+    if (cpuid(0).eax < 6)
+        return false;
+    return (cpuid(6).eax & (1 << 2)) != 0;
+}
+
+/**
+ * Arm address monitoring on the line holding addr
+ */
+inline void
+monitor(const void *addr)
+{
+    asm volatile("monitor" : : "a"(addr), "c"(0), "d"(0) : "memory");
+}
+
+/**
+ * Enable interrupts and wait for a write to the monitored line or an interrupt (the sti shadow
+ * covers mwait, an interrupt can't be taken in between). Interrupts are disabled again on return
+ */
+inline void
+sti_mwait_cli(uint32_t hint)
+{
+    asm volatile("sti; mwait; cli" : : "a"(hint), "c"(0) : "memory");
+}
+
+/**
+ * Global pages are available (cpuid 1 edx bit 13)
+ */
+inline bool
+has_pge()
+{
+    return (cpuid(1).edx & (1 << 13)) != 0;
+}
+
+/**
+ * Process-context identifiers are available (cpuid 1 ecx bit 17)
+ */
+inline bool
+has_pcid()
+{
+    return (cpuid(1).ecx & (1 << 17)) != 0;
+}
+
+/**
+ * INVPCID is available (cpuid 7 ebx bit 10)
+ */
+inline bool
+has_invpcid()
+{
+    if (cpuid(0).eax < 7)
+        return false;
+    return (cpuid(7).ebx & (1 << 10)) != 0;
+}
+
+/**
+ * Invalidate TLB entries by process-context identifier
+ *
+ * @param type 0 one address of pcid, 1 every non-global entry of pcid, 2 everything, 3 every
+ * non-global entry
+ */
+inline void
+invpcid(uint64_t type, uint64_t pcid, uint64_t addr)
+{
+    struct
+    {
+        uint64_t pcid;
+        uint64_t addr;
+    } descriptor = { pcid, addr };
+    asm volatile("invpcid %0, %1" : : "m"(descriptor), "r"(type) : "memory");
+}
+
+/**
+ * Local APIC timer supports TSC-deadline mode (cpuid 1 ecx bit 24)
+ */
+inline bool
+has_tsc_deadline()
+{
+    return (cpuid(1).ecx & (1 << 24)) != 0;
+}
+
+} // namespace cpu
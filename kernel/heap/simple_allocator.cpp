@@ -6,15 +6,24 @@
 
 #include "heap/simple_allocator.h"
 #include "kernel.h"
+#include "lib/string.h"
 
 namespace heap {
 
+static sync::lock_stats heap_stats("heap");
+static sync::lock_stats fault_stats("heap faults");
+
 /**
  * Construct the heap
  *
- * Can be on different chunks of physical memory (virtual memory mapping)
+ * Can be on different chunks of physical memory (virtual memory mapping). In lazy mode the heap
+ * lives in its own virtual window and only the page holding the first header is mapped (the page
+ * fault handler isn't installed yet when the heap is bootstrapped)
  */
-simple_allocator::simple_allocator(uint64_t pages)
+simple_allocator::simple_allocator(uint64_t pages, expansion_e mode)
+  : expansion(mode)
+  , lock(&heap_stats)
+  , fault_lock(&fault_stats)
 {
     auto aux = kernel::allocator.request_page();
     if (aux == nullptr) {
@@ -22,12 +31,19 @@ simple_allocator::simple_allocator(uint64_t pages)
         return;
     }
 
-    /* for each page, allocate and map them */
-    void *iter = aux;
-    for (uint64_t i = 0; i < pages - 1; i++) {
-        /* phys addr != virt addr*/
-        kernel::translator.map((uint64_t)iter, (uint64_t)kernel::allocator.request_page());
-        iter = (uint8_t *)iter + kernel::page_size;
+    if (this->expansion == expansion_e::lazy) {
+        kernel::translator.map(simple_allocator::LAZY_BASE, (uint64_t)aux);
+        this->resident_pages = 1;
+        aux                  = (void *)simple_allocator::LAZY_BASE;
+    } else {
+        /* for each page, allocate and map them */
+        void *iter = aux;
+        for (uint64_t i = 0; i < pages - 1; i++) {
+            /* phys addr != virt addr*/
+            kernel::translator.map((uint64_t)iter, (uint64_t)kernel::allocator.request_page());
+            iter = (uint8_t *)iter + kernel::page_size;
+        }
+        this->resident_pages = pages;
     }
 
     this->heap_address = aux;
@@ -59,6 +75,18 @@ simple_allocator::malloc(uint64_t size)
     if (size == 0)
         return nullptr;
 
+    auto flags = this->lock.lock_irqsave();
+    void *ret  = this->do_malloc(size);
+    this->lock.unlock_irqrestore(flags);
+    return ret;
+}
+
+/**
+ * Find (or make) room for size bytes (heap lock held)
+ */
+void *
+simple_allocator::do_malloc(uint64_t size)
+{
     /* round up size to ROUND_NUM (reduce fragmentation) */
     if (size % simple_allocator::ROUND_NUM != 0) {
         size -= (size % simple_allocator::ROUND_NUM);
@@ -90,7 +118,7 @@ simple_allocator::malloc(uint64_t size)
     }
     /* no memory for size, we need to expand the heap */
     this->expand_heap(size);
-    return malloc(size);
+    return this->do_malloc(size);
 }
 
 /**
@@ -102,15 +130,18 @@ simple_allocator::free(void *addr)
     /* -1 to get the header addr and not the memory block */
     heap_header *header = (heap_header *)addr - 1;
 
+    auto flags      = this->lock.lock_irqsave();
     header->is_free = true;
     this->combine_forward(header);
     this->combine_backward(header);
+    this->lock.unlock_irqrestore(flags);
 }
 
 /**
  * Increase heap size
  *
- * Get physical pages and map them to contiguous virtual addresses
+ * Get physical pages and map them to contiguous virtual addresses. In lazy mode only the virtual
+ * addresses are reserved, frames are mapped on first touch by handle_fault()
  */
 void
 simple_allocator::expand_heap(uint64_t size)
@@ -121,13 +152,18 @@ simple_allocator::expand_heap(uint64_t size)
         size += simple_allocator::ROUND_NUM;
     }
 
-    auto pages = size / kernel::page_size;
+    /* the new segment needs room for its header too, grow in whole pages */
+    auto pages = (size + sizeof(heap_header) + kernel::page_size - 1) / kernel::page_size;
+    size       = pages * kernel::page_size;
 
     heap_header *header = (heap_header *)this->heap_end;
     for (uint64_t i = 0; i < pages; i++) {
         /* phys addr != virt addr*/
-        kernel::translator.map((uint64_t)this->heap_end,
-                               (uint64_t)kernel::allocator.request_page());
+        if (this->expansion == expansion_e::eager) {
+            kernel::translator.map((uint64_t)this->heap_end,
+                                   (uint64_t)kernel::allocator.request_page());
+            this->resident_pages++;
+        }
         this->heap_end = (uint8_t *)this->heap_end + kernel::page_size;
     }
 
@@ -140,6 +176,50 @@ simple_allocator::expand_heap(uint64_t size)
     this->combine_backward(header);
 }
 
+/**
+ * Resolve a page fault inside the lazy heap window
+ *
+ * Called from the page fault handler for not-present faults. If the address belongs to the
+ * reserved heap, a zeroed frame is mapped on it. Several CPUs can fault on the same page at once,
+ * only the first one maps it
+ *
+ * @warning runs while the faulting CPU may hold the heap lock, it must not take it
+ *
+ * @param addr faulting virtual address (cr2)
+ * @return true if the fault was resolved and the instruction can be restarted
+ */
+bool
+simple_allocator::handle_fault(uint64_t addr)
+{
+    if (this->expansion != expansion_e::lazy)
+        return false;
+
+    if (addr < (uint64_t)this->heap_start || addr >= (uint64_t)this->heap_end)
+        return false;
+
+    uint64_t page = addr & ~((uint64_t)kernel::page_size - 1);
+    auto flags    = this->fault_lock.lock_irqsave();
+
+    if (kernel::translator.is_mapped(page)) {
+        this->fault_lock.unlock_irqrestore(flags);
+        return true;
+    }
+
+    void *frame = kernel::allocator.request_page();
+    if (frame == nullptr) {
+        this->fault_lock.unlock_irqrestore(flags);
+        return false;
+    }
+
+    /* frames are accessed through the identity map before being exposed to the heap */
+    memset(frame, 0, kernel::page_size);
+    kernel::translator.map(page, (uint64_t)frame);
+    this->resident_pages++;
+
+    this->fault_lock.unlock_irqrestore(flags);
+    return true;
+}
+
 /**
  * Split a heap node
  */
@@ -159,7 +239,8 @@ simple_allocator::heap_header::split(uint64_t size)
 
     heap_header *header = (heap_header *)((uint8_t *)this + size + sizeof(heap_header));
     /* linked list */
-    this->next->last = header;
+    if (this->next != nullptr)
+        this->next->last = header;
     header->next     = this->next;
     this->next       = header;
     header->last     = this;
@@ -1,12 +1,14 @@
 /**
  * Simple Allocator
  *
- * From "absurponcho" work
+ * From "absurponcho" work. malloc/free are serialised by a spinlock, lazy heap faults by another
+ * one (they happen while malloc holds the first)
  */
 
 #pragma once
 
 #include "heap/allocator_i.h"
+#include "sync/spinlock.h"
 #include <stdint.h>
 
 namespace heap {
@@ -14,16 +16,48 @@ namespace heap {
 class simple_allocator : allocator_i
 {
   public:
+    /**
+     * How the heap obtains physical memory when it grows
+     *
+     * - eager: every page is requested and mapped as soon as the heap grows
+     * - lazy: growing only reserves virtual addresses, the page fault handler maps a zeroed frame
+     *   the first time a page is touched (see handle_fault())
+     */
+    enum class expansion_e
+    {
+        eager,
+        lazy,
+    };
+
     simple_allocator()
       : heap_address(nullptr)
       , heap_lenght(0){};
 
-    simple_allocator(uint64_t);
+    simple_allocator(uint64_t, expansion_e mode = expansion_e::eager);
 
     simple_allocator &operator=(const simple_allocator &) = default;
 
     void *malloc(uint64_t);
     void free(void *);
+    bool handle_fault(uint64_t);
+
+    /** Gets the heap expansion mode */
+    expansion_e get_expansion() const
+    {
+        return this->expansion;
+    }
+
+    /** Gets the bytes of virtual address space reserved by the heap */
+    uint64_t get_reserved() const
+    {
+        return (uint8_t *)this->heap_end - (uint8_t *)this->heap_start;
+    }
+
+    /** Gets the number of pages backed by physical memory */
+    uint64_t get_resident() const
+    {
+        return this->resident_pages;
+    }
 
   private:
     void *heap_address;
@@ -31,6 +65,20 @@ class simple_allocator : allocator_i
 
     static const uint32_t ROUND_NUM = 0x10;
 
+    /**
+     * Virtual base of the lazy heap
+     *
+     * PML4 slot 320, untouched by limine (identity map, higher half direct map and kernel live in
+     * other slots) so every page of the window starts not present
+     */
+    static const uint64_t LAZY_BASE = 0xffffa00000000000;
+
+    expansion_e expansion   = expansion_e::eager;
+    uint64_t resident_pages = 0;
+
+    sync::ticket_lock lock;
+    sync::ticket_lock fault_lock;
+
     struct heap_header
     {
         uint64_t length;
@@ -45,6 +93,7 @@ class simple_allocator : allocator_i
     void *heap_end;
     heap_header *last_header;
 
+    void *do_malloc(uint64_t);
     void expand_heap(uint64_t);
     void combine_forward(heap_header *);
     void combine_backward(heap_header *);
@@ -79,22 +79,70 @@ idt_ptr::remap_pic(uint8_t ICW2_PIC1, uint8_t ICW2_PIC2)
     io::io_wait();
 }
 
+/** Handler of every vector, called by its entry stub */
+uint64_t interrupt_handlers[256];
+
+/**
+ * Point a gate to the entry stub of its vector and register the handler the stub calls
+ *
+ * Interrupt gate: the stub re-enables interrupts if the interrupted code had them enabled
+ */
+static void
+set_gate(interrupts::vector_e code, uint64_t handler, uint8_t ist)
+{
+    uint8_t vector = static_cast<uint8_t>(code);
+    interrupts::idt_entry *reserved =
+      (interrupts::idt_entry *)(kernel::idtr.ptr + vector * sizeof(interrupts::idt_entry));
+
+    interrupt_handlers[vector] = handler;
+    reserved->set_offset(interrupt_stubs[vector]);
+    reserved->selector  = interrupts::KERNEL_CS;
+    reserved->ist       = ist;
+    reserved->type_attr = static_cast<uint8_t>(interrupts::gate_e::interrupt2) |
+                          static_cast<uint8_t>(interrupts::status_e::enabled);
+}
+
 /**
  * Add a new interrupt
  *
- * Map (handler - function), if interrupt "code" arrives, call handler
+ * Map (handler - function), if interrupt "code" arrives, call handler. A non zero ist switches to
+ * that Interrupt Stack Table entry of the TSS
+ */
+void
+idt_ptr::add_handle(interrupts::vector_e code, void (*handler)(frame *), uint8_t ist)
+{
+    set_gate(code, (uint64_t)handler, ist);
+}
+
+/**
+ * Add a new exception that pushes an error code
+ *
+ * Same as the frame-only version but for vectors like the page fault where the CPU pushes an
+ * error code (the compiler needs the different signature to pop it before iretq)
+ */
+void
+idt_ptr::add_handle(interrupts::vector_e code,
+                    void (*handler)(frame *, uint64_t),
+                    uint8_t ist)
+{
+    set_gate(code, (uint64_t)handler, ist);
+}
+
+/**
+ * Add a gate ring 3 can raise with int, straight to its own entry code (no stub)
  */
 void
-idt_ptr::add_handle(interrupts::vector_e code, void (*handler)(frame *))
+idt_ptr::add_user_gate(interrupts::vector_e code, void (*entry)())
 {
     interrupts::idt_entry *reserved =
       (interrupts::idt_entry *)(kernel::idtr.ptr +
                                 static_cast<int>(code) * sizeof(interrupts::idt_entry));
 
-    reserved->set_offset((uint64_t)handler);
-    reserved->vector    = static_cast<uint8_t>(code);
-    reserved->type_attr = static_cast<uint8_t>(interrupts::gate_e::interrupt) |
-                          static_cast<uint8_t>(interrupts::status_e::enabled);
+    reserved->set_offset((uint64_t)entry);
+    reserved->selector  = interrupts::KERNEL_CS;
+    reserved->ist       = 0;
+    reserved->type_attr = static_cast<uint8_t>(interrupts::gate_e::interrupt2) |
+                          static_cast<uint8_t>(interrupts::status_e::enabled) | DPL_USER;
 }
 
 /**
@@ -25,12 +25,30 @@ enum class status_e
     disabled = 0x0,
 };
 
+/** Gate DPL that lets ring 3 raise the vector with int */
+const uint8_t DPL_USER = 0x60;
+
 enum class vector_e
 {
-    reserved = 0x9,
-    keyboard = 0x21,
+    divide_error       = 0x0,
+    invalid_opcode     = 0x6,
+    fpu_missing        = 0x7,
+    double_fault       = 0x8,
+    reserved           = 0x9,
+    general_protection = 0xd,
+    page_fault         = 0xe,
+    keyboard           = 0x21,
+    serial             = 0x24,
+    apic_timer         = 0x30,
+    reschedule         = 0x31,
+    tlb_shootdown      = 0x32,
+    syscall            = 0x80,
+    apic_spurious      = 0xff,
 };
 
+/** Kernel code segment selector (see segmentation::table) */
+const uint16_t KERNEL_CS = 0x08;
+
 /**
  * Struct to hold the pointer to the IDT table. We'll use
  * this struct to pass it to the interrupt register
@@ -41,7 +59,9 @@ struct idt_ptr
     uint64_t ptr;
     idt_ptr();
     void set_ptr(uint64_t);
-    void add_handle(interrupts::vector_e code, void (*handler)(frame *));
+    void add_handle(interrupts::vector_e code, void (*handler)(frame *), uint8_t ist = 0);
+    void add_handle(interrupts::vector_e code, void (*handler)(frame *, uint64_t), uint8_t ist = 0);
+    void add_user_gate(interrupts::vector_e code, void (*entry)());
     static void remap_pic(uint8_t, uint8_t);
 } __attribute__((packed));
 
@@ -51,7 +71,7 @@ struct idt_ptr
 struct idt_entry
 {
     uint16_t offset_low;
-    uint16_t vector;
+    uint16_t selector;
     uint8_t ist;
     uint8_t type_attr;
     uint16_t offset_middle;
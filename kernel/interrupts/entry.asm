@@ -0,0 +1,129 @@
+;;
+; Interrupt entry stubs
+;
+; Every IDT gate points to the stub of its vector (interrupt gate, interrupts disabled on entry),
+; which jumps to the handler registered in interrupt_handlers. The stubs keep the handlers unaware
+; of ring 3:
+;
+;   - From ring 0 the stub restores the interrupt flag of the interrupted code (the handlers were
+;     installed as trap gates before) and jumps to the handler, which returns with its iretq
+;   - Page faults are left with interrupts disabled: an interrupt or another thread could fault
+;     and overwrite cr2 before the handler reads it. The handler enables them once it has cr2
+;   - From ring 3 the stub switches to the kernel gs base (swapgs) and builds a ring 0 frame that
+;     returns to the stub itself, which switches gs back and returns to ring 3. The ring 0 frame
+;     points (rsp) to the frame pushed by the CPU, see interrupts::user_frame()
+;
+; @author Ernesto Martínez García <me@ecomaikgolf.com>
+;
+
+; tell nasm we need 64 bit instructions
+[bits 64]
+
+KERNEL_CS equ 0x08
+KERNEL_DS equ 0x10
+; page fault vector (%define, the stubs compare it in %if)
+%define PAGE_FAULT 14
+
+;
+; Vector without error code
+;
+;   [rsp + 0] rip, [rsp + 8] cs, [rsp + 16] rflags, [rsp + 24] rsp, [rsp + 32] ss
+;
+%macro STUB 1
+stub_%1:
+	test byte [rsp + 8], 3
+	jnz %%user
+	bt qword [rsp + 16], 9 ; interrupted code had interrupts enabled
+	jnc %%kernel
+	sti
+%%kernel:
+	jmp [interrupt_handlers + %1 * 8]
+%%user:
+	swapgs
+	cld ; the kernel expects the direction flag clear
+	push rax
+	lea rax, [rsp + 8] ; frame pushed by the CPU
+	push KERNEL_DS ; ss
+	push rax ; rsp
+	pushfq ; rflags (interrupts disabled)
+	push KERNEL_CS
+	lea rax, [rel %%back]
+	push rax ; rip
+	mov rax, [rsp + 40]
+	sti
+	jmp [interrupt_handlers + %1 * 8]
+%%back:
+	swapgs ; the handler iretq left rsp on the CPU frame
+	iretq
+%endmacro
+
+;
+; Vector with error code, the handler pops it before its iretq
+;
+;   [rsp + 0] error, [rsp + 8] rip, [rsp + 16] cs, [rsp + 24] rflags, ...
+;
+%macro STUB_ERROR 1
+stub_%1:
+	test byte [rsp + 16], 3
+	jnz %%user
+%if %1 != PAGE_FAULT
+	bt qword [rsp + 24], 9
+	jnc %%kernel
+	sti
+%endif
+%%kernel:
+	jmp [interrupt_handlers + %1 * 8]
+%%user:
+	swapgs
+	cld ; the kernel expects the direction flag clear
+	push rax
+	lea rax, [rsp + 16] ; frame pushed by the CPU (without the error code)
+	sub rsp, 8 ; keeps the handler stack aligned like a CPU pushed frame
+	push KERNEL_DS
+	push rax
+	pushfq
+	push KERNEL_CS
+	lea rax, [rel %%back]
+	push rax
+	push qword [rsp + 56] ; error code
+	mov rax, [rsp + 56]
+%if %1 != PAGE_FAULT
+	sti
+%endif
+	jmp [interrupt_handlers + %1 * 8]
+%%back:
+	swapgs
+	iretq
+%endmacro
+
+section .text
+
+interrupt_stubs_start:
+%assign vector 0
+%rep 256
+%if vector == 8 || (vector >= 10 && vector <= 14) || vector == 17 || vector == 21 || vector == 29 || vector == 30
+	STUB_ERROR %[vector]
+%else
+	STUB %[vector]
+%endif
+%assign vector vector + 1
+%endrep
+interrupt_stubs_end:
+
+section .rodata
+
+;
+; const uint64_t interrupt_stubs[256]
+;
+interrupt_stubs:
+%assign vector 0
+%rep 256
+	dq stub_%[vector]
+%assign vector vector + 1
+%endrep
+
+; make it accessible for other code
+GLOBAL interrupt_stubs
+GLOBAL interrupt_stubs_start
+GLOBAL interrupt_stubs_end
+EXTERN interrupt_handlers
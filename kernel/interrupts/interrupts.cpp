@@ -8,9 +8,48 @@
 #include "io/keyboard.h"
 #include "kernel.h"
 #include "lib/stdlib.h"
+#include "paging/tlb.h"
+#include "sched/thread.h"
+#include "user/process.h"
 
 namespace interrupts {
 
+/**
+ * Frame pushed by the CPU when the interrupt came from ring 3
+ *
+ * Handlers of ring 3 interrupts get a ring 0 frame returning to the entry stub, whose rsp points
+ * to the frame pushed by the CPU (see entry.asm)
+ *
+ * @return the ring 3 frame or nullptr if the interrupt came from ring 0
+ */
+frame *
+user_frame(frame *f)
+{
+    if (f->rip < (uint64_t)interrupt_stubs_start || f->rip >= (uint64_t)interrupt_stubs_end)
+        return nullptr;
+    return (frame *)f->rsp;
+}
+
+/**
+ * Exception without recovery: kills the process that raised it, stops the CPU if it was the
+ * kernel
+ */
+[[noreturn]] static void
+fatal(frame *f, const char *name)
+{
+    frame *user = user_frame(f);
+    if (user != nullptr)
+        user::kill(name, user->rip);
+
+    kernel::tty.pushColor(screen::color_e::RED);
+    kernel::tty.fmt("%s at %p", name, f->rip);
+    kernel::tty.popColor();
+    kernel::tty.flush();
+
+    while (true)
+        asm volatile("cli; hlt");
+}
+
 /**
  * Reserved special interrupt
  */
@@ -20,6 +59,104 @@ reserved(frame *)
     kernel::tty.println("Hola desde las interrupciones!");
 }
 
+/**
+ * Divide error exception
+ */
+__attribute__((interrupt)) void
+divide_error(frame *f)
+{
+    fatal(f, "divide error");
+}
+
+/**
+ * Invalid opcode exception
+ */
+__attribute__((interrupt)) void
+invalid_opcode(frame *f)
+{
+    fatal(f, "invalid opcode");
+}
+
+/**
+ * General protection exception
+ */
+__attribute__((interrupt)) void
+general_protection(frame *f, uint64_t)
+{
+    fatal(f, "general protection fault");
+}
+
+/**
+ * Page fault exception
+ *
+ * Not-present faults inside the lazy heap are resolved by mapping a zeroed frame (demand paging),
+ * faults in ring 3 kill the process, anything else is fatal. Runs with interrupts disabled until
+ * the faulting address is read
+ */
+__attribute__((interrupt)) void
+page_fault(frame *f, uint64_t error)
+{
+    /* Faulting address */
+    uint64_t addr;
+    asm volatile("mov %%cr2, %0" : "=r"(addr));
+
+    /*
+     * The stub left interrupts disabled until cr2 is read, restore them now. Ring 3 code always
+     * runs with them enabled (the frame built by the stub doesn't say so)
+     */
+    if ((error & 0x4) || (f->rflags & (1 << 9)))
+        asm volatile("sti");
+
+    /* Bit 2 of the error code is set for ring 3 accesses */
+    if (error & 0x4)
+        user::kill("page fault", addr);
+
+    /* Bit 0 of the error code is clear for not-present pages */
+    if ((error & 0x1) == 0 && (user::sync_kernel(addr) || kernel::heap.handle_fault(addr)))
+        return;
+
+    kernel::tty.pushColor(screen::color_e::RED);
+    if (sched::is_guard(addr))
+        kernel::tty.fmt("stack overflow in thread %s (%p)", sched::current()->name, addr);
+    else
+        kernel::tty.fmt("page fault at %p (error %p)", addr, error);
+    kernel::tty.popColor();
+    kernel::tty.flush();
+
+    while (true)
+        asm volatile("cli; hlt");
+}
+
+/**
+ * Double fault
+ *
+ * Runs on its own IST stack: the usual cause is a thread overflowing into its guard page, where
+ * the CPU can't even push the page fault frame
+ */
+__attribute__((interrupt)) void
+double_fault(frame *, uint64_t)
+{
+    sched::thread *self = sched::current();
+    const char *name    = self != nullptr ? self->name : "boot";
+
+    kernel::tty.pushColor(screen::color_e::RED);
+    kernel::tty.fmt("double fault in thread %s (kernel stack overflow?)", name);
+    kernel::tty.popColor();
+    kernel::tty.flush();
+
+    while (true)
+        asm volatile("cli; hlt");
+}
+
+/**
+ * Device not available, first FPU/SSE instruction after a context switch (lazy FPU)
+ */
+__attribute__((interrupt)) void
+fpu_missing(frame *)
+{
+    sched::fpu_fault();
+}
+
 /**
  * Keyboard handling interrupt
  */
@@ -29,7 +166,17 @@ keyboard(frame *)
     uint8_t status = io::inb(io::port::PS2);
     /* Return correct receive */
     io::outb(io::PIC1_COMMAND, 0x20);
-    kernel::keyboard.process_scancode(status);
+    io::PS2::interrupt(status);
+}
+
+/**
+ * COM1 interrupt, the transmit FIFO is empty
+ */
+__attribute__((interrupt)) void
+serial(frame *)
+{
+    kernel::serial.handle();
+    io::outb(io::PIC1_COMMAND, 0x20);
 }
 
 /**
@@ -39,4 +186,42 @@ __attribute__((interrupt)) void
 ethernet(frame *)
 {}
 
+/**
+ * LAPIC timer interrupt
+ */
+__attribute__((interrupt)) void
+apic_timer(frame *)
+{
+    kernel::timer.handle();
+    /* The time slice may have expired (already acknowledged, safe to switch from here) */
+    sched::preempt();
+}
+
+/**
+ * LAPIC spurious interrupt (must not be acknowledged)
+ */
+__attribute__((interrupt)) void
+apic_spurious(frame *)
+{}
+
+/**
+ * Reschedule IPI, another CPU queued threads for this one
+ */
+__attribute__((interrupt)) void
+reschedule(frame *)
+{
+    kernel::lapic.eoi();
+    sched::resched_ipi();
+}
+
+/**
+ * TLB shootdown IPI, another CPU changed translations of an address space loaded here
+ */
+__attribute__((interrupt)) void
+tlb_shootdown(frame *)
+{
+    paging::tlb::handle_ipi();
+    kernel::lapic.eoi();
+}
+
 } // namespace interrupts
@@ -10,11 +10,41 @@
 
 namespace interrupts {
 
-/** Mandatory in order to compile */
-struct frame;
+/**
+ * Interrupt frame pushed by the CPU
+ */
+struct frame
+{
+    uint64_t rip;
+    uint64_t cs;
+    uint64_t rflags;
+    uint64_t rsp;
+    uint64_t ss;
+};
 
 __attribute__((interrupt)) void reserved(frame *);
+__attribute__((interrupt)) void divide_error(frame *);
+__attribute__((interrupt)) void invalid_opcode(frame *);
+__attribute__((interrupt)) void general_protection(frame *, uint64_t);
+__attribute__((interrupt)) void page_fault(frame *, uint64_t);
+__attribute__((interrupt)) void double_fault(frame *, uint64_t);
+__attribute__((interrupt)) void fpu_missing(frame *);
 __attribute__((interrupt)) void keyboard(frame *);
+__attribute__((interrupt)) void serial(frame *);
 __attribute__((interrupt)) void ethernet(frame *);
+__attribute__((interrupt)) void apic_timer(frame *);
+__attribute__((interrupt)) void apic_spurious(frame *);
+__attribute__((interrupt)) void reschedule(frame *);
+__attribute__((interrupt)) void tlb_shootdown(frame *);
+
+frame *user_frame(frame *);
+
+/** Handler of every vector, called by its entry stub (entry.asm) */
+extern "C" uint64_t interrupt_handlers[256];
+/** Entry stub of every vector */
+extern "C" const uint64_t interrupt_stubs[256];
+/** Code of the entry stubs */
+extern "C" const uint8_t interrupt_stubs_start[];
+extern "C" const uint8_t interrupt_stubs_end[];
 
 } // namespace interrupts
@@ -7,10 +7,88 @@
 #include "io/keyboard.h"
 #include "kernel.h"
 #include "lib/ctype.h"
-#include "lib/math.h"
 
 namespace io {
 
+/* Set 1 scancodes of the console chords (PgUp/PgDn come after the extended prefix) */
+static const uint8_t SCANCODE_EXTENDED = 0xe0;
+static const uint8_t SCANCODE_LALT     = 0x38;
+static const uint8_t SCANCODE_LSHIFT   = 0x2a;
+static const uint8_t SCANCODE_RSHIFT   = 0x36;
+static const uint8_t SCANCODE_RELEASED = 0x80;
+static const uint8_t SCANCODE_F1       = 0x3b;
+static const uint8_t SCANCODE_PGUP     = 0x49;
+static const uint8_t SCANCODE_PGDN     = 0x51;
+
+/** Modifiers of the chords (interrupt handler) */
+static bool chord_alt   = false;
+static bool chord_shift = false;
+/** Last scancode was the extended prefix */
+static bool chord_extended = false;
+
+/**
+ * Keyboard interrupt (interrupt context)
+ *
+ * Alt+F1..F4 shows a console and Shift+PgUp/PgDn move through its scrollback by half a screen.
+ * Handled here so they work whatever the console runs, the other keys go to the keyboard of the
+ * shown console (and bring its view back to the bottom)
+ */
+void
+PS2::interrupt(uint8_t keycode)
+{
+    bool extended  = chord_extended;
+    chord_extended = keycode == SCANCODE_EXTENDED;
+
+    uint8_t key   = keycode & ~SCANCODE_RELEASED;
+    bool pressed  = (keycode & SCANCODE_RELEASED) == 0;
+    bool modifier =
+      !extended && (key == SCANCODE_LALT || key == SCANCODE_LSHIFT || key == SCANCODE_RSHIFT);
+    if (modifier && key == SCANCODE_LALT)
+        chord_alt = pressed;
+    else if (modifier)
+        chord_shift = pressed;
+
+    if (chord_alt && keycode >= SCANCODE_F1 && keycode < SCANCODE_F1 + screen::CONSOLES) {
+        kernel::tty.show(keycode - SCANCODE_F1);
+        return;
+    }
+
+    if (chord_shift && extended && (keycode == SCANCODE_PGUP || keycode == SCANCODE_PGDN)) {
+        int32_t half = kernel::tty.get_console(kernel::tty.get_active()).get_rows() / 2;
+        kernel::tty.scroll_view(keycode == SCANCODE_PGUP ? half : -half);
+        return;
+    }
+
+    /* Typing goes back to the bottom of the scrollback */
+    uint32_t view = kernel::tty.get_view();
+    if (view != 0 && pressed && !modifier && keycode != SCANCODE_EXTENDED)
+        kernel::tty.scroll_view(-(int32_t)view);
+
+    kernel::keyboards[kernel::tty.get_active()].queue_scancode(keycode);
+}
+
+/**
+ * Keyboard of the console of the calling thread
+ */
+PS2 &
+PS2::local()
+{
+    return kernel::keyboards[screen::caller_console()];
+}
+
+/**
+ * Queue a PS2 keycode for the reader (interrupt context)
+ *
+ * Keys typed while nobody reads stay queued (type ahead) until the queue is full
+ */
+void
+PS2::queue_scancode(uint8_t keycode)
+{
+    /* Full: the key is lost, like on a real keyboard controller buffer overrun */
+    if (this->scancodes.push(keycode))
+        this->readers.wake_one();
+}
+
 /**
  * Process a PS2 keycode
  *
@@ -74,8 +152,8 @@ PS2::delete_char(uint16_t n)
 {
     if (n > buffer_count)
         return;
-    this->buffer_count = this->buffer_count - n; // -= n volatile deprecated
-    this->has_new_key  = true;
+    this->buffer_count -= n;
+    this->has_new_key = true;
 }
 
 /**
@@ -96,8 +174,8 @@ PS2::add_char(char letter)
     }
 
     this->buffer[this->buffer_count] = letter;
-    this->buffer_count               = this->buffer_count + 1; // += 1 volatile deprecated
-    this->has_new_key                = true;
+    this->buffer_count++;
+    this->has_new_key = true;
 }
 
 /**
@@ -136,8 +214,13 @@ PS2::scanf(char *buffer, uint32_t maxsize)
     this->buffer_handling = PS2::buffer_mode::limit;
     this->input_mode      = read_mode::scanf;
 
-    /* Wait until user finished introducing text */
+    /* Decode keys as they come until the user finishes introducing text (update_scanf) */
     while (this->input_mode == read_mode::scanf) {
+        this->readers.wait([this] { return !this->scancodes.empty(); });
+
+        uint8_t keycode;
+        while (this->input_mode == read_mode::scanf && this->scancodes.pop(keycode))
+            this->process_scancode(keycode);
     }
 
     this->buffer[this->buffer_count] = '\0';
@@ -154,41 +237,28 @@ PS2::scanf(char *buffer, uint32_t maxsize)
 /**
  * Scanf under the hood
  *
- * Responsible to manage the screen while executing scanf(). This function ins called from
- * process_scancode() directly from the interrupt to improve performance
+ * Responsible to manage the screen while executing scanf(). This function is called from
+ * process_scancode() in the reading thread
  */
 void
 PS2::update_scanf()
 {
-    static uint32_t last_text_size = 0;
     if (this->buffer_count > 0 && this->buffer[this->buffer_count - 1] == '\n') {
         /* User ends scanf with enter */
         this->input_mode = read_mode::kernel;
-        last_text_size   = 0;
+        this->echoed     = 0;
         return;
-    } else if (this->buffer_count > last_text_size) {
+    } else if (this->buffer_count > this->echoed) {
         /* User enters new character(s) */
-        auto new_chars             = this->buffer_count - last_text_size;
         buffer[this->buffer_count] = '\0';
-        kernel::tty.print(&this->buffer[last_text_size]);
-    } else if (this->buffer_count < last_text_size) {
-        /* User removes character(s) */
-        auto del_chars = last_text_size - this->buffer_count;
-        int new_x      = kernel::tty.get_x() - (del_chars * kernel::tty.glyph_x());
-        if (new_x < 0) [[unlikely]] {
-            kernel::tty.set_x(kernel::tty.get_width() - abs(new_x));
-            kernel::tty.set_y(kernel::tty.get_y() - kernel::tty.glyph_y());
-        } else [[likely]] {
-            kernel::tty.set_x(new_x);
-        }
-        kernel::tty.pushCoords(kernel::tty.get_x(), kernel::tty.get_y());
-        kernel::tty.pushColor(screen::color_e::BLACK);
-        for (uint32_t i = 0; i < del_chars; i++)
-            kernel::tty.put((char)0xdb); // Full color character
-        kernel::tty.popColor();
-        kernel::tty.popCoords();
+        kernel::tty.print(&this->buffer[this->echoed]);
+    } else if (this->buffer_count < this->echoed) {
+        /* User removes character(s), blanked in the console too */
+        kernel::tty.erase(this->echoed - this->buffer_count);
     }
-    last_text_size = this->buffer_count;
+    /* Echo right away instead of on the deferred flush */
+    kernel::tty.flush();
+    this->echoed = this->buffer_count;
 }
 
 /**
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include "sync/ring.h"
+#include "sync/wait.h"
 #include <stdint.h>
 
 namespace io {
@@ -69,10 +71,22 @@ enum class PS2_State
  * on it... right?
  *
  * We have to generate them by playing with pressed/released combinations
+ *
+ * The interrupt handler only queues the scancodes, they are decoded (and echoed) by the thread
+ * reading in scanf(), so the buffer and the state are touched by a single context
+ *
+ * Every virtual console has its own keyboard (kernel::keyboards), keys go to the one of the shown
+ * console. The console chords are handled by the interrupt handler itself (interrupt())
  */
 class PS2
 {
   public:
+    /** Keyboard interrupt: console chords or queue to the shown console */
+    static void interrupt(uint8_t);
+    /** Keyboard of the console of the calling thread */
+    static PS2 &local();
+    /** Queue a scancode (interrupt handler) */
+    void queue_scancode(uint8_t);
     /** Process a new scancode */
     void process_scancode(uint8_t);
     /** Delete n chars from buffer */
@@ -107,16 +121,20 @@ class PS2
 
   private:
     const static uint16_t DEFAULT_MAXSIZE = 256;
+    /** Scancodes waiting to be decoded */
+    const static uint64_t QUEUE_SIZE = 128;
     /** Input buffer max size */
     uint16_t buffer_maxsize = DEFAULT_MAXSIZE;
     /** Chars in the input buffer */
-    volatile uint16_t buffer_count = 0;
+    uint16_t buffer_count = 0;
     /** Input buffer */
     char *buffer = nullptr;
     /** Buffer has unrequested changes */
     bool has_new_key = false;
     /** Keyboard state */
     PS2_State state = PS2_State::Normal;
+    /** Chars of the scanf buffer already echoed */
+    uint32_t echoed = 0;
 
     enum class buffer_mode
     {
@@ -131,7 +149,12 @@ class PS2
     };
 
     buffer_mode buffer_handling;
-    volatile read_mode input_mode = read_mode::kernel;
+    read_mode input_mode = read_mode::kernel;
+
+    /** Interrupt handler to reader channel (a single reader at a time) */
+    sync::spsc_ring<uint8_t, QUEUE_SIZE> scancodes;
+    /** Thread sleeping in scanf */
+    sync::wait_queue readers;
 
     void update_scanf();
 };
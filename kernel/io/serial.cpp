@@ -0,0 +1,187 @@
+/**
+ * 16550 UART serial port
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "io/serial.h"
+#include "cpu/cpu.h"
+#include "io/bus.h"
+
+namespace io {
+
+/* Line control: 8 data bits, no parity, 1 stop bit (8N1) and divisor latch access */
+static const uint8_t LCR_8N1  = 0x03;
+static const uint8_t LCR_DLAB = 0x80;
+/* FIFO control: enable, clear both FIFOs, receive threshold of 14 bytes */
+static const uint8_t FCR_ENABLE = 0xc7;
+/* Modem control: DTR, RTS and OUT2 (gates the interrupt line), loopback for the self test */
+static const uint8_t MCR_NORMAL   = 0x0b;
+static const uint8_t MCR_LOOPBACK = 0x1e;
+/* Interrupt enable: transmitter holding register empty */
+static const uint8_t IER_THRE = 0x02;
+/* Line status: transmitter holding register empty (the FIFO can take new bytes) */
+static const uint8_t LSR_THRE = 0x20;
+/* Interrupt identification: both bits set if the FIFO works (16550A) */
+static const uint8_t IIR_FIFO = 0xc0;
+
+static const uint64_t TX_MASK = uart16550::TX_SIZE - 1;
+static_assert((uart16550::TX_SIZE & TX_MASK) == 0, "TX_SIZE must be a power of two");
+
+void
+uart16550::out(uart_reg reg, uint8_t value)
+{
+    outb(this->base + static_cast<uint16_t>(reg), value);
+}
+
+uint8_t
+uart16550::in(uart_reg reg)
+{
+    return inb(this->base + static_cast<uint16_t>(reg));
+}
+
+/**
+ * Detect and configure the UART of a port (8N1, FIFO enabled, polled transmission)
+ *
+ * @param base base I/O port
+ * @param baud line rate, a divisor of UART_BASE_BAUD
+ * @return false if there is no working UART
+ */
+bool
+uart16550::init(uint16_t base, uint32_t baud)
+{
+    this->base = base;
+    this->out(uart_reg::irq_enable, 0);
+    if (!this->set_baud(baud))
+        return false;
+
+    this->out(uart_reg::irq_id, FCR_ENABLE);
+    this->fifo = (this->in(uart_reg::irq_id) & IIR_FIFO) == IIR_FIFO ? 16 : 1;
+
+    /* Self test: a byte sent in loopback mode has to come back */
+    this->out(uart_reg::modem, MCR_LOOPBACK);
+    this->out(uart_reg::data, 0xae);
+    if (this->in(uart_reg::data) != 0xae)
+        return false;
+
+    this->out(uart_reg::modem, MCR_NORMAL);
+    this->present = true;
+    return true;
+}
+
+/**
+ * Change the line rate
+ *
+ * @return false if baud doesn't divide UART_BASE_BAUD
+ */
+bool
+uart16550::set_baud(uint32_t baud)
+{
+    if (baud == 0 || baud > UART_BASE_BAUD || UART_BASE_BAUD % baud != 0)
+        return false;
+
+    auto flags = this->lock.lock_irqsave();
+    /* Bytes still in the ring go out at the old rate */
+    if (this->present)
+        this->drain();
+
+    this->divisor = UART_BASE_BAUD / baud;
+    this->out(uart_reg::line_control, LCR_DLAB);
+    this->out(uart_reg::data, this->divisor & 0xff);
+    this->out(uart_reg::irq_enable, this->divisor >> 8);
+    this->out(uart_reg::line_control, LCR_8N1);
+    this->lock.unlock_irqrestore(flags);
+    return true;
+}
+
+/**
+ * Transmit from the interrupt from now on (its handler must be installed)
+ */
+void
+uart16550::enable_irq()
+{
+    auto flags = this->lock.lock_irqsave();
+    this->irq  = this->present;
+    this->lock.unlock_irqrestore(flags);
+}
+
+/**
+ * Move as many bytes from the ring to the FIFO as it can take (lock held)
+ */
+void
+uart16550::fill_fifo()
+{
+    if ((this->in(uart_reg::line_status) & LSR_THRE) == 0)
+        return;
+
+    for (uint8_t i = 0; i < this->fifo && this->head != this->tail; i++) {
+        this->out(uart_reg::data, this->tx[this->head & TX_MASK]);
+        this->head++;
+        this->sent++;
+    }
+}
+
+/**
+ * Send the whole ring polling the line status (lock held)
+ */
+void
+uart16550::drain()
+{
+    while (this->head != this->tail) {
+        uint64_t before = this->head;
+        while ((this->in(uart_reg::line_status) & LSR_THRE) == 0)
+            cpu::pause();
+        this->fill_fifo();
+        this->polled += this->head - before;
+    }
+}
+
+/**
+ * Queue bytes for transmission
+ *
+ * Only waits for the line if the ring fills up or interrupts are disabled
+ */
+void
+uart16550::write(const char *data, uint64_t length)
+{
+    if (!this->present)
+        return;
+
+    auto flags = this->lock.lock_irqsave();
+    for (uint64_t i = 0; i < length; i++) {
+        if (this->tail - this->head == TX_SIZE)
+            this->drain();
+        this->tx[this->tail & TX_MASK] = data[i];
+        this->tail++;
+    }
+
+    if (!this->irq || (flags & cpu::RFLAGS_IF) == 0) {
+        this->drain();
+    } else if (!this->busy) {
+        /* Start the transmission, the interrupt continues it once the FIFO empties */
+        this->fill_fifo();
+        this->busy = true;
+        this->out(uart_reg::irq_enable, IER_THRE);
+    }
+    this->lock.unlock_irqrestore(flags);
+}
+
+/**
+ * Transmitter holding register empty interrupt (interrupt context)
+ */
+void
+uart16550::handle()
+{
+    auto flags = this->lock.lock_irqsave();
+    /* Reading the identification acknowledges the interrupt */
+    this->in(uart_reg::irq_id);
+
+    this->fill_fifo();
+    if (this->head == this->tail) {
+        this->busy = false;
+        this->out(uart_reg::irq_enable, 0);
+    }
+    this->lock.unlock_irqrestore(flags);
+}
+
+} // namespace io
@@ -0,0 +1,106 @@
+/**
+ * 16550 UART serial port
+ *
+ * Output only. Writers copy the bytes to a transmit ring and the transmitter holding register
+ * empty interrupt refills the FIFO (16 bytes at once on a 16550A) until the ring is empty, so a
+ * writer never waits for the line unless the ring is full. Before the interrupt is enabled, and
+ * for writers with interrupts disabled (panics), the FIFO is filled by polling instead
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "sync/spinlock.h"
+#include <stdint.h>
+
+namespace io {
+
+/** Base port of the first serial port */
+const uint16_t COM1 = 0x3f8;
+/** Line rate of a divisor of 1 */
+const uint32_t UART_BASE_BAUD = 115200;
+
+/**
+ * UART registers (offsets from the base port)
+ */
+enum class uart_reg : uint16_t
+{
+    data         = 0, // THR/RBR, divisor low byte with DLAB
+    irq_enable   = 1, // IER, divisor high byte with DLAB
+    irq_id       = 2, // IIR (read), FCR (write)
+    line_control = 3,
+    modem        = 4,
+    line_status  = 5,
+    scratch      = 7,
+};
+
+class uart16550
+{
+  public:
+    /** Bytes of the transmit ring */
+    static const uint64_t TX_SIZE = 4096;
+
+    uart16550() = default;
+    bool init(uint16_t, uint32_t);
+    bool set_baud(uint32_t);
+    void enable_irq();
+    void write(const char *, uint64_t);
+    void handle();
+
+    /** There is an UART at the port */
+    bool is_present() const
+    {
+        return this->present;
+    }
+
+    /** Gets the line rate in bauds */
+    uint32_t get_baud() const
+    {
+        return UART_BASE_BAUD / this->divisor;
+    }
+
+    /** Gets the bytes of the transmit FIFO */
+    uint8_t get_fifo() const
+    {
+        return this->fifo;
+    }
+
+    /** Gets the bytes sent */
+    uint64_t get_sent() const
+    {
+        return this->sent;
+    }
+
+    /** Gets the bytes sent by polling (ring full or interrupts disabled) */
+    uint64_t get_polled() const
+    {
+        return this->polled;
+    }
+
+  private:
+    void out(uart_reg, uint8_t);
+    uint8_t in(uart_reg);
+    void fill_fifo();
+    void drain();
+
+    uint16_t base    = 0;
+    uint16_t divisor = 1;
+    uint8_t fifo     = 1;
+    bool present     = false;
+    /** Transmission driven by the interrupt */
+    bool irq = false;
+    /** The interrupt is enabled, it will refill the FIFO */
+    bool busy = false;
+
+    /** Transmit ring (free running indices) */
+    char tx[TX_SIZE];
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    sync::ticket_lock lock;
+
+    uint64_t sent   = 0;
+    uint64_t polled = 0;
+};
+
+} // namespace io
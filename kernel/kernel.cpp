@@ -12,6 +12,7 @@
 #include "lib/stdlib.h"
 #include "lib/string.h"
 #include "paging/PFA.h"
+#include "sched/thread.h"
 #include "screen/framebuffer.h"
 #include "shell/command.h"
 #include "stivale2.h"
@@ -21,9 +22,15 @@
 /** kernel stack */
 static uint8_t stack[8192];
 
+/** Stivale SMP parameters (start the APs, xAPIC mode) */
+static struct stivale2_header_tag_smp smp_hdr_tag = {
+    .tag   = { .identifier = STIVALE2_HEADER_TAG_SMP_ID, .next = 0 },
+    .flags = 0
+};
+
 /** Stivale tag parameters */
 static struct stivale2_header_tag_terminal terminal_hdr_tag = {
-    .tag   = { .identifier = STIVALE2_HEADER_TAG_TERMINAL_ID, .next = 0 },
+    .tag   = { .identifier = STIVALE2_HEADER_TAG_TERMINAL_ID, .next = (uint64_t)&smp_hdr_tag },
     .flags = 0
 };
 
@@ -50,6 +57,18 @@ __attribute__((section(".stivale2hdr"), used)) static struct stivale2_header sti
 extern "C" void _init();
 extern "C" void _fini();
 
+/**
+ * Shell thread
+ *
+ * @param console virtual console of the shell
+ */
+static void
+shell_thread(void *console)
+{
+    sched::current()->console = (uint64_t)console;
+    shell::commands::shell(0, nullptr);
+}
+
 /**
  * Kernel starting function
  * extern C to avoid C++ function mangling
@@ -67,27 +86,29 @@ _start(stivale2_struct *stivale2_struct)
     bootstrap::allocator(stivale2_struct);
     bootstrap::translator(stivale2_struct);
     bootstrap::enable_virtualaddr();
-    bootstrap::heap(0x10);
+    bootstrap::heap(0x10, heap::simple_allocator::expansion_e::lazy);
     bootstrap::screen(stivale2_struct);
     bootstrap::gdt();
     bootstrap::interrupts();
     bootstrap::enable_interrupts();
     bootstrap::keyboard();
+    bootstrap::serial(stivale2_struct);
     bootstrap::acpi(stivale2_struct);
+    bootstrap::clock();
+    bootstrap::sched();
+    bootstrap::klog();
+    bootstrap::smp(stivale2_struct);
+    bootstrap::async();
     bootstrap::pci();
     bootstrap::rtl8139();
 
     /* Welcome the user */
     kernel::tty.println("welcome to the alma kernel");
 
-    /* Start a shell */
-    shell::commands::shell(0, nullptr);
+    /* Start a shell on every console (Alt+F1..F4) */
+    for (uint64_t i = 0; i < screen::CONSOLES; i++)
+        sched::create("shell", shell_thread, (void *)i);
 
-    /* Call global destructors & functions */
-    _fini();
-    /* Shoudln't return (poweroff instead) */
-    __asm__("hlt");
-    /* To supress diagnostics */
-    while (1) {
-    };
+    /* Run threads until poweroff, this flow is now the idle thread */
+    sched::idle();
 }
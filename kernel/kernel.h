@@ -1,20 +1,29 @@
 #pragma once
 
 #include "acpi/acpi.h"
+#include "apic/lapic.h"
+#include "cpu/cpu.h"
 #include "heap/allocator_i.h"
 #include "heap/simple_allocator.h"
 #include "heap/trivial_allocator.h"
 #include "interrupts/IDT.h"
 #include "io/keyboard.h"
+#include "io/serial.h"
 #include "net/rtl8139.h"
 #include "paging/BPFA.h"
 #include "paging/PTM.h"
 #include "pci/pci.h"
 #include "screen/fast_renderer_i.h"
 #include "screen/fonts/psf1.h"
+#include "screen/fonts/psf2.h"
 #include "screen/simple_renderer_i.h"
 #include "segmentation/gdt.h"
 #include "shell/interpreter.h"
+#include "smp/smp.h"
+#include "time/clock.h"
+#include "time/event.h"
+#include "time/hpet.h"
+#include "time/wheel.h"
 #include <stdint.h>
 
 namespace kernel {
@@ -35,14 +44,19 @@ const auto page_size = uefi::page_size;
 /* Variables */
 inline paging::allocator::BPFA allocator;
 inline paging::translator::PTM translator __attribute__((aligned(uefi::page_size)));
-inline screen::fonts::psf1<screen::fast_renderer_i> tty;
-inline segmentation::gdt_ptr gdt;
+inline screen::fonts::psf2 tty;
 inline interrupts::idt_ptr idtr;
-inline io::PS2 keyboard;
+inline io::PS2 keyboards[screen::CONSOLES];
+inline io::uart16550 serial;
 inline acpi::rsdp_v2 rsdp;
 inline heap::simple_allocator heap;
 inline pci::pci_device *devices;
 inline net::rtl8139 rtl8139;
+inline apic::lapic lapic;
+inline time::hpet hpet;
+inline time::clocksource clock;
+inline time::clockevent timer;
+inline smp::processor cpus[cpu::MAX_CPUS];
 
 /* Kernel Constants */
 __attribute__((unused)) static void *_start_addr = &internal::_start_addr;
@@ -0,0 +1,370 @@
+/**
+ * Kernel log
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "klog/klog.h"
+#include "kernel.h"
+#include "lib/atomic.h"
+#include "lib/stdlib.h"
+#include "smp/smp.h"
+#include "sync/wait.h"
+#include <stdarg.h>
+
+namespace klog {
+
+/**
+ * Ring slot, a cache line pair per record so producers on different CPUs don't share lines
+ */
+struct alignas(64) slot
+{
+    std::atomic<uint64_t> state = 0;
+    record value;
+};
+
+static_assert(sizeof(slot) == 128, "a record must fill its slot");
+static_assert((RECORDS & (RECORDS - 1)) == 0, "RECORDS must be a power of two");
+
+static const uint64_t MASK = RECORDS - 1;
+
+static slot slots[RECORDS];
+/** Next sequence number to claim */
+alignas(64) static std::atomic<uint64_t> next = 0;
+
+/** Consumers fed by the consumer thread */
+static std::atomic<consumer *> consumers = nullptr;
+/** Consumer thread */
+static sync::wait_queue drainer;
+/** The consumer thread is going to sleep, producers have to wake it */
+static std::atomic<bool> sleeping = false;
+
+/**
+ * Log a line of text
+ *
+ * Interrupts are disabled while the slot is written, a reader never waits for a preempted writer
+ *
+ * @param level severity
+ * @param text line (without '\n')
+ * @param length characters of the line (cut to TEXT_SIZE)
+ */
+void
+write(level_e level, const char *text, uint64_t length)
+{
+    if (length > TEXT_SIZE)
+        length = TEXT_SIZE;
+
+    auto flags   = cpu::irq_save();
+    uint64_t seq = next.fetch_add(1, std::memory_order_relaxed);
+    slot *s      = &slots[seq & MASK];
+
+    s->state.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s->value.tsc    = cpu::rdtsc();
+    s->value.cpu    = smp::id();
+    s->value.level  = level;
+    s->value.length = length;
+    memcpy(s->value.text, text, length);
+
+    s->state.store(2 * seq + 2, std::memory_order_release);
+    cpu::irq_restore(flags);
+
+    /*
+     * Pairs with the store in the wait condition of the consumer thread (store sleeping, then check
+     * the slots): without the fence the load can pass the buffered state store, the consumer would
+     * see the slot incomplete and sleep while this sees it awake
+     */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst) && sleeping.exchange(false))
+        drainer.wake_one();
+}
+
+/**
+ * Append a string to a line being formatted
+ */
+static void
+append(char *line, uint32_t &length, const char *str)
+{
+    while (*str != '\0' && length < TEXT_SIZE)
+        line[length++] = *str++;
+}
+
+/**
+ * Log a formatted line (same specifiers as the tty: %i %s %p %c)
+ */
+void
+fmt(level_e level, const char *fmtstr, ...)
+{
+    va_list args;
+    va_start(args, fmtstr);
+    char line[TEXT_SIZE];
+    char buffer[32];
+    uint32_t length = 0;
+
+    for (uint64_t i = 0; fmtstr[i] != '\0' && length < TEXT_SIZE; i++) {
+        if (fmtstr[i] != '%' || fmtstr[i + 1] == '\0') {
+            line[length++] = fmtstr[i];
+            continue;
+        }
+
+        switch (fmtstr[++i]) {
+            case 'i': {
+                str(va_arg(args, int), buffer);
+                append(line, length, buffer);
+                break;
+            }
+            case 's': {
+                append(line, length, va_arg(args, const char *));
+                break;
+            }
+            case 'p': {
+                hstr(va_arg(args, uint64_t), buffer);
+                append(line, length, "0x");
+                append(line, length, buffer);
+                break;
+            }
+            case 'c': {
+                buffer[0] = (char)va_arg(args, int);
+                buffer[1] = '\0';
+                append(line, length, buffer);
+                break;
+            }
+        }
+    }
+
+    va_end(args);
+    write(level, line, length);
+}
+
+/**
+ * Read the record of a sequence number
+ *
+ * Records already overwritten are skipped (and counted in lost)
+ *
+ * @param cursor sequence number to read, advanced past the record read
+ * @param out copy of the record
+ * @param lost counter of the skipped records
+ * @return false if there is no complete record at cursor yet
+ */
+bool
+read(uint64_t &cursor, record &out, uint64_t *lost)
+{
+    while (true) {
+        uint64_t head = next.load(std::memory_order_acquire);
+        if (cursor >= head)
+            return false;
+
+        if (head - cursor > RECORDS) {
+            if (lost != nullptr)
+                *lost += head - RECORDS - cursor;
+            cursor = head - RECORDS;
+        }
+
+        slot *s        = &slots[cursor & MASK];
+        uint64_t state = s->state.load(std::memory_order_acquire);
+        if (state < 2 * cursor + 2)
+            return false; // still being written
+
+        if (state == 2 * cursor + 2) {
+            out = s->value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s->state.load(std::memory_order_relaxed) == state) {
+                cursor++;
+                return true;
+            }
+        }
+
+        /* Overwritten by a later lap while reading it */
+        if (lost != nullptr)
+            (*lost)++;
+        cursor++;
+    }
+}
+
+/**
+ * Sequence number of the oldest record in the ring
+ */
+uint64_t
+oldest()
+{
+    uint64_t head = next.load(std::memory_order_acquire);
+    return head > RECORDS ? head - RECORDS : 0;
+}
+
+/**
+ * Records logged since boot
+ */
+uint64_t
+logged()
+{
+    return next.load(std::memory_order_relaxed);
+}
+
+const char *
+level_name(level_e level)
+{
+    switch (level) {
+        case level_e::debug:
+            return "debug";
+        case level_e::info:
+            return "info";
+        case level_e::warning:
+            return "warn";
+        case level_e::error:
+            return "error";
+    }
+    return "?";
+}
+
+/**
+ * Write a record as a line: "[seconds.microseconds] level: text"
+ *
+ * @param line buffer of LINE_SIZE characters
+ * @return characters of the line (without the '\0')
+ */
+uint32_t
+render(const record &rec, char *line)
+{
+    uint64_t us = kernel::clock.cycles_to_ns(rec.tsc) / 1000;
+    char buffer[16];
+    uint32_t length = 0;
+
+    line[length++] = '[';
+    str((int)(us / 1000000), buffer);
+    for (uint32_t i = 0; buffer[i] != '\0'; i++)
+        line[length++] = buffer[i];
+
+    line[length++] = '.';
+    for (uint64_t digit = 100000; digit > 0; digit /= 10)
+        line[length++] = '0' + (us / digit) % 10;
+
+    line[length++] = ']';
+    line[length++] = ' ';
+    for (const char *name = level_name(rec.level); *name != '\0'; name++)
+        line[length++] = *name;
+    line[length++] = ':';
+    line[length++] = ' ';
+
+    memcpy(line + length, rec.text, rec.length);
+    length += rec.length;
+    line[length] = '\0';
+    return length;
+}
+
+/**
+ * Add a consumer, it starts with the oldest record still in the ring
+ */
+void
+attach(consumer *c)
+{
+    c->cursor = oldest();
+    c->next   = consumers.load(std::memory_order_relaxed);
+    while (!consumers.compare_exchange_weak(c->next, c, std::memory_order_release))
+        ;
+
+    /* The consumer thread may sleep with records this consumer didn't see */
+    if (sleeping.exchange(false))
+        drainer.wake_one();
+}
+
+/**
+ * There is something for a consumer (an unread record is complete)
+ */
+static bool
+ready()
+{
+    for (consumer *c = consumers.load(std::memory_order_acquire); c != nullptr; c = c->next) {
+        uint64_t head = next.load(std::memory_order_seq_cst);
+        if (c->cursor >= head)
+            continue;
+        if (head - c->cursor > RECORDS ||
+            slots[c->cursor & MASK].state.load(std::memory_order_acquire) >= 2 * c->cursor + 2)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Console consumer: warnings in yellow and errors in red
+ */
+static void
+tty_emit(const record &rec)
+{
+    if (rec.level < level_e::info)
+        return;
+
+    char line[LINE_SIZE];
+    render(rec, line);
+
+    screen::color_e color = screen::color_e::WHITE;
+    if (rec.level == level_e::warning)
+        color = screen::color_e::YELLOW;
+    else if (rec.level == level_e::error)
+        color = screen::color_e::RED;
+
+    kernel::tty.pushColor(color);
+    kernel::tty.println(line);
+    kernel::tty.popColor();
+}
+
+static consumer tty_consumer = { "tty", tty_emit };
+
+/**
+ * Serial consumer: every record, a line each
+ */
+static void
+serial_emit(const record &rec)
+{
+    char line[LINE_SIZE + 2];
+    uint32_t length = render(rec, line);
+    line[length++]  = '\r';
+    line[length++]  = '\n';
+    kernel::serial.write(line, length);
+}
+
+static consumer serial_consumer = { "serial", serial_emit };
+
+/**
+ * Copy the log to the serial port (it must be initialised)
+ */
+void
+attach_serial()
+{
+    attach(&serial_consumer);
+}
+
+/**
+ * Consumer thread: hand new records to every consumer, sleep when they are up to date
+ */
+static void
+drain(void *)
+{
+    while (true) {
+        drainer.wait([] {
+            sleeping.store(true, std::memory_order_seq_cst);
+            return ready();
+        });
+        sleeping.store(false, std::memory_order_relaxed);
+
+        for (consumer *c = consumers.load(std::memory_order_acquire); c != nullptr; c = c->next) {
+            record rec;
+            while (read(c->cursor, rec, &c->lost))
+                c->emit(rec);
+        }
+    }
+}
+
+/**
+ * Attach the console and start the consumer thread (the scheduler must be initialised), records
+ * logged before are printed then
+ */
+void
+init()
+{
+    attach(&tty_consumer);
+    if (sched::create("klog", drain, nullptr) == nullptr)
+        kernel::tty.println("klog: can't create the consumer thread");
+}
+
+} // namespace klog
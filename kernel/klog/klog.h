@@ -0,0 +1,83 @@
+/**
+ * Kernel log
+ *
+ * Diagnostics are stored as records (severity, TSC timestamp, CPU and a short line of text) in a
+ * lock-free ring that keeps the last RECORDS of them. Logging claims a sequence number with one
+ * fetch_add and copies the text to its slot, it can be done from any CPU and from interrupt
+ * context and never waits for the screen
+ *
+ * Consumers (the tty, the serial port...) read the ring at their own pace from a kernel thread,
+ * each one with its own cursor. A consumer that falls more than RECORDS behind loses the oldest
+ * records. The dmesg shell command reads every record still in the ring
+ *
+ * Slots are published seqlock style: the slot state is 2 * seq + 1 while the record of sequence
+ * number seq is written and 2 * seq + 2 once it is complete, readers copy the record and check the
+ * state didn't change
+ *
+ * @warning don't log with a run queue lock held, waking the consumer thread takes it
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace klog {
+
+enum class level_e : uint8_t
+{
+    debug,
+    info,
+    warning,
+    error,
+};
+
+/** Records kept in the ring */
+const uint64_t RECORDS = 256;
+/** Characters of a record, longer lines are cut */
+const uint32_t TEXT_SIZE = 108;
+/** Characters of a rendered record: timestamp, level, text and '\0' */
+const uint32_t LINE_SIZE = TEXT_SIZE + 32;
+
+/**
+ * Log record
+ */
+struct record
+{
+    /** Time stamp counter of the CPU that logged it */
+    uint64_t tsc;
+    uint16_t cpu;
+    level_e level;
+    uint8_t length;
+    char text[TEXT_SIZE];
+};
+
+/**
+ * Reader of the log, fed by the consumer thread
+ */
+struct consumer
+{
+    const char *name = nullptr;
+    /** Called for each record in order (consumer thread) */
+    void (*emit)(const record &) = nullptr;
+    /** Next sequence number to read */
+    uint64_t cursor = 0;
+    /** Records overwritten before this consumer read them */
+    uint64_t lost  = 0;
+    consumer *next = nullptr;
+};
+
+void write(level_e, const char *, uint64_t);
+void fmt(level_e, const char *, ...);
+bool read(uint64_t &, record &, uint64_t *lost = nullptr);
+uint64_t oldest();
+uint64_t logged();
+uint32_t render(const record &, char *);
+const char *level_name(level_e);
+
+void attach(consumer *);
+void attach_serial();
+void init();
+
+} // namespace klog
@@ -0,0 +1,160 @@
+/**
+ * Atomic operations
+ *
+ * Freestanding subset of <atomic> (the cross compiler is built without libstdc++) implemented with
+ * the gcc __atomic builtins. Same names and semantics as the standard ones so code can be moved to
+ * the real header if it ever becomes available
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace std {
+
+enum class memory_order : int
+{
+    relaxed = __ATOMIC_RELAXED,
+    consume = __ATOMIC_CONSUME,
+    acquire = __ATOMIC_ACQUIRE,
+    release = __ATOMIC_RELEASE,
+    acq_rel = __ATOMIC_ACQ_REL,
+    seq_cst = __ATOMIC_SEQ_CST,
+};
+
+inline constexpr memory_order memory_order_relaxed = memory_order::relaxed;
+inline constexpr memory_order memory_order_consume = memory_order::consume;
+inline constexpr memory_order memory_order_acquire = memory_order::acquire;
+inline constexpr memory_order memory_order_release = memory_order::release;
+inline constexpr memory_order memory_order_acq_rel = memory_order::acq_rel;
+inline constexpr memory_order memory_order_seq_cst = memory_order::seq_cst;
+
+/**
+ * Memory order of the load part of a compare exchange failure
+ */
+constexpr int
+failure_order(memory_order order)
+{
+    if (order == memory_order::acq_rel)
+        return __ATOMIC_ACQUIRE;
+    if (order == memory_order::release)
+        return __ATOMIC_RELAXED;
+    return static_cast<int>(order);
+}
+
+/**
+ * Atomic value
+ *
+ * T must be trivially copyable and at most 8 bytes (lock free on x86-64)
+ */
+template<typename T>
+class atomic
+{
+  public:
+    atomic() = default;
+    constexpr atomic(T value)
+      : value(value)
+    {}
+    atomic(const atomic &) = delete;
+    atomic &operator=(const atomic &) = delete;
+
+    T load(memory_order order = memory_order::seq_cst) const
+    {
+        return __atomic_load_n(&this->value, static_cast<int>(order));
+    }
+
+    void store(T desired, memory_order order = memory_order::seq_cst)
+    {
+        __atomic_store_n(&this->value, desired, static_cast<int>(order));
+    }
+
+    T exchange(T desired, memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_exchange_n(&this->value, desired, static_cast<int>(order));
+    }
+
+    bool compare_exchange_weak(T &expected,
+                               T desired,
+                               memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_compare_exchange_n(
+          &this->value, &expected, desired, true, static_cast<int>(order), failure_order(order));
+    }
+
+    bool compare_exchange_strong(T &expected,
+                                 T desired,
+                                 memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_compare_exchange_n(
+          &this->value, &expected, desired, false, static_cast<int>(order), failure_order(order));
+    }
+
+    T fetch_add(T arg, memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_fetch_add(&this->value, arg, static_cast<int>(order));
+    }
+
+    T fetch_sub(T arg, memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_fetch_sub(&this->value, arg, static_cast<int>(order));
+    }
+
+    T fetch_and(T arg, memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_fetch_and(&this->value, arg, static_cast<int>(order));
+    }
+
+    T fetch_or(T arg, memory_order order = memory_order::seq_cst)
+    {
+        return __atomic_fetch_or(&this->value, arg, static_cast<int>(order));
+    }
+
+    operator T() const
+    {
+        return this->load();
+    }
+
+    T operator=(T desired)
+    {
+        this->store(desired);
+        return desired;
+    }
+
+    T operator++()
+    {
+        return this->fetch_add(1) + 1;
+    }
+
+    T operator--()
+    {
+        return this->fetch_sub(1) - 1;
+    }
+
+  private:
+    static_assert(sizeof(T) <= sizeof(uint64_t), "atomic<T> must be lock free");
+
+    alignas(sizeof(T)) T value;
+};
+
+/**
+ * Fence between threads (CPUs)
+ */
+inline void
+atomic_thread_fence(memory_order order)
+{
+    __atomic_thread_fence(static_cast<int>(order));
+}
+
+/**
+ * Fence between a thread and an interrupt handler running on the same CPU (compiler barrier)
+ */
+inline void
+atomic_signal_fence(memory_order order)
+{
+    __atomic_signal_fence(static_cast<int>(order));
+}
+
+} // namespace std
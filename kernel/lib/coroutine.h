@@ -0,0 +1,160 @@
+/**
+ * Coroutine support
+ *
+ * Freestanding subset of <coroutine> (the cross compiler is built without libstdc++) implemented
+ * with the gcc __builtin_coro builtins. The compiler looks the names up in std, they must keep the
+ * standard ones
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+namespace std {
+
+/**
+ * Promise type of a coroutine returning R (R::promise_type)
+ */
+template<typename R, typename... Args>
+struct coroutine_traits
+{
+    using promise_type = typename R::promise_type;
+};
+
+template<typename Promise = void>
+struct coroutine_handle;
+
+/**
+ * Type erased coroutine handle
+ */
+template<>
+struct coroutine_handle<void>
+{
+    constexpr coroutine_handle() noexcept = default;
+    constexpr coroutine_handle(decltype(nullptr)) noexcept {}
+
+    constexpr void *address() const noexcept
+    {
+        return this->frame;
+    }
+
+    static constexpr coroutine_handle from_address(void *addr) noexcept
+    {
+        coroutine_handle handle;
+        handle.frame = addr;
+        return handle;
+    }
+
+    constexpr explicit operator bool() const noexcept
+    {
+        return this->frame != nullptr;
+    }
+
+    bool done() const noexcept
+    {
+        return __builtin_coro_done(this->frame);
+    }
+
+    void operator()() const
+    {
+        this->resume();
+    }
+
+    void resume() const
+    {
+        __builtin_coro_resume(this->frame);
+    }
+
+    void destroy() const
+    {
+        __builtin_coro_destroy(this->frame);
+    }
+
+  protected:
+    void *frame = nullptr;
+};
+
+/**
+ * Coroutine handle with access to its promise
+ */
+template<typename Promise>
+struct coroutine_handle : coroutine_handle<void>
+{
+    constexpr coroutine_handle() noexcept = default;
+    constexpr coroutine_handle(decltype(nullptr)) noexcept {}
+
+    static coroutine_handle from_promise(Promise &promise)
+    {
+        coroutine_handle handle;
+        handle.frame = __builtin_coro_promise((char *)&promise, alignof(Promise), true);
+        return handle;
+    }
+
+    static constexpr coroutine_handle from_address(void *addr) noexcept
+    {
+        coroutine_handle handle;
+        handle.frame = addr;
+        return handle;
+    }
+
+    Promise &promise() const
+    {
+        return *(Promise *)__builtin_coro_promise(this->frame, alignof(Promise), false);
+    }
+};
+
+/**
+ * Frame of the coroutine that does nothing (gcc frames start with the resume and destroy
+ * functions)
+ */
+struct noop_coroutine_frame
+{
+    void (*resume)(void *);
+    void (*destroy)(void *);
+};
+
+inline void
+noop_coroutine_step(void *)
+{}
+
+inline noop_coroutine_frame noop_frame = { noop_coroutine_step, noop_coroutine_step };
+
+/**
+ * Handle of a coroutine that returns immediately when resumed (symmetric transfer target when
+ * there is nothing to resume)
+ */
+inline coroutine_handle<>
+noop_coroutine() noexcept
+{
+    return coroutine_handle<>::from_address(&noop_frame);
+}
+
+/**
+ * Awaitable that always suspends
+ */
+struct suspend_always
+{
+    constexpr bool await_ready() const noexcept
+    {
+        return false;
+    }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+/**
+ * Awaitable that never suspends
+ */
+struct suspend_never
+{
+    constexpr bool await_ready() const noexcept
+    {
+        return true;
+    }
+    constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+    constexpr void await_resume() const noexcept {}
+};
+
+} // namespace std
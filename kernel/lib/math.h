@@ -10,3 +10,4 @@ unsigned int int_log10(unsigned int);
 unsigned int pow(unsigned int, unsigned int);
 double sqrt(double);
 #include "lib/math/abs.h"
+#include "lib/math/muldiv.h"
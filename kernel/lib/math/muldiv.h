@@ -0,0 +1,44 @@
+/**
+ * 128 bit intermediate multiplications
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Computes (a * b) / c with a 128 bit intermediate product
+ *
+ * Used for unit conversions (cycles <-> nanoseconds) where a * b overflows 64 bits. Done with
+ * mulq/divq as we don't link libgcc 128 bit helpers
+ *
+ * @warning the quotient must fit in 64 bits (divq raises #DE otherwise)
+ */
+inline uint64_t
+muldiv(uint64_t a, uint64_t b, uint64_t c)
+{
+    uint64_t quotient, remainder;
+    asm("mulq %[b]\n\t"
+        "divq %[c]"
+        : "=a"(quotient), "=&d"(remainder)
+        : "0"(a), [b] "r"(b), [c] "r"(c)
+        : "cc");
+    return quotient;
+}
+
+/**
+ * Computes (a * mult) >> shift with a 128 bit intermediate product
+ *
+ * Fixed point multiplication, cheaper than muldiv() when the divisor is known beforehand
+ *
+ * @param shift 1..63
+ */
+inline uint64_t
+mulshift(uint64_t a, uint64_t mult, uint8_t shift)
+{
+    uint64_t low, high;
+    asm("mulq %[mult]" : "=a"(low), "=d"(high) : "0"(a), [mult] "r"(mult) : "cc");
+    return (low >> shift) | (high << (64 - shift));
+}
@@ -9,6 +9,7 @@
 #include <stdint.h>
 
 void memset(void *, uint8_t, uint64_t);
+void *memcpy(void *, const void *, uint64_t);
 int strcmp(const char *, const char *);
 int strncmp(const char *, const char *, unsigned int);
 uint32_t strlen(const char *);
@@ -0,0 +1,19 @@
+/**
+ * memcpy
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Copies a memory chunk to a non overlapping one
+ */
+void *
+memcpy(void *dest, const void *src, uint64_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        *((uint8_t *)dest + i) = *((const uint8_t *)src + i);
+    return dest;
+}
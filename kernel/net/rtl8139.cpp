@@ -6,6 +6,8 @@
 
 #include "net/rtl8139.h"
 #include "kernel.h"
+#include "klog/klog.h"
+#include "sched/thread.h"
 
 namespace net {
 
@@ -44,9 +46,15 @@ rtl8139::start()
     /** Turn on the device */
     this->setconfig<uint8_t>(rtl8139_config::CONFIG1, 0x0);
 
-    /** Software reset */
+    /** Software reset, sleep between polls instead of spinning on the register */
     this->setconfig<uint8_t>(rtl8139_config::CR, 0x10);
+    uint64_t deadline = kernel::clock.now() + rtl8139::RESET_TIMEOUT_NS;
     while ((this->getconfig<uint8_t>(rtl8139_config::CR) & 0x10) != 0) {
+        if (kernel::clock.is_calibrated() && kernel::clock.now() > deadline) {
+            klog::fmt(klog::level_e::error, "rtl8139: reset timed out");
+            return;
+        }
+        sched::sleep(rtl8139::RESET_POLL_NS);
     }
 
     /** Set receive buffer */
@@ -60,6 +60,10 @@ class rtl8139
     rtl8139_config TSD_array[4]  = { TSD0, TSD1, TSD2, TSD3 };
     uint8_t tx_cur               = 0; // used to cycle TSAD and TSD arrays
 
+    /** Software reset deadline and polling period (ns) */
+    static const uint64_t RESET_TIMEOUT_NS = 100000000;
+    static const uint64_t RESET_POLL_NS    = 1000000;
+
     /** PCI device */
     pci::pci_device *device;
     /** MMIO base address */
@@ -6,17 +6,24 @@
 
 #include "paging/BPFA.h"
 #include "kernel.h"
+#include "percpu/percpu.h"
 
 namespace paging {
 
 namespace allocator {
 
+/** Page cache of every CPU (there is a single frame allocator, kernel::allocator) */
+DEFINE_PERCPU(page_cache, cpu_pages);
+
+static sync::lock_stats frames_stats("frames");
+
 /**
  * Construct the BPFA from the EFI memory map provided by stivale
  *
  * Only use "Free" pages (doesn't support reclaiming bootloader used pages)
  */
 BPFA::BPFA(stivale2_struct_tag_memmap *map)
+  : lock(&frames_stats)
 {
     if (map == NULL)
         return;
@@ -53,7 +60,7 @@ BPFA::BPFA(stivale2_struct_tag_memmap *map)
 
     this->list_first = this->buffer_base;
 
-    this->lock_pages(this->buffer_base, total_pages);
+    this->do_lock_pages((uint64_t)this->buffer_base, total_pages);
 }
 
 BPFA &
@@ -64,6 +71,7 @@ BPFA::operator=(BPFA &&rval)
     this->buffer_next = rval.buffer_next;
     this->list_first  = rval.list_first;
     this->list_last   = rval.list_last;
+    this->lock        = rval.lock;
 
     rval.buffer_base = nullptr;
     rval.buffer_limi = nullptr;
@@ -77,10 +85,63 @@ BPFA::operator=(BPFA &&rval)
 /**
  * Lock a page
  *
- * Like reserving a page, mark it as used
+ * Like reserving a page, mark it as used. Pages sitting in a CPU cache are already locked
  */
 bool
 BPFA::lock_page(uint64_t addr)
+{
+    auto flags = this->lock.lock_irqsave();
+    bool ret   = this->do_lock_page(addr);
+    this->lock.unlock_irqrestore(flags);
+    return ret;
+}
+
+/**
+ * Lock contiguous pages
+ */
+bool
+BPFA::lock_pages(uint64_t addr, uint64_t pages)
+{
+    auto flags = this->lock.lock_irqsave();
+    bool ret   = this->do_lock_pages(addr, pages);
+    this->lock.unlock_irqrestore(flags);
+    return ret;
+}
+
+/**
+ * Free a page
+ *
+ * From locked to free, through the CPU cache when possible
+ */
+bool
+BPFA::free_page(uint64_t addr)
+{
+    if (this->cached_free(addr))
+        return true;
+
+    auto flags = this->lock.lock_irqsave();
+    bool ret   = this->do_free_page(addr);
+    this->lock.unlock_irqrestore(flags);
+    return ret;
+}
+
+/**
+ * Free contiguous pages
+ */
+bool
+BPFA::free_pages(uint64_t addr, uint64_t pages)
+{
+    auto flags = this->lock.lock_irqsave();
+    bool ret   = this->do_free_pages(addr, pages);
+    this->lock.unlock_irqrestore(flags);
+    return ret;
+}
+
+/**
+ * Lock a page (allocator lock held)
+ */
+bool
+BPFA::do_lock_page(uint64_t addr)
 {
     auto iter = this->list_first;
     do {
@@ -114,17 +175,17 @@ BPFA::lock_page(uint64_t addr)
 }
 
 /**
- * Lock a contiguous pages
+ * Lock contiguous pages (allocator lock held)
  */
 bool
-BPFA::lock_pages(uint64_t addr, uint64_t pages)
+BPFA::do_lock_pages(uint64_t addr, uint64_t pages)
 {
     auto it       = addr;
     uint64_t done = 0;
     for (; pages > 0; pages--) {
         done++;
-        if (!this->lock_page(it)) {
-            this->free_pages(it, done);
+        if (!this->do_lock_page(it)) {
+            this->do_free_pages(it, done);
             return false;
         }
         it += kernel::page_size;
@@ -133,12 +194,10 @@ BPFA::lock_pages(uint64_t addr, uint64_t pages)
 }
 
 /**
- * Free a page
- *
- * From locked to free
+ * Free a page (allocator lock held)
  */
 bool
-BPFA::free_page(uint64_t addr)
+BPFA::do_free_page(uint64_t addr)
 {
     auto it = this->get_first();
     while (it != nullptr) {
@@ -166,13 +225,13 @@ BPFA::free_page(uint64_t addr)
 }
 
 /**
- * Free contiguous pages
+ * Free contiguous pages (allocator lock held)
  */
 bool
-BPFA::free_pages(uint64_t addr, uint64_t pages)
+BPFA::do_free_pages(uint64_t addr, uint64_t pages)
 {
     for (; pages > 0; pages--) {
-        if (!this->free_page(addr))
+        if (!this->do_free_page(addr))
             return false;
         addr += kernel::page_size;
     }
@@ -207,7 +266,8 @@ BPFA::lock_pages(void *addr, uint64_t pages)
 /**
  * Request a free page
  *
- * Get one free, lock it and return it's address
+ * Get one free, lock it and return it's address. Without a specific address the page comes from
+ * the CPU cache when possible
  */
 void *
 BPFA::request_page(void *ptr)
@@ -218,14 +278,103 @@ BPFA::request_page(void *ptr)
         return ptr;
     }
 
+    void *page = this->cached_request();
+    if (page != nullptr)
+        return page;
+
+    auto flags = this->lock.lock_irqsave();
+    page       = (void *)this->do_request_page();
+    this->lock.unlock_irqrestore(flags);
+    return page;
+}
+
+/**
+ * Take the first free page (allocator lock held)
+ *
+ * @return the page address or 0 if there is no free memory
+ */
+uint64_t
+BPFA::do_request_page()
+{
     auto iter = this->list_first;
     if (iter == nullptr)
-        return nullptr;
-    void *retval = (void *)iter->addr;
-    this->lock_page(iter->addr);
+        return 0;
+    uint64_t retval = iter->addr;
+    if (!this->do_lock_page(retval))
+        return 0;
     return retval;
 }
 
+/**
+ * Take a page from the calling CPU cache, refilling it with a batch from the list if empty
+ *
+ * The cache is only used once the CPU runs on its own per CPU area, before that it would be the
+ * template copied to every CPU
+ *
+ * @return the page or nullptr (no cache or no free memory)
+ */
+void *
+BPFA::cached_request()
+{
+    if (!percpu::loaded())
+        return nullptr;
+
+    /* The cache belongs to this CPU, interrupts (and migration) are kept out */
+    auto flags        = cpu::irq_save();
+    page_cache *cache = percpu::ptr(cpu_pages);
+
+    if (cache->count == 0) {
+        this->lock.lock();
+        while (cache->count < PAGE_CACHE_BATCH) {
+            uint64_t page = this->do_request_page();
+            if (page == 0)
+                break;
+            cache->pages[cache->count++] = page;
+        }
+        this->lock.unlock();
+    }
+
+    void *page = nullptr;
+    if (cache->count > 0)
+        page = (void *)cache->pages[--cache->count];
+
+    cpu::irq_restore(flags);
+    return page;
+}
+
+/**
+ * Keep a freed page in the calling CPU cache, giving a batch back to the list if full
+ *
+ * @return false if the CPU has no cache yet (the caller frees it to the list)
+ */
+bool
+BPFA::cached_free(uint64_t addr)
+{
+    if (!percpu::loaded())
+        return false;
+
+    auto flags        = cpu::irq_save();
+    page_cache *cache = percpu::ptr(cpu_pages);
+
+    if (cache->count == PAGE_CACHE_SIZE) {
+        this->lock.lock();
+        for (uint32_t i = 0; i < PAGE_CACHE_BATCH; i++) {
+            /* No list node left for it, keep it cached */
+            if (!this->do_free_page(cache->pages[cache->count - 1]))
+                break;
+            cache->count--;
+        }
+        this->lock.unlock();
+    }
+
+    bool cached = cache->count < PAGE_CACHE_SIZE;
+    if (cached)
+        cache->pages[cache->count++] = addr;
+
+    cpu::irq_restore(flags);
+    return cached;
+}
+
 /**
  * Get the largest memory chunk from the EFI map
  */
@@ -324,15 +473,18 @@ BPFA_page::split(uint64_t addr, BPFA_page *newaddr)
 void *
 BPFA::request_cont_page(uint32_t pages)
 {
-    auto it = this->get_first();
+    auto flags = this->lock.lock_irqsave();
+    auto it    = this->get_first();
     while (it != nullptr) {
         if (it->pages >= pages) {
             auto ret = it->addr;
-            this->lock_pages(it->addr, pages);
+            this->do_lock_pages(it->addr, pages);
+            this->lock.unlock_irqrestore(flags);
             return (void *)ret;
         }
         it = it->next;
     }
+    this->lock.unlock_irqrestore(flags);
     return nullptr;
 }
 
@@ -1,7 +1,8 @@
 /**
  * Kernel "Better" Page Frame Allocator
  *
- * Linked list of pages
+ * Linked list of pages, protected by a spinlock. Single page requests and frees go through a small
+ * per CPU cache first, refilled and drained in batches, so most of them don't touch the lock
  *
  * @author Ernesto Martínez García <me@ecomaikgolf.com>
  */
@@ -9,6 +10,7 @@
 #pragma once
 
 #include "stivale2.h"
+#include "sync/spinlock.h"
 #include <stdint.h>
 
 namespace paging {
@@ -39,6 +41,20 @@ struct BPFA_page
     void split(uint64_t, BPFA_page *);
 };
 
+/** Pages kept by every CPU */
+const uint32_t PAGE_CACHE_SIZE = 64;
+/** Pages moved between a CPU cache and the list at once */
+const uint32_t PAGE_CACHE_BATCH = 16;
+
+/**
+ * Free pages owned by a CPU
+ */
+struct page_cache
+{
+    uint32_t count = 0;
+    uint64_t pages[PAGE_CACHE_SIZE];
+};
+
 /**
  * Better Page Frame Allocator Class
  *
@@ -71,6 +87,16 @@ class BPFA
     };
 
   private:
+    bool do_free_page(uint64_t);
+    bool do_free_pages(uint64_t, uint64_t);
+    bool do_lock_page(uint64_t);
+    bool do_lock_pages(uint64_t, uint64_t);
+    uint64_t do_request_page();
+    void *cached_request();
+    bool cached_free(uint64_t);
+
+    sync::ticket_lock lock;
+
     BPFA_page *buffer_base;
     BPFA_page *buffer_next;
     BPFA_page *buffer_limi;
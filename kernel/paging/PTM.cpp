@@ -10,20 +10,27 @@
 #include "paging/PTM.h"
 #include "kernel.h"
 #include "paging/PFA.h"
+#include "paging/pcid.h"
+#include "smp/smp.h"
 
 namespace paging {
 
 namespace translator {
 
+static sync::lock_stats translator_stats("translator");
+
+/** Tables loaded in the CR3 of each CPU (nullptr: the kernel ones) */
+DEFINE_PERCPU(PTM *, active) = nullptr;
+
 /**
  * Page table manager constructor
  *
- * Just sets the PGDT to 0
+ * Without tables, they are given with set_PGDT()
  */
 PTM::PTM()
-{
-    memset(this->get_PGDT(), 0, uefi::page_size);
-}
+  : PGD_table(nullptr)
+  , lock(&translator_stats)
+{}
 
 /**
  * Map a virtual memory address to a physical memory addres using intel's x86-64 paging scheme
@@ -41,15 +48,23 @@ PTM::PTM()
  * "remove them" when we store it on any entry as the CPU "doesn't want them" but then when WE use
  * it we have to restore the address filling it with zeroes.
  *
+ * Replacing a present translation invalidates it on every CPU using the tables, right away or
+ * through batch if given (the caller flushes it)
+ *
  * @info https://www.iaik.tugraz.at/teaching/materials/os/tutorials/paging-on-intel-x86-64/
  * @info http://lenovopress.com/lp1468.pdf
  */
 void
-PTM::map(uint64_t virt, uint64_t phys)
+PTM::map(uint64_t virt, uint64_t phys, tlb::batch *batch)
 {
+    auto flags = this->lock.lock_irqsave();
+
     /* Parse uint64_t bits to a x86-64 virtual address struct */
     address_t *virtaddr = (address_t *)&virt;
 
+    /** Only process tables give ring 3 access, kernel mappings are supervisor only */
+    bool is_kernel = this == &kernel::translator;
+
     /** Get the page global entry from it's table */
     page_global_dir_entry_t *PGD = &this->get_PGDT()[virtaddr->global];
 
@@ -61,7 +76,7 @@ PTM::map(uint64_t virt, uint64_t phys)
         PGD->page_ppn    = (uint64_t)PUDT >> 12;
         PGD->present     = true;
         PGD->writeable   = true;
-        PGD->user_access = true;
+        PGD->user_access = !is_kernel;
     } else {
         PUDT = (page_upper_dir_entry_t *)((uint64_t)PGD->page_ppn << 12);
     }
@@ -77,7 +92,7 @@ PTM::map(uint64_t virt, uint64_t phys)
         PUD->page_ppn    = (uint64_t)PMDT >> 12;
         PUD->present     = true;
         PUD->writeable   = true;
-        PUD->user_access = true;
+        PUD->user_access = !is_kernel;
     } else {
         PMDT = (page_mid_dir_entry_t *)((uint64_t)PUD->page_ppn << 12);
     }
@@ -93,7 +108,7 @@ PTM::map(uint64_t virt, uint64_t phys)
         PMD->page_ppn    = (uint64_t)PTDT >> 12;
         PMD->present     = true;
         PMD->writeable   = true;
-        PMD->user_access = true;
+        PMD->user_access = !is_kernel;
     } else {
         PTDT = (page_table_entry_t *)((uint64_t)PMD->page_ppn << 12);
     }
@@ -102,13 +117,207 @@ PTM::map(uint64_t virt, uint64_t phys)
     page_table_entry_t *PTD = &PTDT[virtaddr->table];
 
     /** Fill it with the physical address */
+    bool remap       = PTD->present;
+    bool was_global  = PTD->global;
     PTD->page_ppn    = (uint64_t)phys >> 12;
     PTD->present     = true;
     PTD->writeable   = true;
-    PTD->user_access = true;
+    PTD->user_access = !is_kernel;
+    /** Kernel mappings are the same in every address space, keep them across CR3 writes */
+    PTD->global = is_kernel;
+
+    this->lock.unlock_irqrestore(flags);
+
+    /** Non-present translations are never cached, only a remap has stale TLB entries */
+    if (remap)
+        this->invalidate(virt, was_global, batch);
+}
+
+/**
+ * Remove the translation of a virtual address (4KiB pages only)
+ *
+ * The page is invalidated on every CPU using the tables, right away or through batch if given
+ */
+void
+PTM::unmap(uint64_t virt, tlb::batch *batch)
+{
+    auto flags              = this->lock.lock_irqsave();
+    page_table_entry_t *PTD = this->entry(virt);
+    bool present            = PTD != nullptr && PTD->present;
+    bool global             = present && PTD->global;
+    if (present)
+        PTD->present = false;
+    this->lock.unlock_irqrestore(flags);
+
+    if (present)
+        this->invalidate(virt, global, batch);
+}
+
+/**
+ * Invalidate a changed translation, in the batch or in a shootdown of its own (lock not held, the
+ * shootdown waits for the other CPUs)
+ */
+void
+PTM::invalidate(uint64_t virt, bool global, tlb::batch *batch)
+{
+    if (batch != nullptr) {
+        batch->add(virt, global);
+        return;
+    }
+
+    tlb::batch single;
+    single.add(virt, global);
+    this->flush(single);
+}
+
+/**
+ * Invalidate a batch of changed translations on every CPU using the tables
+ */
+void
+PTM::flush(tlb::batch &batch)
+{
+    if (batch.empty())
+        return;
+
+    /* CPUs that ran the tables before still tag their entries with its PCID */
+    bool user = this != &kernel::translator;
+    if (user)
+        this->stale.store(~0UL, std::memory_order_seq_cst);
+
+    batch.flush(this->cpus.load(std::memory_order_seq_cst), user);
+}
+
+/**
+ * Load the kernel tables in the CR3 of the calling CPU at boot, with PCID 0
+ *
+ * @param cpu index of the calling CPU (its per CPU area may not be loaded yet)
+ */
+void
+PTM::load(uint32_t cpu)
+{
+    this->cpus.fetch_or(1UL << cpu, std::memory_order_seq_cst);
+    asm volatile("mov %0, %%cr3" : : "r"(this->get_PGDT()) : "memory");
+}
+
+/**
+ * Switch the calling CPU to these tables
+ *
+ * With PCIDs the TLB entries of the tables (and of the previous ones) survive the switch, unless
+ * the tables changed since the CPU last ran them or their PCID was handed out again
+ */
+void
+PTM::activate()
+{
+    auto flags   = cpu::irq_save();
+    uint64_t bit = 1UL << smp::id();
+    PTM *prev    = percpu::read(active);
+    if (prev == nullptr)
+        prev = &kernel::translator;
+    if (prev == this) {
+        cpu::irq_restore(flags);
+        return;
+    }
+
+    uint64_t cr3   = (uint64_t)this->get_PGDT();
+    bool is_kernel = this == &kernel::translator;
+    if (pcid::enabled()) {
+        uint16_t id = is_kernel ? pcid::KERNEL : pcid::get(this->context, this->stale);
+        if (pcid::catch_up())
+            tlb::flush_all();
+
+        /* Pairs with flush(): either the shootdown sees us in cpus or we see the stale bit */
+        this->cpus.fetch_or(bit, std::memory_order_seq_cst);
+        bool stale = (this->stale.fetch_and(~bit, std::memory_order_seq_cst) & bit) != 0;
+        cr3 |= id | (stale && !is_kernel ? 0 : pcid::NOFLUSH);
+    } else {
+        this->cpus.fetch_or(bit, std::memory_order_seq_cst);
+    }
+
+    asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+
+    /* The kernel tables stay loaded everywhere, their mappings are part of every address space */
+    if (prev != &kernel::translator)
+        prev->cpus.fetch_and(~bit, std::memory_order_release);
+    percpu::write(active, is_kernel ? nullptr : this);
+
+    cpu::irq_restore(flags);
+}
+
+/**
+ * Give back the PCID of tables no CPU runs anymore, the PTM can take new ones (set_PGDT)
+ */
+void
+PTM::retire()
+{
+    pcid::put(this->context);
+}
+
+/**
+ * Check if a virtual address has a present translation
+ */
+bool
+PTM::is_mapped(uint64_t virt)
+{
+    auto flags  = this->lock.lock_irqsave();
+    bool mapped = this->walk(virt);
+    this->lock.unlock_irqrestore(flags);
+    return mapped;
+}
+
+/**
+ * Walk the tree down to the entry translating virt, without creating anything (lock held)
+ *
+ * Large pages count as present translations
+ */
+bool
+PTM::walk(uint64_t virt)
+{
+    address_t *virtaddr = (address_t *)&virt;
+
+    page_global_dir_entry_t *PGD = &this->get_PGDT()[virtaddr->global];
+    if (!PGD->present)
+        return false;
+
+    auto PUDT = (page_upper_dir_entry_t *)((uint64_t)PGD->page_ppn << 12);
+    auto PUD  = &PUDT[virtaddr->upper];
+    if (!PUD->present || PUD->size)
+        return PUD->present;
+
+    auto PMDT = (page_mid_dir_entry_t *)((uint64_t)PUD->page_ppn << 12);
+    auto PMD  = &PMDT[virtaddr->mid];
+    if (!PMD->present || PMD->size)
+        return PMD->present;
+
+    auto PTDT = (page_table_entry_t *)((uint64_t)PMD->page_ppn << 12);
+    return PTDT[virtaddr->table].present;
+}
+
+/**
+ * Page table entry translating virt (lock held)
+ *
+ * @return the entry or nullptr if a table on the way is missing or a large page covers virt
+ */
+page_table_entry_t *
+PTM::entry(uint64_t virt)
+{
+    address_t *virtaddr = (address_t *)&virt;
+
+    page_global_dir_entry_t *PGD = &this->get_PGDT()[virtaddr->global];
+    if (!PGD->present)
+        return nullptr;
+
+    auto PUDT = (page_upper_dir_entry_t *)((uint64_t)PGD->page_ppn << 12);
+    auto PUD  = &PUDT[virtaddr->upper];
+    if (!PUD->present || PUD->size)
+        return nullptr;
+
+    auto PMDT = (page_mid_dir_entry_t *)((uint64_t)PUD->page_ppn << 12);
+    auto PMD  = &PMDT[virtaddr->mid];
+    if (!PMD->present || PMD->size)
+        return nullptr;
 
-    /** Flush TLB Cache Entries  https://www.felixcloutier.com/x86/invlpg */
-    asm("invlpg %0" : : "m"(virt));
+    auto PTDT = (page_table_entry_t *)((uint64_t)PMD->page_ppn << 12);
+    return &PTDT[virtaddr->table];
 }
 
 } // namespace translator
@@ -10,7 +10,10 @@
 #pragma once
 
 #include "address.h"
+#include "lib/atomic.h"
 #include "lib/string.h"
+#include "paging/tlb.h"
+#include "sync/spinlock.h"
 #include "uefi/memory.h"
 
 namespace paging {
@@ -130,7 +133,13 @@ class PTM
 {
   public:
     PTM();
-    void map(uint64_t, uint64_t);
+    void map(uint64_t, uint64_t, tlb::batch * = nullptr);
+    void unmap(uint64_t, tlb::batch * = nullptr);
+    bool is_mapped(uint64_t);
+    void load(uint32_t);
+    void activate();
+    void retire();
+    void flush(tlb::batch &);
     static const uint16_t page_size = 512;
 
     /**
@@ -147,7 +156,19 @@ class PTM
     }
 
   private:
+    bool walk(uint64_t);
+    page_table_entry_t *entry(uint64_t);
+    void invalidate(uint64_t, bool, tlb::batch *);
+
     PGDT_wrapper *PGD_table;
+    /** CPUs that loaded the tables in their CR3 */
+    std::atomic<uint64_t> cpus = 0;
+    /** PCID generation and number (see paging::pcid) */
+    std::atomic<uint64_t> context = 0;
+    /** CPUs that may cache entries of an older version of the tables under their PCID */
+    std::atomic<uint64_t> stale = ~0UL;
+    /** Serialises changes to the tables (lock order: translator, then the frame allocator) */
+    sync::ticket_lock lock;
 };
 
 } // namespace translator
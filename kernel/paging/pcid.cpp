@@ -0,0 +1,195 @@
+/**
+ * Process-context identifiers
+ *
+ * The context of an address space is (generation << 12) | PCID, 0 before its first activation.
+ * Contexts of an older generation are stale: the address space keeps using its PCID on the CPUs
+ * running it (their TLBs only hold entries of that generation) until they switch, and gets a new
+ * one on its next activation
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "paging/pcid.h"
+#include "cpu/cpu.h"
+#include "percpu/percpu.h"
+#include "sync/spinlock.h"
+
+namespace paging {
+
+namespace pcid {
+
+static const uint64_t MASK = COUNT - 1;
+
+static bool use_pcid    = false;
+static bool use_invpcid = false;
+
+static sync::lock_stats pcid_stats("pcid");
+static sync::ticket_lock lock(&pcid_stats);
+/** Current generation (starts at 1, a context of 0 is never valid) */
+static std::atomic<uint64_t> current = 1;
+/** PCIDs handed out in the current generation */
+static uint64_t used[COUNT / 64] = { 1 };
+static uint64_t used_count       = 1;
+/** Where the search for a free PCID starts */
+static uint64_t hint = 1;
+
+/** Generation of the last full flush of the CPU */
+DEFINE_PERCPU(uint64_t, flushed_generation) = 0;
+
+/**
+ * Detect PCID support and enable global pages and PCIDs on the BSP (the kernel tables must be
+ * loaded, with PCID 0)
+ */
+void
+init()
+{
+    use_pcid    = cpu::has_pcid();
+    use_invpcid = use_pcid && cpu::has_invpcid();
+    init_cpu();
+}
+
+/**
+ * Enable global pages and PCIDs (if the BSP did) on the calling CPU
+ */
+void
+init_cpu()
+{
+    uint64_t cr4 = cpu::read_cr4();
+    if (cpu::has_pge())
+        cr4 |= cpu::CR4_PGE;
+    if (use_pcid)
+        cr4 |= cpu::CR4_PCIDE;
+    cpu::write_cr4(cr4);
+}
+
+/**
+ * PCIDs are enabled
+ */
+bool
+enabled()
+{
+    return use_pcid;
+}
+
+/**
+ * INVPCID can be used
+ */
+bool
+invpcid()
+{
+    return use_invpcid;
+}
+
+/**
+ * Find a free PCID and mark it used (lock held)
+ *
+ * @return the PCID or 0 if the generation is exhausted
+ */
+static uint16_t
+allocate()
+{
+    for (uint64_t i = 0; i < COUNT; i++) {
+        uint64_t id = (hint + i) & MASK;
+        if (used[id / 64] & (1UL << (id % 64)))
+            continue;
+        used[id / 64] |= 1UL << (id % 64);
+        used_count++;
+        hint = id + 1;
+        return id;
+    }
+    return 0;
+}
+
+/**
+ * PCID of an address space, handing out a new one if its context is stale
+ *
+ * A new PCID may still tag entries of its previous owner on some CPUs, stale is set so every CPU
+ * flushes it before its first use
+ *
+ * @param context context of the address space
+ * @param stale CPUs that must flush the PCID of the address space before using it
+ */
+uint16_t
+get(std::atomic<uint64_t> &context, std::atomic<uint64_t> &stale)
+{
+    uint64_t ctx = context.load(std::memory_order_acquire);
+    if (ctx >> 12 == current.load(std::memory_order_acquire))
+        return ctx & MASK;
+
+    auto flags = lock.lock_irqsave();
+
+    ctx = context.load(std::memory_order_relaxed);
+    if (ctx >> 12 != current.load(std::memory_order_relaxed)) {
+        uint16_t id = allocate();
+        if (id == 0) {
+            /* New generation, every CPU flushes before its next switch (see catch_up()) */
+            for (uint64_t i = 0; i < COUNT / 64; i++)
+                used[i] = 0;
+            used[0]    = 1;
+            used_count = 1;
+            hint       = 1;
+            current.fetch_add(1, std::memory_order_release);
+            id = allocate();
+        }
+
+        stale.store(~0UL, std::memory_order_seq_cst);
+        ctx = (current.load(std::memory_order_relaxed) << 12) | id;
+        context.store(ctx, std::memory_order_release);
+    }
+
+    lock.unlock_irqrestore(flags);
+    return ctx & MASK;
+}
+
+/**
+ * Give back the PCID of a dead address space
+ */
+void
+put(std::atomic<uint64_t> &context)
+{
+    auto flags   = lock.lock_irqsave();
+    uint64_t ctx = context.exchange(0, std::memory_order_relaxed);
+    if (ctx != 0 && ctx >> 12 == current.load(std::memory_order_relaxed)) {
+        uint64_t id = ctx & MASK;
+        used[id / 64] &= ~(1UL << (id % 64));
+        used_count--;
+    }
+    lock.unlock_irqrestore(flags);
+}
+
+/**
+ * A new generation started since the last full flush of the calling CPU, which has to flush its
+ * TLB before loading a PCID
+ */
+bool
+catch_up()
+{
+    uint64_t generation = current.load(std::memory_order_acquire);
+    if (percpu::read(flushed_generation) == generation)
+        return false;
+
+    percpu::write(flushed_generation, generation);
+    return true;
+}
+
+/**
+ * Current generation
+ */
+uint64_t
+generation()
+{
+    return current.load(std::memory_order_relaxed);
+}
+
+/**
+ * PCIDs handed out in the current generation (the kernel one included)
+ */
+uint64_t
+in_use()
+{
+    return __atomic_load_n(&used_count, __ATOMIC_RELAXED);
+}
+
+} // namespace pcid
+
+} // namespace paging
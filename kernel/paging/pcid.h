@@ -0,0 +1,45 @@
+/**
+ * Process-context identifiers
+ *
+ * With CR4.PCIDE the TLB tags every entry with the PCID in the low 12 bits of CR3, so switching
+ * address spaces (with CR3 bit 63 set) keeps the entries of the others. Every address space
+ * except the kernel one (PCID 0) gets a PCID on its first activation. PCIDs are numbered in
+ * generations: when all of them are in use a new generation starts, every CPU flushes its whole
+ * TLB before its next switch and address spaces get a new PCID the next time they are activated
+ *
+ * Kernel mappings are global (CR4.PGE), they survive CR3 writes even without PCIDs
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include <stdint.h>
+
+namespace paging {
+
+namespace pcid {
+
+/** PCIDs per generation (12 bits) */
+const uint64_t COUNT = 4096;
+/** PCID of the kernel address space, never handed out */
+const uint16_t KERNEL = 0;
+/** CR3 bit: don't flush the entries of the loaded PCID */
+const uint64_t NOFLUSH = 1UL << 63;
+
+void init();
+void init_cpu();
+bool enabled();
+bool invpcid();
+
+uint16_t get(std::atomic<uint64_t> &, std::atomic<uint64_t> &);
+void put(std::atomic<uint64_t> &);
+bool catch_up();
+
+uint64_t generation();
+uint64_t in_use();
+
+} // namespace pcid
+
+} // namespace paging
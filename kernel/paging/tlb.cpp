@@ -0,0 +1,230 @@
+/**
+ * TLB shootdown
+ *
+ * One shootdown runs at a time: the initiator fills the shared request under shootdown_lock, sets
+ * the pending mask of its targets and sends them the IPI, then waits until every target cleared
+ * its bit. A CPU waiting for the lock serves the request with its own bit meanwhile, two CPUs
+ * shooting each other down with interrupts disabled would deadlock otherwise
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "paging/tlb.h"
+#include "interrupts/IDT.h"
+#include "kernel.h"
+#include "lib/atomic.h"
+#include "paging/pcid.h"
+#include "sched/thread.h"
+#include "smp/smp.h"
+#include "sync/spinlock.h"
+
+namespace paging {
+
+namespace tlb {
+
+static const uint8_t SHOOTDOWN_VECTOR =
+  static_cast<uint8_t>(interrupts::vector_e::tlb_shootdown);
+
+/**
+ * Shootdown in flight
+ */
+struct request
+{
+    uint64_t pages[FLUSH_THRESHOLD];
+    uint32_t count = 0;
+    bool full      = false;
+    bool tagged    = false;
+    bool user      = true;
+    /** Target CPUs that didn't invalidate yet */
+    std::atomic<uint64_t> pending = 0;
+};
+
+static sync::lock_stats shootdown_stats("tlb shootdown");
+static sync::ticket_lock shootdown_lock(&shootdown_stats);
+static request in_flight;
+
+static std::atomic<uint64_t> sent = 0;
+
+DEFINE_PERCPU(uint64_t, received) = 0;
+DEFINE_PERCPU(uint64_t, flushes)  = 0;
+
+/**
+ * Invalidate every translation of the calling CPU, global ones and those of every PCID included
+ */
+void
+flush_all()
+{
+    if (pcid::invpcid()) {
+        cpu::invpcid(2, 0, 0);
+    } else {
+        /* Any change of CR4.PGE flushes everything */
+        uint64_t cr4 = cpu::read_cr4();
+        cpu::write_cr4(cr4 ^ cpu::CR4_PGE);
+        cpu::write_cr4(cr4);
+    }
+    percpu::add(flushes, 1UL);
+}
+
+/**
+ * Invalidate the non-global translations of the loaded address space on the calling CPU
+ */
+void
+flush_context()
+{
+    /* Reading CR3 gives bit 63 clear, writing it back flushes the loaded PCID */
+    uint64_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    percpu::add(flushes, 1UL);
+}
+
+/**
+ * Queue the invalidation of a page
+ *
+ * @param global the replaced translation was global
+ */
+void
+batch::add(uint64_t virt, bool global)
+{
+    if (!global)
+        this->tagged = true;
+
+    if (this->full)
+        return;
+
+    if (this->count == FLUSH_THRESHOLD) {
+        this->full = true;
+        return;
+    }
+
+    this->pages[this->count++] = virt & ~(kernel::page_size - 1);
+}
+
+/**
+ * Invalidate a request on the calling CPU
+ */
+static void
+invalidate_local(const uint64_t *pages, uint32_t count, bool full, bool tagged, bool user)
+{
+    /* invlpg only reaches the loaded PCID, kernel tables are shared by all of them */
+    if (!user && tagged && pcid::enabled()) {
+        flush_all();
+        return;
+    }
+
+    if (full) {
+        /* Kernel pages are global, a CR3 write would keep them */
+        if (user)
+            flush_context();
+        else
+            flush_all();
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        invalidate(pages[i]);
+}
+
+/**
+ * Serve the request in flight if the calling CPU is one of its targets
+ */
+static void
+serve()
+{
+    uint64_t bit = 1UL << smp::id();
+    if ((in_flight.pending.load(std::memory_order_acquire) & bit) == 0)
+        return;
+
+    invalidate_local(
+      in_flight.pages, in_flight.count, in_flight.full, in_flight.tagged, in_flight.user);
+    in_flight.pending.fetch_and(~bit, std::memory_order_release);
+}
+
+/**
+ * Invalidate the batch on the calling CPU and on the other CPUs of an address space, then empty it
+ *
+ * @param cpus CPUs that loaded the address space
+ * @param user the address space is a user one (its pages aren't global)
+ */
+void
+batch::flush(uint64_t cpus, bool user)
+{
+    if (this->empty())
+        return;
+
+    sched::preempt_disable();
+    uint32_t self = smp::id();
+
+    invalidate_local(this->pages, this->count, this->full, this->tagged, user);
+
+    uint64_t targets = cpus & ~(1UL << self);
+    if (targets != 0) {
+        while (!shootdown_lock.try_lock()) {
+            serve();
+            cpu::pause();
+        }
+
+        for (uint32_t i = 0; i < this->count; i++)
+            in_flight.pages[i] = this->pages[i];
+        in_flight.count  = this->count;
+        in_flight.full   = this->full;
+        in_flight.tagged = this->tagged;
+        in_flight.user   = user;
+        in_flight.pending.store(targets, std::memory_order_release);
+
+        for (uint64_t mask = targets; mask != 0; mask &= mask - 1)
+            kernel::lapic.send_ipi(kernel::cpus[__builtin_ctzll(mask)].lapic_id, SHOOTDOWN_VECTOR);
+
+        while (in_flight.pending.load(std::memory_order_acquire) != 0)
+            cpu::pause();
+        sent.fetch_add(1, std::memory_order_relaxed);
+
+        shootdown_lock.unlock();
+    }
+
+    sched::preempt_enable();
+
+    this->count  = 0;
+    this->full   = false;
+    this->tagged = false;
+}
+
+/**
+ * Shootdown IPI (the request may already have been served while this CPU waited for the lock)
+ */
+void
+handle_ipi()
+{
+    percpu::add(received, 1UL);
+    serve();
+}
+
+/**
+ * Shootdowns that interrupted at least one CPU
+ */
+uint64_t
+shootdowns()
+{
+    return sent.load(std::memory_order_relaxed);
+}
+
+/**
+ * Shootdown IPIs received by a CPU
+ */
+uint64_t
+ipis(uint32_t cpu)
+{
+    return *percpu::on(received, cpu);
+}
+
+/**
+ * Full TLB flushes done by a CPU
+ */
+uint64_t
+full_flushes(uint32_t cpu)
+{
+    return *percpu::on(flushes, cpu);
+}
+
+} // namespace tlb
+
+} // namespace paging
@@ -0,0 +1,82 @@
+/**
+ * TLB shootdown
+ *
+ * A CPU only invalidates its own TLB, changing or removing a present translation of an address
+ * space loaded on other CPUs needs an IPI to each of them (a shootdown). Invalidations are
+ * gathered in a batch and sent with a single IPI per CPU, batches of more than FLUSH_THRESHOLD
+ * pages flush the whole TLB instead (cheaper than that many invlpg)
+ *
+ * Only CPUs that loaded the address space are interrupted. Kernel threads and idle CPUs run on the
+ * kernel tables (a CPU leaves the CPUs of a user address space when it switches away from it), so
+ * batches of a user address space don't reach them
+ *
+ * Mapping a page that wasn't present needs no invalidation, CPUs don't cache non-present
+ * translations. invlpg also drops global entries, full flushes of kernel (global) pages go through
+ * flush_all()
+ *
+ * @warning shootdowns wait for every target CPU, don't start one holding a spinlock those CPUs may
+ * spin on with interrupts disabled
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace paging {
+
+namespace tlb {
+
+/** Pages above which a batch flushes the whole TLB */
+const uint32_t FLUSH_THRESHOLD = 32;
+
+/**
+ * Pending invalidations
+ */
+class batch
+{
+  public:
+    batch() = default;
+    batch(const batch &) = delete;
+    batch &operator=(const batch &) = delete;
+
+    void add(uint64_t, bool = false);
+
+    /** Nothing to invalidate */
+    bool empty() const
+    {
+        return this->count == 0 && !this->full;
+    }
+
+    void flush(uint64_t, bool);
+
+  private:
+    uint64_t pages[FLUSH_THRESHOLD];
+    uint32_t count = 0;
+    /** Overflowed, flush everything */
+    bool full = false;
+    /** Some page had a non-global translation, cached under the PCID of whoever used it */
+    bool tagged = false;
+};
+
+/**
+ * Invalidate the translation of a page on the calling CPU
+ */
+inline void
+invalidate(uint64_t virt)
+{
+    asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+void flush_all();
+void flush_context();
+void handle_ipi();
+
+uint64_t shootdowns();
+uint64_t ipis(uint32_t);
+uint64_t full_flushes(uint32_t);
+
+} // namespace tlb
+
+} // namespace paging
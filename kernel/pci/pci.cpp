@@ -7,6 +7,7 @@
 #include "pci.h"
 #include "kernel.h"
 #include "lib/stdlib.h"
+#include "sync/spinlock.h"
 
 namespace pci {
 
@@ -17,6 +18,9 @@ static uint64_t startbus;
 static uint64_t _device;
 static uint64_t _function;
 
+/** Serialises changes to the device list (readers use RCU) */
+static sync::ticket_lock devices_lock;
+
 /**
  * Enumerate functions (PCI) and construct the kernel PCI linked list
  */
@@ -45,13 +49,16 @@ enum_fun(uint64_t addr, uint64_t fun)
     dev->function   = _function;
     dev->bus        = _bus;
     dev->prev       = prev;
+    dev->next       = nullptr;
     dev->header_ext = (void *)((uint8_t *)device + sizeof(pci::device_header));
 
-    /*First device in chain or not */
+    /* First device in chain or not, the node is complete before readers can reach it */
+    auto flags = devices_lock.lock_irqsave();
     if (prev == nullptr)
-        kernel::devices = dev;
+        sync::rcu_assign_pointer(kernel::devices, dev);
     else
-        prev->next = dev;
+        sync::rcu_assign_pointer(prev->next, dev);
+    devices_lock.unlock_irqrestore(flags);
 
     prev = dev;
 }
@@ -128,4 +135,33 @@ enum_pci(acpi::sdt *mcfg)
     }
 }
 
+/**
+ * Free a removed device once no reader can reach it
+ */
+static void
+free_device(sync::rcu_head *head)
+{
+    kernel::heap.free((uint8_t *)head - __builtin_offsetof(pci_device, rcu));
+}
+
+/**
+ * Unlink a device from the kernel list (hot unplug, driver failure)
+ *
+ * Readers walking the list may still be on it, the node is freed after a grace period
+ */
+void
+remove_device(pci_device *dev)
+{
+    auto flags = devices_lock.lock_irqsave();
+    if (dev->prev == nullptr)
+        sync::rcu_assign_pointer(kernel::devices, dev->next);
+    else
+        sync::rcu_assign_pointer(dev->prev->next, dev->next);
+    if (dev->next != nullptr)
+        dev->next->prev = dev->prev;
+    devices_lock.unlock_irqrestore(flags);
+
+    sync::call_rcu(&dev->rcu, free_device);
+}
+
 } // namespace pci
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "acpi/acpi.h"
+#include "sync/rcu.h"
 
 namespace pci {
 
@@ -126,6 +127,9 @@ struct header_t2
 
 /**
  * PCI device linked list for the kernel
+ *
+ * Read under sync::rcu_read_lock() following next with sync::rcu_dereference(), only writers use
+ * prev
  */
 struct pci_device
 {
@@ -136,12 +140,15 @@ struct pci_device
     uint16_t function;
     pci_device *prev;
     pci_device *next;
+    /** Deferred free after removal */
+    sync::rcu_head rcu;
 };
 
 void enum_fun(uint64_t addr, uint64_t fun);
 void enum_dev(uint64_t addr, uint64_t dev);
 void enum_bus(uint64_t addr, uint64_t bus);
 void enum_pci(acpi::sdt *);
+void remove_device(pci_device *);
 
 struct BAR_mem
 {
@@ -0,0 +1,50 @@
+/**
+ * Per CPU variables
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "percpu/percpu.h"
+#include "kernel.h"
+#include "lib/string.h"
+
+namespace percpu {
+
+DEFINE_PERCPU(uint64_t, this_offset) = 0;
+
+/**
+ * Allocate the per CPU area of a CPU and fill it with the template
+ *
+ * Called by the BSP for every CPU (the frame allocator is not used from the APs)
+ *
+ * @return false if there is no memory for the area
+ */
+bool
+create(uint32_t cpu)
+{
+    uint64_t size  = __percpu_end - __percpu_start;
+    uint32_t pages = size / kernel::page_size + 1;
+
+    auto *area = (uint8_t *)kernel::allocator.request_cont_page(pages);
+    if (area == nullptr)
+        return false;
+
+    memcpy(area, __percpu_start, size);
+
+    offsets[cpu] = (uint64_t)area - (uint64_t)__percpu_start;
+    *on(this_offset, cpu) = offsets[cpu];
+    return true;
+}
+
+/**
+ * Point the gs base of the calling CPU to its per CPU area
+ *
+ * @warning reloading gs (load_gdt) clears the base, call it afterwards
+ */
+void
+load(uint32_t cpu)
+{
+    cpu::set_gs_base(offsets[cpu]);
+}
+
+} // namespace percpu
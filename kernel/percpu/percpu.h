@@ -0,0 +1,107 @@
+/**
+ * Per CPU variables
+ *
+ * Variables declared with DEFINE_PERCPU are placed in the .percpu section. That section is only a
+ * template: every CPU gets its own copy and its gs base is set to (copy - __percpu_start), so the
+ * link address of a variable used as a gs relative address lands in the copy of the running CPU.
+ * Accessors are a single gs prefixed instruction, which also makes them atomic with respect to
+ * interrupts on the same CPU
+ *
+ * Before percpu::load() the gs base is 0 and the accessors use the template itself
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "cpu/cpu.h"
+#include <stdint.h>
+
+/** Define a per CPU variable (the initializer is the initial value on every CPU) */
+#define DEFINE_PERCPU(type, name) __attribute__((section(".percpu"))) type name
+
+/** Declare a per CPU variable defined in another translation unit */
+#define DECLARE_PERCPU(type, name) extern type name
+
+namespace percpu {
+
+/* Set by the linker */
+extern "C" uint8_t __percpu_start[];
+extern "C" uint8_t __percpu_end[];
+
+/** gs base of every CPU (address of its copy - __percpu_start) */
+inline uint64_t offsets[cpu::MAX_CPUS];
+
+/** gs base of the running CPU, readable without rdgsbase (needs CR4.FSGSBASE) */
+DECLARE_PERCPU(uint64_t, this_offset);
+
+bool create(uint32_t);
+void load(uint32_t);
+
+/**
+ * Read the running CPU copy of a per CPU variable
+ */
+template<typename T>
+__attribute__((always_inline)) inline T
+read(const T &var)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+    T value;
+    asm volatile("mov %%gs:%1, %0" : "=r"(value) : "m"(var));
+    return value;
+}
+
+/**
+ * Write the running CPU copy of a per CPU variable
+ */
+template<typename T>
+__attribute__((always_inline)) inline void
+write(T &var, T value)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+    asm volatile("mov %1, %%gs:%0" : "=m"(var) : "r"(value));
+}
+
+/**
+ * Add to the running CPU copy of a per CPU integer (no lock prefix, only this CPU writes it)
+ */
+template<typename T>
+__attribute__((always_inline)) inline void
+add(T &var, T value)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+    asm volatile("add %1, %%gs:%0" : "+m"(var) : "r"(value) : "cc");
+}
+
+/**
+ * Address of the copy of a per CPU variable of a given CPU
+ */
+template<typename T>
+inline T *
+on(T &var, uint32_t cpu)
+{
+    return (T *)((uint64_t)&var + offsets[cpu]);
+}
+
+/**
+ * Address of the running CPU copy of a per CPU variable (for aggregates)
+ *
+ * @warning only valid while the code can't migrate to another CPU
+ */
+template<typename T>
+inline T *
+ptr(T &var)
+{
+    return (T *)((uint64_t)&var + read(this_offset));
+}
+
+/**
+ * The calling CPU already runs on its own copy (the template has a 0 offset)
+ */
+inline bool
+loaded()
+{
+    return read(this_offset) != 0;
+}
+
+} // namespace percpu
@@ -0,0 +1,124 @@
+/**
+ * Chase-Lev work-stealing deque
+ *
+ * Fixed capacity version of "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê,
+ * Pop, Cohen, Zappa Nardelli, PPoPP'13). Only the owner CPU pushes/pops at the bottom, any CPU
+ * steals from the top with a single CAS. No locks
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include <stdint.h>
+
+namespace sched {
+
+/**
+ * Work-stealing deque of T pointers
+ *
+ * @tparam N capacity (power of two)
+ */
+template<typename T, uint64_t N>
+class deque
+{
+  public:
+    deque() = default;
+
+    /**
+     * Push at the bottom (owner only)
+     *
+     * @return false if full
+     */
+    bool push(T *item)
+    {
+        int64_t b = this->bottom.load(std::memory_order_relaxed);
+        int64_t t = this->top.load(std::memory_order_acquire);
+        if (b - t >= (int64_t)N)
+            return false;
+
+        this->buffer[b & MASK].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Pop the newest item from the bottom (owner only, LIFO)
+     *
+     * @return nullptr if empty
+     */
+    T *pop()
+    {
+        int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+        this->bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = this->top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            /* Empty */
+            this->bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T *item = this->buffer[b & MASK].load(std::memory_order_relaxed);
+        if (t == b) {
+            /* Last item, race against the thieves for it */
+            if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst))
+                item = nullptr;
+            this->bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /**
+     * Take the oldest item from the top (any CPU, FIFO)
+     *
+     * @return nullptr if empty or if another CPU won the race (see empty())
+     */
+    T *steal()
+    {
+        int64_t t = this->top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = this->bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        T *item = this->buffer[t & MASK].load(std::memory_order_relaxed);
+        if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst))
+            return nullptr;
+        return item;
+    }
+
+    /**
+     * Approximate emptiness check (exact when called by the owner with no thieves)
+     */
+    bool empty() const
+    {
+        int64_t t = this->top.load(std::memory_order_acquire);
+        int64_t b = this->bottom.load(std::memory_order_acquire);
+        return t >= b;
+    }
+
+    /**
+     * Approximate number of items
+     */
+    uint64_t size() const
+    {
+        int64_t t = this->top.load(std::memory_order_acquire);
+        int64_t b = this->bottom.load(std::memory_order_acquire);
+        return b > t ? b - t : 0;
+    }
+
+  private:
+    static_assert((N & (N - 1)) == 0, "deque capacity must be a power of two");
+    static const uint64_t MASK = N - 1;
+
+    /** Thieves only write top, keep it away from the owner's bottom */
+    alignas(64) std::atomic<int64_t> top = 0;
+    alignas(64) std::atomic<int64_t> bottom = 0;
+    alignas(64) std::atomic<T *> buffer[N] = {};
+};
+
+} // namespace sched
@@ -0,0 +1,46 @@
+;;
+; Kernel thread context switch
+;
+; @author Ernesto Martínez García <me@ecomaikgolf.com>
+;
+
+; tell nasm we need 64 bit instructions
+[bits 64]
+
+;
+; thread *switch_context(thread *prev, thread *next)
+;
+; Only the callee saved registers need to be preserved (the caller already saved the rest), they
+; are pushed on prev's stack and the stack pointer is stored in prev->rsp (first member). Returns
+; prev, but already running as next
+;
+switch_context:
+	push rbx
+	push rbp
+	push r12
+	push r13
+	push r14
+	push r15
+	mov [rdi], rsp ; prev->rsp = rsp
+	mov rsp, [rsi] ; rsp = next->rsp
+	pop r15
+	pop r14
+	pop r13
+	pop r12
+	pop rbp
+	pop rbx
+	mov rax, rdi ; return prev
+	ret
+
+;
+; First code run by a new thread, sched::create() leaves its address where switch_context returns
+;
+thread_trampoline:
+	mov rdi, rax ; previous thread (switch_context return value)
+	call thread_start
+	ud2 ; thread_start never returns
+
+; make it accessible for other code
+GLOBAL switch_context
+GLOBAL thread_trampoline
+EXTERN thread_start
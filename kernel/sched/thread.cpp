@@ -0,0 +1,832 @@
+/**
+ * Kernel threads
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "sched/thread.h"
+#include "cpu/cpu.h"
+#include "kernel.h"
+#include "lib/atomic.h"
+#include "lib/string.h"
+#include "smp/smp.h"
+#include "sync/rcu.h"
+#include "sync/spinlock.h"
+#include "time/wheel.h"
+#include "user/process.h"
+#include "user/syscall.h"
+
+namespace sched {
+
+DEFINE_PERCPU(thread *, current_thread) = nullptr;
+
+/** Flow that booted the CPU, runs when nothing else is ready */
+DEFINE_PERCPU(thread, idle_thread);
+DEFINE_PERCPU(uint64_t, switches) = 0;
+DEFINE_PERCPU(uint64_t, steals)   = 0;
+
+/** Ready threads of the CPU */
+DEFINE_PERCPU(runqueue, queue);
+/** Threads made ready by other CPUs (lock-free stack, drained by the owner into its queue) */
+DEFINE_PERCPU(std::atomic<thread *>, inbox) = nullptr;
+/** Victim selection state (xorshift64) */
+DEFINE_PERCPU(uint64_t, seed) = 0;
+/** The running thread has to give the CPU up as soon as possible */
+DEFINE_PERCPU(bool, need_resched) = false;
+/** Preemption is allowed only when 0 */
+DEFINE_PERCPU(uint32_t, preempt_count) = 0;
+/** Thread whose state was last loaded in or saved from the FPU registers */
+DEFINE_PERCPU(thread *, fpu_owner) = nullptr;
+/** Time slice of the running thread */
+DEFINE_PERCPU(time::timer, quantum);
+DEFINE_PERCPU(uint64_t, idle_sleeps) = 0;
+DEFINE_PERCPU(bool, use_mwait)       = false;
+/** MWAIT hint of the deepest C-state that keeps the local APIC timer running */
+DEFINE_PERCPU(uint32_t, deep_hint) = 0;
+
+/**
+ * Wakeup line of an idle CPU, written by the CPUs that wake it
+ */
+struct alignas(64) idle_line
+{
+    /** Monitored word, any write ends the MWAIT */
+    std::atomic<uint32_t> poke = 0;
+    /** The CPU monitors poke (a write is enough to wake it) */
+    std::atomic<bool> mwaiting = false;
+};
+DEFINE_PERCPU(idle_line, wakeup);
+
+/** Stack slot size (guard page + stack pages) */
+static const uint64_t SLOT_SIZE = (STACK_PAGES + 1) * kernel::page_size;
+/** Space reserved at the top of every slot for the control block */
+static const uint64_t TCB_SIZE = (sizeof(thread) + 63) & ~63UL;
+
+/** Next never used stack slot */
+static uint64_t next_slot = STACK_WINDOW;
+/** Stack slots of dead threads (still mapped), linked through their first word */
+static uint64_t free_slots = 0;
+/** Every live thread */
+static thread *all_threads = nullptr;
+static sync::lock_stats threads_stats("threads");
+/** Protects the stack slots and the thread list (creation and exit, not the scheduling path) */
+static sync::ticket_lock threads_lock(&threads_stats);
+/** Thread identifiers */
+static std::atomic<uint64_t> next_id = 1;
+/** Vector of the reschedule IPI */
+static const uint8_t RESCHED_VECTOR = static_cast<uint8_t>(interrupts::vector_e::reschedule);
+/** CPUs halted in their idle loop */
+static std::atomic<uint64_t> idle_cpus = 0;
+
+/**
+ * Hand a ready thread to a CPU inbox (any CPU)
+ */
+static void
+inbox_push(uint32_t cpu, thread *t)
+{
+    std::atomic<thread *> *box = percpu::on(inbox, cpu);
+
+    thread *head = box->load(std::memory_order_relaxed);
+    do {
+        t->next = head;
+    } while (!box->compare_exchange_weak(head, t, std::memory_order_release));
+}
+
+/**
+ * Queue a ready thread on the calling CPU (interrupts disabled)
+ */
+static void
+push_local(thread *t)
+{
+    if (!percpu::ptr(queue)->push(t))
+        inbox_push(smp::id(), t);
+}
+
+/**
+ * Move the inbox of the calling CPU to its run queue, oldest first (interrupts disabled)
+ */
+static void
+drain_inbox()
+{
+    std::atomic<thread *> *box = percpu::ptr(inbox);
+    if (box->load(std::memory_order_relaxed) == nullptr)
+        return;
+
+    /* The inbox is a stack, reverse it to keep wakeup order */
+    thread *list = box->exchange(nullptr, std::memory_order_acquire);
+    thread *fifo = nullptr;
+    while (list != nullptr) {
+        thread *next = list->next;
+        list->next   = fifo;
+        fifo         = list;
+        list         = next;
+    }
+
+    while (fifo != nullptr) {
+        thread *next = fifo->next;
+        push_local(fifo);
+        fifo = next;
+    }
+}
+
+/**
+ * Random number for victim selection
+ */
+static uint64_t
+random()
+{
+    uint64_t x = percpu::read(seed);
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    percpu::write(seed, x);
+    return x;
+}
+
+/**
+ * Wake an idle CPU: a write to its line if it waits in MWAIT, the reschedule IPI otherwise
+ */
+static void
+wake_idle(uint32_t cpu)
+{
+    idle_line *line = percpu::on(wakeup, cpu);
+    if (line->mwaiting.load(std::memory_order_seq_cst))
+        line->poke.fetch_add(1, std::memory_order_relaxed);
+    else
+        kernel::lapic.send_ipi(kernel::cpus[cpu].lapic_id, RESCHED_VECTOR);
+}
+
+/**
+ * Wake an idle CPU so it steals the work just queued
+ */
+static void
+kick_idle()
+{
+    uint64_t mask = idle_cpus.load(std::memory_order_seq_cst) & ~(1UL << smp::id());
+    if (mask == 0)
+        return;
+
+    wake_idle(__builtin_ctzll(mask));
+}
+
+/**
+ * Wake a CPU if it is idle
+ */
+static void
+kick(uint32_t cpu)
+{
+    if (idle_cpus.load(std::memory_order_seq_cst) & (1UL << cpu))
+        wake_idle(cpu);
+}
+
+/**
+ * Take the oldest thread of the calling CPU queue
+ *
+ * The owner takes from the top like the thieves (one CAS) instead of popping the bottom, so
+ * threads run in FIFO order and a preempted thread doesn't starve the others
+ */
+static thread *
+take_local()
+{
+    runqueue *rq = percpu::ptr(queue);
+
+    while (!rq->empty()) {
+        thread *t = rq->steal();
+        if (t != nullptr)
+            return t;
+    }
+    return nullptr;
+}
+
+/**
+ * Steal the oldest thread of random victims
+ *
+ * A thread still being switched out by its victim (on_cpu) can't run here yet, it is handed back
+ * to the victim inbox instead of waiting for it (two CPUs could wait for each other)
+ */
+static thread *
+steal_remote()
+{
+    uint32_t self = smp::id();
+    uint32_t cpus = smp::present();
+    if (cpus <= 1)
+        return nullptr;
+
+    for (uint32_t attempt = 0; attempt < 2 * cpus; attempt++) {
+        uint32_t victim = random() % cpus;
+        if (victim == self || !kernel::cpus[victim].online.load(std::memory_order_relaxed))
+            continue;
+
+        thread *t = percpu::on(queue, victim)->steal();
+        if (t == nullptr)
+            continue;
+
+        if (t->on_cpu.load(std::memory_order_acquire)) {
+            inbox_push(victim, t);
+            continue;
+        }
+
+        percpu::add(steals, 1UL);
+        return t;
+    }
+    return nullptr;
+}
+
+/**
+ * There is work this CPU could run (checked before halting)
+ */
+static bool
+work_available()
+{
+    if (!percpu::ptr(queue)->empty() || percpu::ptr(inbox)->load() != nullptr)
+        return true;
+
+    for (uint32_t cpu = 0; cpu < smp::present(); cpu++)
+        if (!percpu::on(queue, cpu)->empty())
+            return true;
+    return false;
+}
+
+/**
+ * Time slice expired (timer interrupt context)
+ */
+static void
+quantum_expired(time::timer *)
+{
+    percpu::write(need_resched, true);
+}
+
+/**
+ * Turn the flow running on the calling CPU into its idle thread
+ *
+ * Must run once per CPU after its per CPU area is loaded
+ */
+void
+init_cpu()
+{
+    thread *idle = percpu::ptr(idle_thread);
+    idle->name   = "idle";
+    idle->state  = state_e::running;
+    idle->cpu    = smp::id();
+    idle->on_cpu = true;
+
+    /* Different victim sequence on every CPU */
+    percpu::write(seed, cpu::rdtsc() ^ ((smp::id() + 1) * 0x9e3779b97f4a7c15UL));
+
+    *percpu::ptr(quantum) = time::timer(quantum_expired);
+    percpu::write(current_thread, idle);
+
+    percpu::write(use_mwait, cpu::has_monitor());
+    /* Every wheel timer is a local APIC timer interrupt, without ARAT stay in C1 */
+    percpu::write(deep_hint, cpu::has_arat() ? cpu::mwait_deepest() : 0);
+}
+
+/**
+ * MWAIT hint for the coming idle period: C1 if a timer is due soon, the deepest C-state otherwise
+ */
+static uint32_t
+idle_hint()
+{
+    uint64_t next = time::local().get_next();
+    if (next != time::wheel::NONE && next * time::TICK_NS < kernel::clock.now() + DEEP_IDLE_NS)
+        return 0;
+    return percpu::read(deep_hint);
+}
+
+/**
+ * Idle loop of the calling CPU (the caller becomes its idle thread)
+ *
+ * Runs whatever is ready (stealing if needed) and waits for an interrupt or a write to its wakeup
+ * line otherwise. The CPU is marked idle and the line monitored before the last check, so work
+ * queued after it always wakes the CPU
+ */
+[[noreturn]] void
+idle()
+{
+    uint64_t bit    = 1UL << smp::id();
+    idle_line *line = percpu::ptr(wakeup);
+
+    while (true) {
+        schedule();
+
+        /* sti only takes effect after hlt/mwait, so a wakeup can't slip in between */
+        asm volatile("cli");
+        idle_cpus.fetch_or(bit, std::memory_order_seq_cst);
+
+        /*
+         * mwaiting shares the line with poke, storing it after MONITOR could end the MWAIT at once.
+         * A poke between the store and MONITOR is missed, but its work is queued before it and the
+         * check below sees it
+         */
+        bool mwait = percpu::read(use_mwait);
+        if (mwait) {
+            line->mwaiting.store(true, std::memory_order_seq_cst);
+            cpu::monitor(&line->poke);
+        }
+
+        if (!work_available() && !percpu::read(need_resched)) {
+            percpu::add(idle_sleeps, 1UL);
+            if (mwait)
+                cpu::sti_mwait_cli(idle_hint());
+            else
+                asm volatile("sti; hlt; cli");
+        }
+
+        line->mwaiting.store(false, std::memory_order_relaxed);
+        idle_cpus.fetch_and(~bit, std::memory_order_seq_cst);
+        asm volatile("sti");
+    }
+}
+
+/**
+ * Get a stack slot: a guard page followed by STACK_PAGES mapped pages
+ *
+ * @return slot base or 0 if there is no memory
+ */
+static uint64_t
+alloc_slot()
+{
+    if (free_slots != 0) {
+        uint64_t slot = free_slots;
+        free_slots    = *(uint64_t *)(slot + kernel::page_size);
+        return slot;
+    }
+
+    uint64_t slot = next_slot;
+    for (uint32_t i = 0; i < STACK_PAGES; i++) {
+        void *page = kernel::allocator.request_page();
+        if (page == nullptr)
+            return 0;
+        kernel::translator.map(slot + (i + 1) * kernel::page_size, (uint64_t)page);
+    }
+
+    next_slot += SLOT_SIZE;
+    return slot;
+}
+
+/**
+ * Give back the stack slot of a dead thread (its pages stay mapped for the next thread)
+ */
+static void
+free_slot(uint64_t slot)
+{
+    *(uint64_t *)(slot + kernel::page_size) = free_slots;
+    free_slots                              = slot;
+}
+
+/**
+ * Queue a ready thread on the CPU that ran it last (the calling one for new threads)
+ */
+static void
+enqueue(thread *t)
+{
+    auto flags    = cpu::irq_save();
+    uint32_t self = smp::id();
+    uint32_t cpu  = t->cpu == NO_CPU ? self : t->cpu;
+
+    if (cpu == self) {
+        push_local(t);
+        if (current() == percpu::ptr(idle_thread))
+            percpu::write(need_resched, true);
+        else
+            kick_idle();
+    } else {
+        inbox_push(cpu, t);
+        kick(cpu);
+    }
+
+    cpu::irq_restore(flags);
+}
+
+/**
+ * Create a kernel thread and make it ready on the calling CPU
+ *
+ * The control block lives at the top of the stack slot, the stack grows below it. Threads given a
+ * process run on its tables (entry drops to ring 3). The thread uses the console of its creator
+ *
+ * @return the thread or nullptr if there is no memory
+ */
+thread *
+create(const char *name, void (*entry)(void *), void *arg, user::process *process)
+{
+    auto flags    = threads_lock.lock_irqsave();
+    uint64_t slot = alloc_slot();
+    if (slot == 0) {
+        threads_lock.unlock_irqrestore(flags);
+        return nullptr;
+    }
+
+    uint64_t top = slot + SLOT_SIZE;
+    thread *t    = (thread *)(top - TCB_SIZE);
+    memset(t, 0, sizeof(thread));
+
+    t->id      = next_id.fetch_add(1, std::memory_order_relaxed);
+    t->name    = name;
+    t->entry   = entry;
+    t->arg     = arg;
+    t->process = process;
+    t->console = current() != nullptr ? current()->console : 0;
+    t->slot    = slot;
+    t->cpu     = NO_CPU;
+    t->fpu_cpu = NO_CPU;
+
+    /*
+     * Initial stack as left by switch_context: 6 callee saved registers and the return address
+     * (thread_trampoline). Two padding words keep the stack 16 byte aligned at its call
+     */
+    uint64_t *sp = (uint64_t *)t;
+    *--sp        = 0;
+    *--sp        = 0;
+    *--sp        = (uint64_t)&thread_trampoline;
+    for (int i = 0; i < 6; i++)
+        *--sp = 0;
+    t->rsp = (uint64_t)sp;
+
+    t->all_next = all_threads;
+    all_threads = t;
+    threads_lock.unlock_irqrestore(flags);
+
+    t->state = state_e::ready;
+    enqueue(t);
+    return t;
+}
+
+/**
+ * Save the FPU state of the outgoing thread if it used it during its time slice and arm #NM for
+ * the incoming one
+ */
+static void
+fpu_switch(thread *prev)
+{
+    /* TS clear means the FPU was used since the last switch */
+    if ((cpu::read_cr0() & cpu::CR0_TS) == 0) {
+        asm volatile("fxsave %0" : "=m"(prev->fpu));
+        prev->fpu_used = true;
+        prev->fpu_cpu  = smp::id();
+        percpu::write(fpu_owner, prev);
+    }
+
+    cpu::set_ts();
+}
+
+/**
+ * Load the tables of the incoming thread
+ *
+ * User threads also get the top of their kernel stack (right below the control block) loaded as
+ * the stack of ring 3 interrupts (TSS) and system calls. Kernel threads run on the kernel tables,
+ * so the tables of a process are unused once its thread stops running it
+ */
+static void
+switch_space(thread *next)
+{
+    if (next->process == nullptr) {
+        kernel::translator.activate();
+        return;
+    }
+
+    uint64_t stack                     = (uint64_t)next;
+    smp::current()->tables.task.rsp[0] = stack;
+    percpu::write(user::syscall_stack, stack);
+    next->process->space.activate();
+}
+
+/**
+ * Cleanup of the thread switched out, runs on the stack of the new one
+ */
+static void
+finish_switch(thread *prev)
+{
+    /* Its stack is no longer in use, other CPUs can resume it now */
+    prev->on_cpu.store(false, std::memory_order_release);
+
+    if (prev->state != state_e::dead)
+        return;
+
+    /* Its registers may still be cached in this CPU FPU */
+    if (percpu::read(fpu_owner) == prev)
+        percpu::write(fpu_owner, (thread *)nullptr);
+
+    /* The control block is reused with the slot */
+    auto flags = threads_lock.lock_irqsave();
+    for (thread **i = &all_threads; *i != nullptr; i = &(*i)->all_next) {
+        if (*i == prev) {
+            *i = prev->all_next;
+            break;
+        }
+    }
+    free_slot(prev->slot);
+    threads_lock.unlock_irqrestore(flags);
+}
+
+/**
+ * Pick the next thread of the calling CPU and switch to it
+ *
+ * The running thread goes back to the queue unless it blocked or exited (a thread woken before it
+ * got here is already queued). Then the local queue, a random victim and finally the idle thread
+ */
+void
+schedule()
+{
+    auto flags   = cpu::irq_save();
+    thread *prev = current();
+    thread *idle = percpu::ptr(idle_thread);
+
+    /* Threads never switch out inside a read-side section */
+    sync::rcu_quiescent();
+
+    percpu::write(need_resched, false);
+    drain_inbox();
+
+    if (prev->state == state_e::running) {
+        prev->state = state_e::ready;
+        if (prev != idle)
+            push_local(prev);
+    }
+
+    thread *next = take_local();
+    if (next == nullptr)
+        next = steal_remote();
+    if (next == nullptr)
+        next = idle;
+
+    next->state = state_e::running;
+    next->cpu   = smp::id();
+
+    /* Only real threads get a time slice, idle always gives the CPU up */
+    if (next != idle && kernel::clock.is_calibrated())
+        time::local().add(percpu::ptr(quantum), kernel::clock.now() + QUANTUM_NS);
+
+    if (next == prev) {
+        cpu::irq_restore(flags);
+        return;
+    }
+
+    /* Only prev can be in this CPU queue while on_cpu, anything else is about to be released */
+    while (next->on_cpu.load(std::memory_order_acquire))
+        cpu::pause();
+    next->on_cpu.store(true, std::memory_order_relaxed);
+
+    percpu::add(switches, 1UL);
+    percpu::write(current_thread, next);
+    fpu_switch(prev);
+    switch_space(next);
+
+    prev = switch_context(prev, next);
+
+    finish_switch(prev);
+    cpu::irq_restore(flags);
+}
+
+/**
+ * Give the CPU to the next ready thread
+ */
+void
+yield()
+{
+    schedule();
+}
+
+/**
+ * Sleep timer expired (timer interrupt context)
+ */
+static void
+sleep_expired(time::timer *timer)
+{
+    wake((thread *)timer->data);
+}
+
+/**
+ * Sleep for at least ns nanoseconds
+ *
+ * Idle threads (and the boot flow) halt until the deadline instead. Without a calibrated clock
+ * there is no deadline to wait for, it only gives the CPU up once
+ */
+void
+sleep(uint64_t ns)
+{
+    if (!kernel::clock.is_calibrated()) {
+        yield();
+        return;
+    }
+
+    thread *self      = current();
+    uint64_t deadline = kernel::clock.now() + ns;
+    time::timer timer(sleep_expired, self);
+
+    auto flags = cpu::irq_save();
+    while (kernel::clock.now() < deadline) {
+        time::local().add(&timer, deadline);
+        prepare_block();
+        block();
+        /* Only idle threads return early, they never migrate */
+        if (timer.pending())
+            time::local().cancel(&timer);
+    }
+    cpu::irq_restore(flags);
+}
+
+/**
+ * Announce that the running thread is going to sleep, before checking the wait condition
+ *
+ * A wake() from any CPU after this point is not lost: block() returns immediately or the thread
+ * is queued again. Usage (interrupts disabled):
+ *
+ *     prepare_block();
+ *     if (condition) cancel_block(); else block();
+ */
+void
+prepare_block()
+{
+    thread *self = current();
+    if (self != nullptr && self != percpu::ptr(idle_thread))
+        self->state.store(state_e::blocked, std::memory_order_seq_cst);
+}
+
+/**
+ * The wait condition already holds, keep running
+ */
+void
+cancel_block()
+{
+    thread *self = current();
+    if (self == nullptr)
+        return;
+
+    state_e expected  = state_e::blocked;
+    bool still_asleep = self->state.compare_exchange_strong(expected, state_e::running);
+
+    /* Someone woke us and queued us in the meantime, that entry has to be consumed */
+    if (!still_asleep && self != percpu::ptr(idle_thread))
+        schedule();
+}
+
+/**
+ * Sleep until wake() is called on the running thread (after prepare_block)
+ *
+ * The idle thread (or the boot flow before init_cpu) can't block, it halts until the next
+ * interrupt instead
+ */
+void
+block()
+{
+    thread *self = current();
+    if (self == nullptr || self == percpu::ptr(idle_thread)) {
+        asm volatile("sti; hlt; cli");
+        return;
+    }
+
+    schedule();
+}
+
+/**
+ * Make a blocked thread ready, on the CPU that ran it last (cache affinity)
+ *
+ * Can be called from interrupt context and from any CPU
+ */
+void
+wake(thread *t)
+{
+    state_e expected = state_e::blocked;
+    if (t->state.compare_exchange_strong(expected, state_e::ready))
+        enqueue(t);
+}
+
+/**
+ * Make another CPU go through a preemption point (even if it is running a thread)
+ */
+void
+resched_cpu(uint32_t cpu)
+{
+    if (cpu != smp::id())
+        kernel::lapic.send_ipi(kernel::cpus[cpu].lapic_id, RESCHED_VECTOR);
+}
+
+/**
+ * Reschedule IPI: another CPU queued work for this one (or wants a quiescent state)
+ */
+void
+resched_ipi()
+{
+    percpu::write(need_resched, true);
+    preempt();
+}
+
+/**
+ * Preemption point (end of the timer interrupt)
+ */
+void
+preempt()
+{
+    if (current() == nullptr || percpu::read(preempt_count) != 0)
+        return;
+
+    /* Not inside a read-side section */
+    sync::rcu_quiescent();
+
+    if (percpu::read(need_resched))
+        schedule();
+}
+
+/**
+ * Terminate the running thread
+ */
+[[noreturn]] void
+exit()
+{
+    cpu::irq_save();
+    current()->state.store(state_e::dead);
+    schedule();
+
+    /* Dead threads are never picked again */
+    while (true)
+        asm volatile("hlt");
+}
+
+/**
+ * Forbid preemption of the running thread (nestable)
+ */
+void
+preempt_disable()
+{
+    percpu::add(preempt_count, 1U);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+/**
+ * Allow preemption again
+ *
+ * A time slice that expired while preemption was disabled is honoured here
+ */
+void
+preempt_enable()
+{
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    percpu::add(preempt_count, ~0U);
+
+    if (percpu::read(need_resched) && cpu::irq_enabled())
+        preempt();
+}
+
+/**
+ * First instruction of a thread, after the switch that started it
+ */
+extern "C" [[noreturn]] void
+thread_start(thread *prev)
+{
+    finish_switch(prev);
+    asm volatile("sti");
+
+    thread *self = current();
+    self->entry(self->arg);
+
+    exit();
+}
+
+/**
+ * Device not available (#NM): first FPU/SSE instruction since the switch
+ *
+ * Loads the state of the running thread unless this CPU registers still hold it. TS is cleared
+ * first so this function can't fault itself, the registers it could clobber before the restore
+ * belong to a thread whose state was already saved by fpu_switch()
+ */
+void
+fpu_fault()
+{
+    cpu::clts();
+    thread *self = current();
+
+    if (percpu::read(fpu_owner) == self && self->fpu_cpu == smp::id())
+        return;
+
+    if (self->fpu_used) {
+        asm volatile("fxrstor %0" : : "m"(self->fpu));
+    } else {
+        /* Clean state (x87 and SSE control words at their defaults) */
+        const uint32_t mxcsr = 0x1f80;
+        asm volatile("fninit; ldmxcsr %0" : : "m"(mxcsr));
+    }
+
+    self->fpu_cpu = smp::id();
+    percpu::write(fpu_owner, self);
+}
+
+/**
+ * Address is in the guard page of a stack slot
+ */
+bool
+is_guard(uint64_t addr)
+{
+    if (addr < STACK_WINDOW || addr >= next_slot)
+        return false;
+    return (addr - STACK_WINDOW) % SLOT_SIZE < kernel::page_size;
+}
+
+/**
+ * List of every live thread (linked through all_next), idle threads excluded
+ */
+thread *
+threads()
+{
+    return all_threads;
+}
+
+} // namespace sched
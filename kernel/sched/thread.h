@@ -0,0 +1,142 @@
+/**
+ * Kernel threads
+ *
+ * Every thread has a control block and a kernel stack in the stack window, below the stack there
+ * is an unmapped guard page so overflows fault instead of corrupting memory. Switches save the
+ * callee saved registers (switch.asm), FPU/SSE state is saved only for threads that used it since
+ * they were switched in and restored lazily on the first FPU instruction (#NM)
+ *
+ * Each CPU has its own run queue and an idle thread (the flow that booted the CPU). Threads are
+ * preempted when their time slice (a wheel timer) expires
+ *
+ * Run queues are Chase-Lev work-stealing deques, CPUs without work steal from random victims.
+ * Wakeups go back to the CPU that ran the thread last, through a lock-free inbox when it is a
+ * remote one. There is no global lock on the scheduling path
+ *
+ * Idle CPUs wait in MWAIT on a per CPU line when the CPU supports it (waking them is a plain store,
+ * no IPI), with a deeper C-state hint when no timer is due soon. Otherwise they halt
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include "percpu/percpu.h"
+#include "sched/deque.h"
+#include "time/clock.h"
+#include <stdint.h>
+
+namespace user {
+struct process;
+}
+
+namespace sched {
+
+/** Start of the virtual window holding the thread stacks */
+const uint64_t STACK_WINDOW = 0xffffb00000000000;
+/** Mapped pages of every thread stack */
+const uint32_t STACK_PAGES = 4;
+/** Time slice */
+const uint64_t QUANTUM_NS = 10 * time::NS_PER_MS;
+/** No CPU */
+const uint32_t NO_CPU = ~0U;
+/** Capacity of every CPU run queue (overflow waits in the CPU inbox) */
+const uint64_t RUNQUEUE_SIZE = 1024;
+/** Idle periods at least this long use the deepest C-state */
+const uint64_t DEEP_IDLE_NS = 2 * time::NS_PER_MS;
+
+enum class state_e
+{
+    ready,
+    running,
+    blocked,
+    dead,
+};
+
+/**
+ * Thread control block
+ */
+struct thread
+{
+    /** Saved stack pointer (must be the first member, see switch.asm) */
+    uint64_t rsp               = 0;
+    uint64_t id                = 0;
+    const char *name           = nullptr;
+    std::atomic<state_e> state = state_e::ready;
+    /** Registers still live on a CPU (being switched out), it can't be resumed elsewhere yet */
+    std::atomic<bool> on_cpu = false;
+
+    void (*entry)(void *) = nullptr;
+    void *arg             = nullptr;
+    /** Process run in ring 3 by the thread (nullptr for kernel threads) */
+    user::process *process = nullptr;
+    /** Virtual console the thread writes to and reads from (inherited from its creator) */
+    uint32_t console = 0;
+
+    /** Stack slot in the stack window (0 for idle threads) */
+    uint64_t slot = 0;
+    /** CPU that ran the thread last */
+    uint32_t cpu = NO_CPU;
+
+    /** Inbox link */
+    thread *next = nullptr;
+    /** List of every live thread */
+    thread *all_next = nullptr;
+
+    /** CPU whose registers still hold fpu (lazy restore) */
+    uint32_t fpu_cpu = NO_CPU;
+    /** fpu holds a saved state */
+    bool fpu_used = false;
+    /** fxsave area */
+    alignas(16) uint8_t fpu[512];
+};
+
+/** Ready threads of a CPU */
+using runqueue = deque<thread, RUNQUEUE_SIZE>;
+
+/** Running thread of each CPU */
+DECLARE_PERCPU(thread *, current_thread);
+/** Context switches of each CPU */
+DECLARE_PERCPU(uint64_t, switches);
+/** Threads stolen by each CPU */
+DECLARE_PERCPU(uint64_t, steals);
+/** Times each CPU went idle */
+DECLARE_PERCPU(uint64_t, idle_sleeps);
+/** Each CPU idles in MWAIT (HLT otherwise) */
+DECLARE_PERCPU(bool, use_mwait);
+
+/**
+ * Running thread of the calling CPU
+ */
+inline thread *
+current()
+{
+    return percpu::read(current_thread);
+}
+
+void init_cpu();
+[[noreturn]] void idle();
+thread *create(const char *, void (*)(void *), void *, user::process * = nullptr);
+void yield();
+void sleep(uint64_t);
+void prepare_block();
+void cancel_block();
+void block();
+void wake(thread *);
+void resched_ipi();
+void resched_cpu(uint32_t);
+void schedule();
+void preempt();
+[[noreturn]] void exit();
+void preempt_disable();
+void preempt_enable();
+void fpu_fault();
+bool is_guard(uint64_t);
+thread *threads();
+
+extern "C" thread *switch_context(thread *, thread *);
+extern "C" void thread_trampoline();
+extern "C" [[noreturn]] void thread_start(thread *);
+
+} // namespace sched
@@ -0,0 +1,655 @@
+/**
+ * Virtual console
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "screen/console.h"
+#include "kernel.h"
+#include "lib/string.h"
+#include "sched/thread.h"
+
+namespace screen {
+
+/**
+ * Palette index of a color (white for a foreground or black for a background not in it)
+ */
+static uint8_t
+palette_index(color_e color, uint8_t missing)
+{
+    for (uint8_t i = 0; i < 16; i++) {
+        if (PALETTE[i] == color)
+            return i;
+    }
+    return missing;
+}
+
+/**
+ * Cell attributes of a pair of colors
+ */
+uint8_t
+attributes(color_e fg, color_e bg)
+{
+    return palette_index(fg, 15) | (palette_index(bg, 0) << 4);
+}
+
+/**
+ * Console of the calling thread (0 before the scheduler runs)
+ */
+uint32_t
+caller_console()
+{
+    sched::thread *current = sched::current();
+    return current != nullptr ? current->console : 0;
+}
+
+/**
+ * Reserve the cells of a grid (blank)
+ *
+ * @return false if there is no memory
+ */
+bool
+grid::init(uint32_t columns, uint32_t rows)
+{
+    this->columns = columns;
+    this->rows    = rows;
+
+    uint64_t size = rows * columns * sizeof(cell);
+    this->cells   = (cell *)kernel::allocator.request_cont_page(size / kernel::page_size + 1);
+    if (this->cells == nullptr)
+        return false;
+
+    this->fill(BLANK);
+    return true;
+}
+
+/**
+ * Move every row up, the top one becomes the bottom one (blank)
+ */
+void
+grid::scroll()
+{
+    if (this->cells == nullptr)
+        return;
+
+    this->top    = (this->top + 1) % this->rows;
+    cell *bottom = this->row(this->rows - 1);
+    for (uint32_t i = 0; i < this->columns; i++)
+        bottom[i] = BLANK;
+}
+
+void
+grid::fill(cell value)
+{
+    if (this->cells == nullptr)
+        return;
+
+    for (uint32_t i = 0; i < this->rows * this->columns; i++)
+        this->cells[i] = value;
+}
+
+/**
+ * Reserve the cells of the screen and its scrollback
+ *
+ * @param columns characters of a line
+ * @param rows lines of the screen
+ * @return false if there is no memory (writes to the console are dropped)
+ */
+bool
+console::init(uint32_t columns, uint32_t rows)
+{
+    this->columns = columns;
+    this->rows    = rows;
+    this->lines   = rows + SCROLLBACK;
+
+    uint64_t size = this->lines * columns * sizeof(cell);
+    this->cells   = (cell *)kernel::allocator.request_cont_page(size / kernel::page_size + 1);
+    if (this->cells == nullptr)
+        return false;
+
+    this->margin_bottom = rows - 1;
+    this->clear();
+    return true;
+}
+
+/**
+ * Add a screen row to the damage
+ */
+void
+console::damage(uint32_t row)
+{
+    if (this->damage_first > this->damage_last) {
+        this->damage_first = row;
+        this->damage_last  = row;
+    } else if (row < this->damage_first) {
+        this->damage_first = row;
+    } else if (row > this->damage_last) {
+        this->damage_last = row;
+    }
+}
+
+/**
+ * Mark the whole screen as changed (its contents are unknown to the renderer)
+ */
+void
+console::damage_all()
+{
+    this->damage_first = 0;
+    this->damage_last  = this->rows - 1;
+    this->scrolled     = 0;
+}
+
+/**
+ * Changes since the last call, for the renderer
+ *
+ * The renderer scrolls what it shows by scrolled lines first, then compares the damaged rows
+ *
+ * @param first first changed screen row
+ * @param last last changed screen row
+ * @param scrolled lines scrolled before the changes (0 if every row is damaged)
+ * @return false if nothing changed
+ */
+bool
+console::take_damage(uint32_t &first, uint32_t &last, uint32_t &scrolled)
+{
+    if (this->damage_first > this->damage_last && this->scrolled == 0)
+        return false;
+
+    /* Scrolled or changed entirely: compare every row, without scrolling first */
+    bool whole = this->damage_first == 0 && this->damage_last == this->rows - 1;
+    if (this->scrolled >= this->rows || whole)
+        this->damage_all();
+
+    first    = this->damage_first;
+    last     = this->damage_last;
+    scrolled = this->scrolled;
+
+    this->damage_first = 1;
+    this->damage_last  = 0;
+    this->scrolled     = 0;
+    return true;
+}
+
+void
+console::blank_line(cell *line)
+{
+    for (uint32_t i = 0; i < this->columns; i++)
+        line[i] = BLANK;
+}
+
+/**
+ * Write a character at the cursor and advance it
+ */
+void
+console::put(char character, uint8_t attr)
+{
+    if (this->cells == nullptr)
+        return;
+
+    cell *line         = this->ring_line(this->row, 0);
+    line[this->column] = { character, attr };
+    this->damage(this->row);
+    if (++this->column == this->columns)
+        this->newline();
+}
+
+/**
+ * Move the cursor to the start of the next line, scrolling at the last row of the scroll region
+ */
+void
+console::newline()
+{
+    if (this->cells == nullptr)
+        return;
+
+    this->column = 0;
+    this->line_feed();
+}
+
+/**
+ * Move the cursor down a line, scrolling at the last row of the scroll region
+ */
+void
+console::line_feed()
+{
+    if (this->row == this->margin_bottom)
+        this->scroll_up(1);
+    else if (this->row + 1 < this->rows)
+        this->row++;
+}
+
+/**
+ * Move the cursor back a cell (to the end of the previous line at the first column) and blank it
+ *
+ * @param attr colors of the blank
+ * @return false at the first cell of the screen
+ */
+bool
+console::backspace(uint8_t attr)
+{
+    if (this->cells == nullptr || (this->column == 0 && this->row == 0))
+        return false;
+
+    if (this->column == 0) {
+        this->row--;
+        this->column = this->columns;
+    }
+    this->column--;
+    this->ring_line(this->row, 0)[this->column] = { ' ', attr };
+    this->damage(this->row);
+    return true;
+}
+
+/**
+ * Scroll the screen by 1 line, the top line becomes scrollback
+ */
+void
+console::scroll()
+{
+    if (this->cells == nullptr)
+        return;
+
+    this->top = (this->top + 1) % this->lines;
+    this->blank_line(this->ring_line(this->rows - 1, 0));
+    if (this->history < SCROLLBACK)
+        this->history++;
+    if (this->row > 0)
+        this->row--;
+
+    /* Damaged rows moved up with the text, the one that went off the top is gone */
+    this->scrolled++;
+    if (this->damage_first <= this->damage_last) {
+        if (this->damage_last == 0)
+            this->damage_first = 1;
+        else
+            this->damage_first -= this->damage_first > 0 ? 1 : 0;
+        this->damage_last -= this->damage_last > 0 ? 1 : 0;
+    }
+}
+
+/**
+ * Scroll the scroll region up, the cursor stays
+ *
+ * A region of the whole screen moves the ring (the lines go to the scrollback), otherwise the rows
+ * of the region are copied
+ */
+void
+console::scroll_up(uint32_t n)
+{
+    uint32_t height = this->margin_bottom - this->margin_top + 1;
+    if (n > height)
+        n = height;
+
+    if (this->margin_top == 0 && this->margin_bottom == this->rows - 1) {
+        uint32_t row = this->row;
+        for (uint32_t i = 0; i < n; i++)
+            this->scroll();
+        this->row = row;
+        return;
+    }
+
+    for (uint32_t row = this->margin_top; row <= this->margin_bottom; row++) {
+        cell *line = this->ring_line(row, 0);
+        if (row + n <= this->margin_bottom)
+            memcpy(line, this->ring_line(row + n, 0), this->columns * sizeof(cell));
+        else
+            this->blank_line(line);
+        this->damage(row);
+    }
+}
+
+/**
+ * Scroll the scroll region down (copying its rows), the cursor stays
+ */
+void
+console::scroll_down(uint32_t n)
+{
+    uint32_t height = this->margin_bottom - this->margin_top + 1;
+    if (n > height)
+        n = height;
+
+    for (uint32_t row = this->margin_bottom + 1; row-- > this->margin_top;) {
+        cell *line = this->ring_line(row, 0);
+        if (row >= this->margin_top + n)
+            memcpy(line, this->ring_line(row - n, 0), this->columns * sizeof(cell));
+        else
+            this->blank_line(line);
+        this->damage(row);
+    }
+}
+
+/**
+ * Blank the cells [from, to) of a screen row
+ */
+void
+console::erase(uint32_t row, uint32_t from, uint32_t to, uint8_t attr)
+{
+    cell *line = this->ring_line(row, 0);
+    for (uint32_t i = from; i < to && i < this->columns; i++)
+        line[i] = { ' ', attr };
+    this->damage(row);
+}
+
+/**
+ * Write a character at the cursor, interpreting control characters and escape sequences
+ *
+ * @param attr colors of the writer, SGR colors replace them
+ */
+void
+console::write(char character, uint8_t attr)
+{
+    if (this->cells == nullptr)
+        return;
+
+    switch (this->escape) {
+        case escape_e::escape:
+            this->escape_sequence(character);
+            return;
+        case escape_e::csi: {
+            if (character >= '0' && character <= '9') {
+                uint32_t &value = this->params[this->nparams - 1];
+                if (value < 10000)
+                    value = value * 10 + (character - '0');
+            } else if (character == ';') {
+                if (this->nparams < PARAMS)
+                    this->params[this->nparams++] = 0;
+            } else if (character == '?') {
+                this->dec_private = true;
+            } else if (character >= 0x40 && character <= 0x7e) {
+                this->escape = escape_e::none;
+                if (!this->dec_private)
+                    this->csi(character, attr);
+            }
+            return;
+        }
+        case escape_e::none:
+            break;
+    }
+
+    this->control(character, attr);
+}
+
+/**
+ * Characters outside of escape sequences
+ */
+void
+console::control(char character, uint8_t attr)
+{
+    switch (character) {
+        case '\x1b':
+            this->escape = escape_e::escape;
+            break;
+        case '\n':
+            this->newline();
+            break;
+        case '\r':
+            this->column = 0;
+            break;
+        case '\b':
+            if (this->column > 0)
+                this->column--;
+            break;
+        case '\t':
+            this->column = (this->column / 8 + 1) * 8;
+            if (this->column >= this->columns)
+                this->column = this->columns - 1;
+            break;
+        default:
+            this->put(character, this->styled(attr));
+    }
+}
+
+/**
+ * Character after ESC
+ */
+void
+console::escape_sequence(char character)
+{
+    this->escape = escape_e::none;
+    switch (character) {
+        case '[':
+            this->escape      = escape_e::csi;
+            this->params[0]   = 0;
+            this->nparams     = 1;
+            this->dec_private = false;
+            break;
+        case '7':
+            this->saved_column = this->column;
+            this->saved_row    = this->row;
+            break;
+        case '8':
+            this->column = this->saved_column;
+            this->row    = this->saved_row;
+            break;
+        case 'D':
+            this->line_feed();
+            break;
+        case 'E':
+            this->newline();
+            break;
+        case 'M':
+            /* Reverse index */
+            if (this->row == this->margin_top)
+                this->scroll_down(1);
+            else if (this->row > 0)
+                this->row--;
+            break;
+        case 'c':
+            this->margin_top    = 0;
+            this->margin_bottom = this->rows - 1;
+            this->fg            = -1;
+            this->bg            = -1;
+            this->bold          = false;
+            this->clear();
+            break;
+    }
+}
+
+/**
+ * Parameter of the CSI sequence, def if it's missing or 0
+ */
+uint32_t
+console::param(uint32_t index, uint32_t def) const
+{
+    if (index >= this->nparams || this->params[index] == 0)
+        return def;
+    return this->params[index];
+}
+
+/**
+ * Run a CSI sequence
+ *
+ * @param final final character, the command
+ * @param attr colors of the writer (for the erased cells)
+ */
+void
+console::csi(char final, uint8_t attr)
+{
+    uint32_t n     = this->param(0, 1);
+    uint8_t blank  = this->styled(attr);
+    uint32_t right = this->columns - 1;
+    uint32_t below = this->rows - 1;
+
+    switch (final) {
+        case 'A':
+            this->row = this->row > n ? this->row - n : 0;
+            break;
+        case 'B':
+            this->row = this->row + n < below ? this->row + n : below;
+            break;
+        case 'C':
+            this->column = this->column + n < right ? this->column + n : right;
+            break;
+        case 'D':
+            this->column = this->column > n ? this->column - n : 0;
+            break;
+        case 'E':
+            this->row    = this->row + n < below ? this->row + n : below;
+            this->column = 0;
+            break;
+        case 'F':
+            this->row    = this->row > n ? this->row - n : 0;
+            this->column = 0;
+            break;
+        case 'G':
+            this->column = n - 1 < right ? n - 1 : right;
+            break;
+        case 'd':
+            this->row = n - 1 < below ? n - 1 : below;
+            break;
+        case 'H':
+        case 'f': {
+            uint32_t column = this->param(1, 1);
+            this->row       = n - 1 < below ? n - 1 : below;
+            this->column    = column - 1 < right ? column - 1 : right;
+            break;
+        }
+        case 'J': {
+            uint32_t mode = this->param(0, 0);
+            if (mode == 0) {
+                this->erase(this->row, this->column, this->columns, blank);
+                for (uint32_t row = this->row + 1; row < this->rows; row++)
+                    this->erase(row, 0, this->columns, blank);
+            } else if (mode == 1) {
+                for (uint32_t row = 0; row < this->row; row++)
+                    this->erase(row, 0, this->columns, blank);
+                this->erase(this->row, 0, this->column + 1, blank);
+            } else {
+                for (uint32_t row = 0; row < this->rows; row++)
+                    this->erase(row, 0, this->columns, blank);
+                if (mode == 3)
+                    this->history = 0;
+            }
+            break;
+        }
+        case 'K': {
+            uint32_t mode = this->param(0, 0);
+            if (mode == 0)
+                this->erase(this->row, this->column, this->columns, blank);
+            else if (mode == 1)
+                this->erase(this->row, 0, this->column + 1, blank);
+            else
+                this->erase(this->row, 0, this->columns, blank);
+            break;
+        }
+        case 'S':
+            this->scroll_up(n);
+            break;
+        case 'T':
+            this->scroll_down(n);
+            break;
+        case 'r': {
+            uint32_t top    = this->param(0, 1) - 1;
+            uint32_t bottom = this->param(1, this->rows) - 1;
+            if (top < bottom && bottom < this->rows) {
+                this->margin_top    = top;
+                this->margin_bottom = bottom;
+                this->row           = 0;
+                this->column        = 0;
+            }
+            break;
+        }
+        case 's':
+            this->saved_column = this->column;
+            this->saved_row    = this->row;
+            break;
+        case 'u':
+            this->column = this->saved_column;
+            this->row    = this->saved_row;
+            break;
+        case 'm':
+            this->sgr();
+            break;
+    }
+}
+
+/**
+ * Select Graphic Rendition: change the colors of the next characters
+ */
+void
+console::sgr()
+{
+    for (uint32_t i = 0; i < this->nparams; i++) {
+        uint32_t code = this->params[i];
+        if (code == 0) {
+            this->fg   = -1;
+            this->bg   = -1;
+            this->bold = false;
+        } else if (code == 1) {
+            this->bold = true;
+        } else if (code == 22) {
+            this->bold = false;
+        } else if (code >= 30 && code <= 37) {
+            this->fg = code - 30;
+        } else if (code == 39) {
+            this->fg = -1;
+        } else if (code >= 40 && code <= 47) {
+            this->bg = code - 40;
+        } else if (code == 49) {
+            this->bg = -1;
+        } else if (code >= 90 && code <= 97) {
+            this->fg = code - 90 + 8;
+        } else if (code >= 100 && code <= 107) {
+            this->bg = code - 100 + 8;
+        } else if ((code == 38 || code == 48) && i + 2 < this->nparams &&
+                   this->params[i + 1] == 5) {
+            /* 256 color palette, only its first 16 colors are ours */
+            uint32_t color = this->params[i + 2];
+            if (color < 16 && code == 38)
+                this->fg = color;
+            else if (color < 16)
+                this->bg = color;
+            i += 2;
+        }
+    }
+}
+
+/**
+ * Colors of the next character: the SGR ones or the ones of the writer
+ */
+uint8_t
+console::styled(uint8_t attr) const
+{
+    uint8_t fg = this->fg >= 0 ? this->fg : attr & 0xf;
+    uint8_t bg = this->bg >= 0 ? this->bg : attr >> 4;
+    if (this->bold && fg < 8)
+        fg += 8;
+    return fg | (bg << 4);
+}
+
+/**
+ * Blank the screen and forget the scrollback
+ */
+void
+console::clear()
+{
+    if (this->cells == nullptr)
+        return;
+
+    for (uint32_t i = 0; i < this->lines; i++)
+        this->blank_line(this->cells + i * this->columns);
+
+    this->top     = 0;
+    this->history = 0;
+    this->column  = 0;
+    this->row     = 0;
+    this->damage_all();
+}
+
+/**
+ * Cells of a line of the screen
+ *
+ * @param row screen row
+ * @param back lines scrolled back (at most get_history())
+ * @return the columns of the line or nullptr if the console has no memory
+ */
+const cell *
+console::line(uint32_t row, uint32_t back) const
+{
+    if (this->cells == nullptr)
+        return nullptr;
+
+    return this->ring_line(row, back);
+}
+
+} // namespace screen
@@ -0,0 +1,242 @@
+/**
+ * Virtual console
+ *
+ * Text of a console kept as character cells (a character and its colors, 2 bytes) instead of
+ * pixels: a screen of 8x16 glyphs is 256 times smaller than its pixels. Lines that scroll off the
+ * top stay in the ring as scrollback, up to SCROLLBACK of them
+ *
+ * Consoles record the rows they change (damage) and the lines they scroll, the renderer compares
+ * only those rows with a grid of the cells on the screen and draws the cells that differ
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "screen/colors.h"
+#include <stdint.h>
+
+namespace screen {
+
+/** Virtual consoles of the tty */
+const uint32_t CONSOLES = 4;
+
+/** Colors of the cells, the attributes of a cell hold their index (VGA order) */
+const color_e PALETTE[16] = { color_e::BLACK, color_e::MAROON,  color_e::GREEN, color_e::OLIVE,
+                              color_e::NAVY,  color_e::PURPLE,  color_e::TEAL,  color_e::SILVER,
+                              color_e::GRAY,  color_e::RED,     color_e::LIME,  color_e::YELLOW,
+                              color_e::BLUE,  color_e::FUCHSIA, color_e::AQUA,  color_e::WHITE };
+
+uint8_t attributes(color_e, color_e);
+
+/**
+ * Foreground color of cell attributes
+ */
+inline color_e
+foreground(uint8_t attr)
+{
+    return PALETTE[attr & 0xf];
+}
+
+/**
+ * Background color of cell attributes
+ */
+inline color_e
+background(uint8_t attr)
+{
+    return PALETTE[attr >> 4];
+}
+
+/**
+ * Character cell
+ */
+struct cell
+{
+    char character;
+    /** Foreground palette index in the low nibble, background in the high one */
+    uint8_t attr;
+};
+
+/** Empty cell: white on black space */
+const cell BLANK = { ' ', 0x0f };
+
+inline bool
+operator==(const cell &a, const cell &b)
+{
+    return a.character == b.character && a.attr == b.attr;
+}
+
+inline bool
+operator!=(const cell &a, const cell &b)
+{
+    return !(a == b);
+}
+
+/**
+ * Rows of cells with a movable first row, scrolling is moving it (no copy)
+ */
+class grid
+{
+  public:
+    grid() = default;
+    bool init(uint32_t, uint32_t);
+    void scroll();
+    void fill(cell);
+
+    /** Cells of a row (nullptr if there was no memory) */
+    cell *row(uint32_t row) const
+    {
+        if (this->cells == nullptr)
+            return nullptr;
+        return this->cells + ((this->top + row) % this->rows) * this->columns;
+    }
+
+  private:
+    cell *cells      = nullptr;
+    uint32_t columns = 0;
+    uint32_t rows    = 0;
+    /** Row of cells at the top */
+    uint32_t top = 0;
+};
+
+/**
+ * State of the escape sequence parser
+ */
+enum class escape_e : uint8_t
+{
+    none,
+    /** After ESC */
+    escape,
+    /** After ESC [ (CSI), reading parameters */
+    csi,
+};
+
+/**
+ * Screen of text with scrollback
+ *
+ * The cursor is a cell of the screen (the last rows of the ring), writing past the last column
+ * wraps and writing past the last row of the scroll region scrolls it
+ *
+ * write() understands the ANSI/VT100 escape sequences a program needs to update part of the
+ * screen instead of printing it again:
+ *
+ * - SGR (ESC [ ... m): 0, 1, 22, 30-37, 39, 40-47, 49, 90-97, 100-107, 38;5;n and 48;5;n (n < 16)
+ * - Cursor: CUU A, CUD B, CUF C, CUB D, CNL E, CPL F, CHA G, CUP H/f, VPA d, save s and restore u
+ *   (also ESC 7 and ESC 8)
+ * - Erase: EL K (0, 1, 2), ED J (0, 1, 2 and 3 with the scrollback)
+ * - Scrolling: DECSTBM r (scroll region), SU S and SD T
+ * - ESC c resets the console
+ *
+ * Text without SGR colors uses the colors of the writer (pushColor() / setColor()). Sequences can
+ * span writes, unknown ones are dropped
+ */
+class console
+{
+  public:
+    /** Lines kept above the screen */
+    static const uint32_t SCROLLBACK = 256;
+
+    /** Parameters of a CSI sequence, the rest are ignored */
+    static const uint32_t PARAMS = 8;
+
+    console() = default;
+    bool init(uint32_t, uint32_t);
+    void write(char, uint8_t);
+    void put(char, uint8_t);
+    void newline();
+    bool backspace(uint8_t);
+    void scroll();
+    void clear();
+    const cell *line(uint32_t, uint32_t) const;
+    bool take_damage(uint32_t &, uint32_t &, uint32_t &);
+    void damage_all();
+
+    uint32_t get_column() const
+    {
+        return this->column;
+    }
+
+    uint32_t get_row() const
+    {
+        return this->row;
+    }
+
+    uint32_t get_columns() const
+    {
+        return this->columns;
+    }
+
+    uint32_t get_rows() const
+    {
+        return this->rows;
+    }
+
+    /** Gets the lines of scrollback above the screen */
+    uint32_t get_history() const
+    {
+        return this->history;
+    }
+
+  private:
+    /** Cells of the ring line holding a screen row, back lines above it */
+    cell *ring_line(uint32_t row, uint32_t back) const
+    {
+        uint32_t index = this->top + row + this->lines - back;
+        return this->cells + (index % this->lines) * this->columns;
+    }
+
+    void blank_line(cell *);
+    void damage(uint32_t);
+    void line_feed();
+    void scroll_up(uint32_t);
+    void scroll_down(uint32_t);
+    void erase(uint32_t, uint32_t, uint32_t, uint8_t);
+    void control(char, uint8_t);
+    void escape_sequence(char);
+    void csi(char, uint8_t);
+    void sgr();
+    uint8_t styled(uint8_t) const;
+    uint32_t param(uint32_t, uint32_t) const;
+
+    /** Ring of lines (nullptr if there was no memory, the console stays empty) */
+    cell *cells      = nullptr;
+    uint32_t columns = 0;
+    uint32_t rows    = 0;
+    /** Lines of the ring, the screen and its scrollback */
+    uint32_t lines = 0;
+    /** Ring line shown at the top of the screen */
+    uint32_t top = 0;
+    /** Lines of scrollback written so far */
+    uint32_t history = 0;
+    /** Cursor */
+    uint32_t column = 0;
+    uint32_t row    = 0;
+    /** Screen rows changed since the last take_damage() (none if first > last) */
+    uint32_t damage_first = 1;
+    uint32_t damage_last  = 0;
+    /** Lines scrolled since the last take_damage() */
+    uint32_t scrolled = 0;
+
+    /** Scroll region, first and last rows */
+    uint32_t margin_top    = 0;
+    uint32_t margin_bottom = 0;
+    /** Cursor of ESC 7 / CSI s */
+    uint32_t saved_column = 0;
+    uint32_t saved_row    = 0;
+
+    /** Escape sequence being read */
+    escape_e escape = escape_e::none;
+    uint32_t params[PARAMS];
+    uint32_t nparams = 0;
+    /** The sequence has the private marker '?' (DEC modes, ignored) */
+    bool dec_private = false;
+
+    /** SGR colors (palette indices, -1 to use the ones of the writer) and bold */
+    int8_t fg = -1;
+    int8_t bg = -1;
+    bool bold = false;
+};
+
+uint32_t caller_console();
+
+} // namespace screen
@@ -1,5 +1,5 @@
 /**
- * Class to output to the screen (faster)
+ * Cache of the screen (faster output)
  *
  * @author Ernesto Martínez García <me@ecomaikgolf.com>
  */
@@ -14,197 +14,173 @@
 
 namespace screen {
 
+static sync::lock_stats tty_stats("tty");
+
+/**
+ * Zero a run of pixels (biggest integer assignments)
+ */
+static void
+zero_pixels(uint32_t *dst, uint64_t pixels)
+{
+    auto *dst_64 = (fast_renderer_i::pixel_pair *)dst;
+    for (uint64_t i = 0; i < pixels / 2; i++)
+        *dst_64++ = 0;
+
+    if (pixels % 2)
+        dst[pixels - 1] = 0;
+}
+
 /**
  * Create the fast renderer
  *
- * Build a copy of the framebuffer as a cache memory (faster read as it's RAM)
+ * Build a copy of the framebuffer as a cache memory (faster read as it's RAM) plus the drawn
+ * width of every row, both for the cache and for video memory
+ *
+ * @param cell_x glyph width, the cache width is a multiple of it
+ * @param cell_y glyph height, the cache height is a multiple of it
  */
 fast_renderer_i::fast_renderer_i(framebuffer video_memory,
                                  unsigned int init_x,
                                  unsigned int init_y,
-                                 color_e init_color)
+                                 color_e init_color,
+                                 unsigned int cell_x,
+                                 unsigned int cell_y)
   : video_memory(video_memory)
+  , cell_y(cell_y)
+  , top_row(0)
+  , dirty_first(1)
+  , dirty_last(0)
+  , lock(&tty_stats)
   , x_offset(init_x)
   , y_offset(init_y)
   , color(init_color)
 {
-    /* Create the cache buffer */
-    this->video_cache      = video_memory;
+    /* Create the cache buffer, width/height aligned to char size */
+    this->video_cache = video_memory;
+    this->video_cache.width -= this->video_cache.width % cell_x;
+    this->video_cache.height -= this->video_cache.height % cell_y;
+    this->video_cache.buffer_size =
+      this->video_cache.ppscl * this->video_cache.height * sizeof(uint32_t);
     this->video_cache.base = (uint32_t *)kernel::allocator.request_cont_page(
-      this->video_memory.buffer_size / kernel::page_size + 1);
+      this->video_cache.buffer_size / kernel::page_size + 1);
     this->video_cache.actual = this->video_cache.base;
-    this->video_cache.limit =
-      (unsigned int *)((uint8_t *)this->video_cache.base + this->video_memory.buffer_size);
-
-    /* Align cache width/height to char size */
-    this->video_cache.width -= this->video_cache.width % 8;
-    this->video_cache.height -= this->video_cache.height % 16;
-    this->video_cache.buffer_size =
-      this->video_cache.width * this->video_cache.height * sizeof(uint32_t);
     this->video_cache.limit =
       (uint32_t *)((uint8_t *)this->video_cache.base + this->video_cache.buffer_size);
 
-    /* Clear cache & video memory to 0 */
-    uint64_t steps     = this->video_memory.buffer_size / sizeof(uint64_t);
-    uint32_t remainder = this->video_memory.buffer_size % sizeof(uint64_t);
-
-    for (uint64_t i = 0; i < steps; i++)
-        ((uint64_t *)this->video_cache.base)[i] = 0;
-
-    for (uint32_t i = 0; i < remainder; i++)
-        ((uint8_t *)this->video_cache.base)[i] = 0;
-
-    this->update_video();
-}
-
-/**
- * Draw a character to the screen
- *
- * Increases x_ffset and y_offset, also recognises special chars as '\n'
- *
- * @param character Char to print
- */
-void
-fast_renderer_i::put(const char character)
-{
-    char aux[2] = { character, '\0' };
-    this->print(aux);
+    /* Row widths, cache rows followed by screen rows */
+    uint64_t widths_size = 2 * this->video_cache.height * sizeof(uint16_t);
+    this->row_width =
+      (uint16_t *)kernel::allocator.request_cont_page(widths_size / kernel::page_size + 1);
+    this->shown_width = this->row_width + this->video_cache.height;
+    for (uint32_t i = 0; i < 2 * this->video_cache.height; i++)
+        this->row_width[i] = 0;
+
+    /* Clear cache & video memory to 0, from now on only the drawn part of the rows is written */
+    zero_pixels(this->video_cache.base, this->video_cache.buffer_size / sizeof(uint32_t));
+    zero_pixels(this->video_memory.base, this->video_memory.buffer_size / sizeof(uint32_t));
 }
 
 /**
- * Print a string without default newline
- *
- * Increases x_offset and y_offset, also recognises special chars as '\n'
+ * Sets a new char color to use
  *
- * @param str string to print
+ * @param color Color to use onwards
  */
 void
-fast_renderer_i::print(const char *str, int64_t n)
+fast_renderer_i::setColor(color_e color)
 {
-    int i = 0;
-    while (str[i] && n != 0) {
-        switch (str[i]) {
-            case '\n':
-                this->y_offset += this->glyph_y();
-                this->x_offset = 0;
-                break;
-            default: {
-                this->draw(str[i]);
-                this->x_offset += this->glyph_x();
-                if (this->x_offset >= this->video_cache.width)
-                    this->print("\n");
-            }
-        }
-        if ((this->y_offset + this->glyph_y()) > this->video_cache.height)
-            this->scroll();
-
-        n--;
-        i++;
-    }
+    this->color = color;
 }
 
 /**
- * Print a string with a default newline
- *
- * Increases x_offset and y_offset, also recognises special chars as '\n'
+ * Gets current color
  *
- * @param str string to print
+ * @return color Color in use
  */
-void
-fast_renderer_i::println(const char *str)
+color_e
+fast_renderer_i::getColor()
 {
-    this->print(str);
-    this->put('\n');
+    return this->color;
 }
 
 /**
- * Sets a new char color to use
+ * Sets a new background color to use
  *
  * @param color Color to use onwards
  */
 void
-fast_renderer_i::setColor(color_e color)
+fast_renderer_i::setBackground(color_e color)
 {
-    this->color = color;
+    this->background = color;
 }
 
 /**
- * Gets current color
+ * Gets current background color
  *
- * @return color Color in use
+ * @return color Background color in use
  */
 color_e
-fast_renderer_i::getColor()
+fast_renderer_i::getBackground()
 {
-    return this->color;
+    return this->background;
 }
 
 /**
  * Fast screen clear
  *
- * Uses biggest integer asignations
+ * Clears the drawn part of the cache rows, the flush clears what video memory shows
  */
 void
 fast_renderer_i::clear()
 {
-    uint32_t jumps = this->video_memory.buffer_size / sizeof(uint64_t);
-    uint32_t rest  = this->video_memory.buffer_size % sizeof(uint64_t);
-
-    /* Fast clear, use big integer movements */
-    unsigned int i;
-    uint64_t *video_64 = (uint64_t *)this->video_memory.base;
-    uint64_t *cache_64 = (uint64_t *)this->video_cache.base;
-    for (i = 0; i < jumps; i++) {
-        *video_64++ = 0;
-        *cache_64++ = 0;
-    }
+    auto flags = this->lock.lock_irqsave();
+    this->clear_cache();
+    this->flush_rows();
+    this->lock.unlock_irqrestore(flags);
+}
 
-    uint8_t *video_8 = (uint8_t *)video_64;
-    uint8_t *cache_8 = (uint8_t *)cache_64;
-    /* for sizes < 64 bytes */
-    for (unsigned int j = 0; j < rest; j++) {
-        *video_64++ = 0;
-        *cache_64++ = 0;
+/**
+ * Clear the cache and move to the top left corner, the rows are left dirty (lock held)
+ */
+void
+fast_renderer_i::clear_cache()
+{
+    for (uint32_t row = 0; row < this->video_cache.height; row++) {
+        zero_pixels(this->video_cache.base + row * this->video_cache.ppscl, this->row_width[row]);
+        this->row_width[row] = 0;
     }
 
     this->video_cache.actual = this->video_cache.base;
+    this->top_row            = 0;
     this->x_offset           = 0;
     this->y_offset           = 0;
+
+    this->mark_dirty(0, this->video_cache.height - 1);
 }
 
 /**
- * Scroll the screen by 1 line (font glyph_y() pixels)
+ * Scroll the cache by 1 line
+ *
+ * The top line of the cache ring is cleared and becomes the bottom one. Every screen row changes,
+ * the copy to video memory is left to the next flush
  */
 void
-fast_renderer_i::scroll()
+fast_renderer_i::scroll_cache()
 {
-    uint64_t *ptr_64 = (uint64_t *)this->video_cache.actual;
-
-    this->video_cache.actual += (this->video_cache.ppscl * this->glyph_y());
-    if (this->video_cache.actual >= this->video_cache.limit)
-        this->video_cache.actual = this->video_cache.base;
-
-    uint32_t size = this->video_cache.ppscl * this->glyph_y() * sizeof(uint32_t);
-
-    // It shouldn't happen as it's aligned but safety checks as it can lead to out of bounds writes
-    if ((uint32_t *)((uint8_t *)ptr_64 + size) > this->video_cache.limit)
-        size = ((uint8_t *)this->video_cache.limit - (uint8_t *)ptr_64);
-
-    uint32_t jumps = size / sizeof(uint64_t);
-    uint32_t rest  = size % sizeof(uint64_t);
-
-    for (int i = 0; i < jumps; i++)
-        *ptr_64++ = 0;
-
-    uint8_t *ptr_8 = (uint8_t *)ptr_64;
+    for (uint32_t i = 0; i < this->cell_y; i++) {
+        uint32_t row = this->top_row + i;
+        zero_pixels(this->video_cache.base + row * this->video_cache.ppscl, this->row_width[row]);
+        this->row_width[row] = 0;
+    }
 
-    for (int i = 0; i < rest; i++)
-        *ptr_8++ = 0;
+    this->top_row += this->cell_y;
+    if (this->top_row >= this->video_cache.height)
+        this->top_row = 0;
+    this->video_cache.actual = this->video_cache.base + this->top_row * this->video_cache.ppscl;
 
-    if (this->y_offset >= this->glyph_y())
-        this->y_offset -= this->glyph_y();
+    if (this->y_offset >= this->cell_y)
+        this->y_offset -= this->cell_y;
 
-    this->update_video();
+    this->mark_dirty(0, this->video_cache.height - 1);
 }
 
 uint32_t
@@ -232,13 +208,18 @@ fast_renderer_i::set_y(uint32_t value)
 }
 
 /**
- * Common fmt function (vaargs support)
+ * Expand a fmt() string: %i %s %p %d %c (lock held)
+ *
+ * Out of line so the font renderers don't need the floating point registers for %d (interrupt
+ * handlers are built without them), the pieces are handed to write in order
+ *
+ * @param write sink of the literal text and the expanded arguments
  */
 void
-fast_renderer_i::fmt(const char *fmtstr, ...)
+fast_renderer_i::format(const char *fmtstr,
+                        va_list args,
+                        void (*write)(fast_renderer_i *, const char *, int64_t))
 {
-    va_list args;
-    va_start(args, fmtstr);
     char buffer[256];
     uint64_t i       = 0;
     uint64_t literal = 0;
@@ -246,33 +227,34 @@ fast_renderer_i::fmt(const char *fmtstr, ...)
     while (fmtstr[i] != '\0') {
         if (fmtstr[i] == '%') {
             specialchar = true;
-            this->print(&fmtstr[literal], i - literal);
+            write(this, &fmtstr[literal], i - literal);
             literal = i + 2;
         } else if (specialchar) {
             specialchar = false;
             switch (fmtstr[i]) {
                 case 'i': {
                     str(va_arg(args, int), buffer);
-                    this->print(buffer);
+                    write(this, buffer, -1);
                     break;
                 }
                 case 's': {
-                    this->print(va_arg(args, const char *));
+                    write(this, va_arg(args, const char *), -1);
                     break;
                 }
                 case 'p': {
                     hstr(va_arg(args, uint64_t), buffer);
-                    this->print("0x");
-                    this->print(buffer);
+                    write(this, "0x", -1);
+                    write(this, buffer, -1);
                     break;
                 }
                 case 'd': {
                     str(va_arg(args, double), buffer);
-                    this->print(buffer);
+                    write(this, buffer, -1);
                     break;
                 }
                 case 'c': {
-                    this->put((char)va_arg(args, int));
+                    char character[2] = { (char)va_arg(args, int), '\0' };
+                    write(this, character, -1);
                     break;
                 }
             }
@@ -280,68 +262,103 @@ fast_renderer_i::fmt(const char *fmtstr, ...)
 
         i++;
     }
-    this->print(&fmtstr[literal]);
-    this->newline();
+    write(this, &fmtstr[literal], -1);
 }
 
 /**
- * Update the framebuffer from the cache
+ * Show everything written so far
  */
 void
-fast_renderer_i::update_video()
+fast_renderer_i::flush()
 {
-    uint64_t *video_64 = (uint64_t *)this->video_memory.base;
-    uint8_t *video_8;
-    {
-        uint64_t size  = (uint8_t *)this->video_cache.limit - (uint8_t *)this->video_cache.actual;
-        uint64_t steps = size / sizeof(uint64_t);
-        uint64_t remainder = size % sizeof(uint64_t);
-
-        uint64_t *cache_64 = (uint64_t *)this->video_cache.actual;
-
-        for (uint64_t i = 0; i < steps; i++)
-            *video_64++ = *cache_64++;
-
-        uint8_t *cache_8 = (uint8_t *)cache_64;
-        video_8          = (uint8_t *)video_64;
+    auto flags = this->lock.lock_irqsave();
+    this->flush_rows();
+    this->lock.unlock_irqrestore(flags);
+}
 
-        for (uint64_t i = 0; i < remainder; i++)
-            *video_8++ = *cache_8++;
+/**
+ * End of a write: flush now or make sure the deferred flush is armed (lock held)
+ *
+ * @param flags interrupt flags of the writer
+ */
+void
+fast_renderer_i::commit(uint64_t flags)
+{
+    if (this->dirty_first > this->dirty_last)
+        return;
+
+    /* Without interrupts the timer may never run before the writer halts (panics) */
+    time::wheel &timers = time::local();
+    if ((flags & cpu::RFLAGS_IF) == 0 || !timers.is_started() ||
+        this->pending_lines >= this->video_cache.height / this->cell_y) {
+        this->flush_rows();
+        return;
     }
 
-    {
-        uint64_t size  = (uint8_t *)this->video_cache.actual - (uint8_t *)this->video_cache.base;
-        uint64_t steps = size / sizeof(uint64_t);
-        uint64_t remainder = size % sizeof(uint64_t);
-
-        uint64_t *cache_64 = (uint64_t *)this->video_cache.base;
+    if (!this->flush_armed) {
+        this->flush_armed          = true;
+        this->flush_timer.callback = flush_expired;
+        this->flush_timer.data     = this;
+        timers.add(&this->flush_timer, kernel::clock.now() + FLUSH_DELAY_NS, FLUSH_DELAY_NS / 2);
+    }
+}
 
-        for (uint64_t i = 0; i < steps; i++)
-            *video_64++ = *cache_64++;
+/**
+ * Deferred flush (timer interrupt context)
+ */
+void
+fast_renderer_i::flush_expired(time::timer *timer)
+{
+    auto *self = (fast_renderer_i *)timer->data;
 
-        uint8_t *cache_8 = (uint8_t *)cache_64;
-        video_8          = (uint8_t *)video_64;
-        for (uint64_t i = 0; i < remainder; i++)
-            *video_8++ = *cache_8++;
-    }
+    auto flags        = self->lock.lock_irqsave();
+    self->flush_armed = false;
+    self->flush_rows();
+    self->lock.unlock_irqrestore(flags);
 }
 
+/**
+ * Copy the rows changed since the last flush from the cache to video memory (lock held)
+ *
+ * A row is copied up to the widest of its new and its old contents
+ */
 void
-fast_renderer_i::newline()
+fast_renderer_i::flush_rows()
 {
-    this->println("");
+    for (uint32_t y = this->dirty_first; y <= this->dirty_last; y++) {
+        uint32_t row   = this->ring_row(y);
+        uint32_t width = this->row_width[row] > this->shown_width[y] ? this->row_width[row]
+                                                                     : this->shown_width[y];
+
+        copy_pixels(this->video_memory.base + y * this->video_memory.ppscl,
+                    this->video_cache.base + row * this->video_cache.ppscl,
+                    width);
+        this->shown_width[y] = this->row_width[row];
+    }
+
+    this->dirty_first   = 1;
+    this->dirty_last    = 0;
+    this->pending_lines = 0;
 }
 
+/**
+ * Draw a pixel to the cache
+ *
+ * Video memory is only written by flush(), reading from it is WAY MORE expensive than writing to
+ * it (in certain real hardware makes scrolling unusable) so it's never read
+ */
 void
 fast_renderer_i::draw_pixel(uint32_t x, uint32_t y)
 {
-    /* Double copy, one in the cache and other in video memory, this is to avoid reading
-     * from video_memory when scrolling, as reading from video_memory is WAY MORE
-     * expensive than writing to it (in certain real hardware makes scrolling unusable) */
-    *(static_cast<unsigned int *>(this->video_memory.base + x + (y * this->video_memory.ppscl))) =
-      static_cast<unsigned int>(this->color);
+    if (x >= this->video_cache.width || y >= this->video_cache.height) [[unlikely]]
+        return;
+
+    uint32_t row = this->ring_row(y);
+    this->video_cache.base[x + row * this->video_cache.ppscl] = static_cast<uint32_t>(this->color);
 
-    *(this->get_pixel(x, y)) = static_cast<unsigned int>(this->color);
+    if (x >= this->row_width[row])
+        this->row_width[row] = x + 1;
+    this->mark_dirty(y, y);
 }
 
 void
@@ -357,17 +374,6 @@ fast_renderer_i::popColor()
     this->color = this->alt_color;
 }
 
-uint32_t *
-fast_renderer_i::get_pixel(uint32_t x, uint32_t y)
-{
-    uint32_t *ptr = this->video_cache.actual + x + (y * this->video_cache.ppscl);
-
-    if (ptr >= this->video_cache.limit)
-        ptr = this->video_cache.base + (ptr - this->video_cache.limit);
-
-    return ptr;
-}
-
 void
 fast_renderer_i::pushCoords(uint32_t x, uint32_t y)
 {
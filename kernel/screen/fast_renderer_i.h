@@ -1,36 +1,45 @@
 /**
- * Class to output to the screen (faster)
+ * Cache of the screen (faster output)
  *
  * @author Ernesto Martínez García <me@ecomaikgolf.com>
  */
 
 #pragma once
 
+#include "screen/colors.h"
 #include "screen/framebuffer.h"
-#include "screen/renderer_i.h"
+#include "sync/spinlock.h"
+#include "time/wheel.h"
 #include <stdarg.h>
 #include <stdint.h>
 
 namespace screen {
 
 /**
- * Interface to output to the screen (faster)
+ * Cache of the screen, the non font specific part of the text renderers (see text_renderer.h)
+ *
+ * Glyphs are drawn only to the cache, a ring buffer whose first screen row moves down when
+ * scrolling. The rows changed since the last flush() are tracked and copied to video memory when a
+ * print ends, so a string of several lines costs a single copy even if it scrolls. Every row also
+ * records how wide its contents are, flushing a row copies only that part (and what the row showed
+ * before), which keeps the copy of a scroll proportional to the text on the screen instead of the
+ * whole framebuffer
+ *
+ * Output is batched: the rows are flushed once a screenful of lines is pending, on flush() or
+ * FLUSH_DELAY_NS after the first unflushed write (timer interrupt). Output written with interrupts
+ * disabled or before the timers run is flushed right away. Every operation that draws is
+ * serialised by a lock, so the renderer can be used from any CPU and from interrupt handlers
  */
-class fast_renderer_i : public renderer_i
+class fast_renderer_i
 {
   public:
-    fast_renderer_i(framebuffer, unsigned int, unsigned int, color_e);
-    fast_renderer_i()             = default;
-    virtual void draw(const char) = 0;
-    void put(const char);
-    void print(const char *, int64_t n = -1);
-    void println(const char *);
-    void fmt(const char *, ...);
-    void newline();
+    fast_renderer_i(framebuffer, unsigned int, unsigned int, color_e, unsigned int, unsigned int);
+    fast_renderer_i() = default;
     void clear();
-    void scroll();
     void setColor(color_e);
     color_e getColor();
+    void setBackground(color_e);
+    color_e getBackground();
     void pushColor(color_e);
     void popColor();
     uint32_t get_x();
@@ -39,22 +48,117 @@ class fast_renderer_i : public renderer_i
     void set_y(uint32_t);
     void pushCoords(uint32_t, uint32_t);
     void popCoords();
+    void flush();
     uint32_t get_width();
     uint32_t get_height();
-    /** renderer glyph x size */
-    virtual unsigned int glyph_x() = 0;
-    /** renderer glyph y size */
-    virtual unsigned int glyph_y() = 0;
+
+    /** Delay of the deferred flush */
+    static const uint64_t FLUSH_DELAY_NS = 10 * time::NS_PER_MS;
+
+    /**
+     * Two pixels, allowed to alias uint32_t pixels and to sit at any pixel (odd x)
+     */
+    typedef uint64_t __attribute__((may_alias, aligned(4))) pixel_pair;
 
   protected:
     void draw_pixel(uint32_t, uint32_t);
-    uint32_t *get_pixel(uint32_t, uint32_t);
-    void update_video();
-    void update_line();
+    void commit(uint64_t);
+    void flush_rows();
+    void scroll_cache();
+    void clear_cache();
+    static void flush_expired(time::timer *);
+    void format(const char *, va_list, void (*)(fast_renderer_i *, const char *, int64_t));
+
+    /**
+     * Copy a run of pixels (biggest integer assignments)
+     *
+     * General purpose registers only, not SSE: the flush also runs in the timer interrupt, where
+     * an SSE store would fault (#NM, lazy FPU switching) or clobber the XMM registers of a thread
+     */
+    static void copy_pixels(uint32_t *dst, const uint32_t *src, uint64_t pixels)
+    {
+        pixel_pair *dst_64       = (pixel_pair *)dst;
+        const pixel_pair *src_64 = (const pixel_pair *)src;
+        for (uint64_t i = 0; i < pixels / 2; i++)
+            *dst_64++ = *src_64++;
+
+        if (pixels % 2)
+            dst[pixels - 1] = src[pixels - 1];
+    }
+
+    /**
+     * Cache row holding a screen row
+     */
+    uint32_t ring_row(uint32_t y)
+    {
+        uint32_t row = this->top_row + y;
+        return row >= this->video_cache.height ? row - this->video_cache.height : row;
+    }
+
+    /**
+     * Add screen rows to the ones to flush
+     */
+    void mark_dirty(uint32_t first, uint32_t last)
+    {
+        if (this->dirty_first > this->dirty_last) {
+            this->dirty_first = first;
+            this->dirty_last  = last;
+            return;
+        }
+
+        if (first < this->dirty_first)
+            this->dirty_first = first;
+        if (last > this->dirty_last)
+            this->dirty_last = last;
+    }
+
+    /**
+     * Draw a width x height tile of pixels to the cache at the current offsets
+     *
+     * Each tile row is one copy into the cache row, which holds complete glyph rows as the cache
+     * ring only moves by whole glyph rows. Inlined with constant sizes the copies are unrolled
+     */
+    void draw_tile(const uint32_t *tile, uint32_t width, uint32_t height)
+    {
+        uint32_t x = this->x_offset;
+        uint32_t y = this->y_offset;
+        if (x + width > this->video_cache.width || y + height > this->video_cache.height)
+            [[unlikely]]
+            return;
+
+        for (uint32_t i = 0; i < height; i++) {
+            uint32_t row = this->ring_row(y + i);
+            copy_pixels(this->video_cache.base + row * this->video_cache.ppscl + x, tile, width);
+            if (x + width > this->row_width[row])
+                this->row_width[row] = x + width;
+            tile += width;
+        }
+
+        this->mark_dirty(y, y + height - 1);
+    }
+
     /** Video Memory */
     framebuffer video_memory;
     /** Cache (double buffer) */
     cache_framebuffer video_cache;
+    /** Glyph height, lines of the cache ring */
+    unsigned int cell_y;
+    /** Cache row shown at the top of the screen (video_cache.actual) */
+    unsigned int top_row;
+    /** Pixels drawn in each cache row, from the left (indexed by cache row) */
+    uint16_t *row_width;
+    /** Pixels drawn in each video memory row, from the left (indexed by screen row) */
+    uint16_t *shown_width;
+    /** Screen rows changed since the last flush (none if first > last) */
+    unsigned int dirty_first;
+    unsigned int dirty_last;
+    /** Lines written since the last flush */
+    unsigned int pending_lines = 0;
+    /** Deferred flush timer, armed by the first unflushed write */
+    time::timer flush_timer;
+    bool flush_armed = false;
+    /** Serialises every operation that draws */
+    sync::ticket_lock lock;
     /** x PIXEL offset of next glyph */
     unsigned int x_offset;
     unsigned int alt_x_offset; // backup for push/pop
@@ -64,6 +168,8 @@ class fast_renderer_i : public renderer_i
     /** color of next glyph */
     color_e color;
     color_e alt_color;
+    /** background color of next glyph (drawn as a tile) */
+    color_e background = color_e::BLACK;
 };
 
 } // namespace screen
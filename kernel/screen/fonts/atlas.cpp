@@ -0,0 +1,89 @@
+/**
+ * Glyph atlas
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "screen/fonts/atlas.h"
+#include "kernel.h"
+
+namespace screen {
+namespace fonts {
+
+/**
+ * Reserve the tiles of glyphs of width x height pixels
+ *
+ * @return false if there is no memory (the atlas stays empty and find()/insert() fail)
+ */
+bool
+atlas::init(uint32_t width, uint32_t height)
+{
+    uint64_t size = TILES * width * height * sizeof(uint32_t);
+    this->tiles   = (uint32_t *)kernel::allocator.request_cont_page(size / kernel::page_size + 1);
+    if (this->tiles == nullptr)
+        return false;
+
+    this->tile_size = width * height;
+    return true;
+}
+
+/**
+ * Tile key, the glyph number above the two 24 bit colors (bit 63 set so it's never 0)
+ */
+uint64_t
+atlas::key(uint32_t glyph, color_e fg, color_e bg)
+{
+    return (1ull << 63) | ((uint64_t)(glyph & 0x7fff) << 48) |
+           ((uint64_t)((uint32_t)fg & 0xffffff) << 24) | ((uint32_t)bg & 0xffffff);
+}
+
+/**
+ * Tile of a glyph drawn with some colors
+ *
+ * @return the tile or nullptr if it's not in the atlas
+ */
+uint32_t *
+atlas::find(uint32_t glyph, color_e fg, color_e bg)
+{
+    if (this->tiles == nullptr)
+        return nullptr;
+
+    uint64_t wanted = key(glyph, fg, bg);
+    uint32_t slot   = this->hints[glyph % HINTS];
+    if (this->keys[slot] != wanted) {
+        for (slot = 0; slot < TILES && this->keys[slot] != wanted; slot++)
+            ;
+        if (slot == TILES)
+            return nullptr;
+        this->hints[glyph % HINTS] = slot;
+    }
+
+    this->used[slot] = ++this->clock;
+    return this->tiles + slot * this->tile_size;
+}
+
+/**
+ * Replace the least recently used tile by a glyph drawn with some colors
+ *
+ * @return the tile for the caller to rasterize or nullptr if the atlas has no memory
+ */
+uint32_t *
+atlas::insert(uint32_t glyph, color_e fg, color_e bg)
+{
+    if (this->tiles == nullptr)
+        return nullptr;
+
+    uint32_t victim = 0;
+    for (uint32_t slot = 1; slot < TILES; slot++) {
+        if (this->used[slot] < this->used[victim])
+            victim = slot;
+    }
+
+    this->keys[victim]         = key(glyph, fg, bg);
+    this->used[victim]         = ++this->clock;
+    this->hints[glyph % HINTS] = victim;
+    return this->tiles + victim * this->tile_size;
+}
+
+} // namespace fonts
+} // namespace screen
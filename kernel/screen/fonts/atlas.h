@@ -0,0 +1,48 @@
+/**
+ * Glyph atlas
+ *
+ * Glyphs rasterized to 32bpp tiles for a foreground/background color pair, so drawing a character
+ * is a copy of its rows instead of a test of every bit of its bitmap. The atlas keeps the last
+ * used tiles, the least recently used one is replaced when a new one is needed
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "screen/colors.h"
+#include <stdint.h>
+
+namespace screen {
+namespace fonts {
+
+class atlas
+{
+  public:
+    /** Tiles in the atlas */
+    static const uint32_t TILES = 64;
+    /** Entries of the last used tile of each hash (glyph number) */
+    static const uint32_t HINTS = 256;
+
+    atlas() = default;
+    bool init(uint32_t, uint32_t);
+    uint32_t *find(uint32_t, color_e, color_e);
+    uint32_t *insert(uint32_t, color_e, color_e);
+
+  private:
+    static uint64_t key(uint32_t, color_e, color_e);
+
+    /** Tile pixels, TILES tiles of width * height */
+    uint32_t *tiles    = nullptr;
+    uint32_t tile_size = 0;
+    /** Glyph and colors of each tile (0 if unused, keys are never 0) */
+    uint64_t keys[TILES] = {};
+    /** Last use of each tile */
+    uint32_t used[TILES] = {};
+    uint32_t clock       = 0;
+    /** Tile last used by each hash */
+    uint8_t hints[HINTS] = {};
+};
+
+} // namespace fonts
+} // namespace screen
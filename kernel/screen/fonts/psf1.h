@@ -7,7 +7,9 @@
 #pragma once
 
 #include "screen/colors.h"
+#include "screen/fonts/atlas.h"
 #include "screen/framebuffer.h"
+#include "screen/text_renderer.h"
 
 namespace screen {
 
@@ -46,9 +48,10 @@ struct psf1
 
 /**
  * Renderer with PSF1 fonts
+ *
+ * PSF1 glyphs are always 8x16, the character loop of text_renderer is built with that size
  */
-template<typename T>
-class psf1 : public T
+class psf1 : public text_renderer<psf1>
 {
   public:
     psf1(screen::framebuffer fb,
@@ -56,52 +59,96 @@ class psf1 : public T
          unsigned int x_offset = 0,
          unsigned int y_offset = 0,
          color_e color         = color_e::WHITE)
-      : T(fb, x_offset, y_offset, color)
+      : text_renderer(fb, x_offset, y_offset, color, glyph_x(), glyph_y())
       , font(font)
-    {}
+    {
+        this->glyphs.init(glyph_x(), glyph_y());
+    }
 
     psf1() = default;
 
     psf1 &operator=(psf1 &&rhs)
     {
-        T::operator=(rhs);
-        this->font = rhs.font;
+        text_renderer::operator=(rhs);
+        this->font   = rhs.font;
+        this->glyphs = rhs.glyphs;
         return *this;
     }
 
+    /**
+     * Draw a character
+     *
+     * The glyph is rasterized with the current colors the first time, then copied from the atlas
+     */
     void draw(const char character)
     {
-        /* Select character from glyph buffer (a character is composed by charsize
-         * elements )*/
-        char *chr = static_cast<char *>(this->font.buffer) +
-                    (static_cast<unsigned char>(character) * this->font.header.charsize);
-
-        /* Iterate bitmap "rectangle" (with offset as base) */
-        for (unsigned long y = this->y_offset; y < this->y_offset + this->glyph_y(); y++) {
-            for (unsigned long x = this->x_offset; x < this->x_offset + this->glyph_x(); x++) {
-                /* Each Y from bitmap is a "flag number", check if corresponding
-                 * x bit is set */
-                if ((*chr & (0b10000000 >> (x - this->x_offset))))
-                    this->draw_pixel(x, y);
+        unsigned char glyph = static_cast<unsigned char>(character);
+        uint32_t *tile      = this->glyphs.find(glyph, this->color, this->background);
+        if (tile == nullptr) {
+            tile = this->glyphs.insert(glyph, this->color, this->background);
+            if (tile == nullptr) [[unlikely]] {
+                this->draw_bits(glyph);
+                return;
             }
-            chr++; /* increase char to iterate over entire charsize elements */
+            this->rasterize(glyph, tile);
         }
+
+        this->draw_tile(tile, glyph_x(), glyph_y());
     }
 
     ///** renderer glyph x size */
-    unsigned int glyph_x()
+    static constexpr unsigned int glyph_x()
     {
         return fonts::specification::psf1::glyph_x;
     }
     ///** renderer glyph y size */
-    unsigned int glyph_y()
+    static constexpr unsigned int glyph_y()
     {
         return fonts::specification::psf1::glyph_y;
     }
 
   private:
+    /**
+     * Expand a glyph bitmap to a tile of the current colors
+     */
+    void rasterize(unsigned char glyph, uint32_t *tile)
+    {
+        const uint8_t *chr = static_cast<uint8_t *>(this->font.buffer) +
+                             (glyph * this->font.header.charsize);
+
+        for (unsigned int y = 0; y < glyph_y(); y++, chr++) {
+            for (unsigned int x = 0; x < glyph_x(); x++) {
+                *tile++ = static_cast<uint32_t>((*chr & (0b10000000 >> x)) ? this->color
+                                                                            : this->background);
+            }
+        }
+    }
+
+    /**
+     * Draw a glyph pixel by pixel (atlas without memory), only its set bits
+     */
+    void draw_bits(unsigned char glyph)
+    {
+        /* Select character from glyph buffer (a character is composed by charsize
+         * elements )*/
+        char *chr = static_cast<char *>(this->font.buffer) + (glyph * this->font.header.charsize);
+
+        /* Iterate bitmap "rectangle" (with offset as base) */
+        for (unsigned long y = this->y_offset; y < this->y_offset + glyph_y(); y++) {
+            for (unsigned long x = this->x_offset; x < this->x_offset + glyph_x(); x++) {
+                /* Each Y from bitmap is a "flag number", check if corresponding
+                 * x bit is set */
+                if ((*chr & (0b10000000 >> (x - this->x_offset))))
+                    this->draw_pixel(x, y);
+            }
+            chr++; /* increase char to iterate over entire charsize elements */
+        }
+    }
+
     /** PSF1 font to use */
     fonts::specification::psf1 font;
+    /** Rasterized glyphs */
+    fonts::atlas glyphs;
 };
 
 } // namespace fonts
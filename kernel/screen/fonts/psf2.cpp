@@ -0,0 +1,191 @@
+/**
+ * PSF2 fonts (any glyph size)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "screen/fonts/psf2.h"
+
+namespace screen {
+namespace fonts {
+namespace specification {
+
+/* PSF1 header: magic, 512 glyphs mode and unicode table mode */
+static const uint8_t PSF1_MAGIC0     = 0x36;
+static const uint8_t PSF1_MAGIC1     = 0x04;
+static const uint8_t PSF1_MODE512    = 0x01;
+static const uint8_t PSF1_MODEHASTAB = 0x02;
+/* PSF1 unicode table: end of the entries of a glyph and start of a sequence */
+static const uint16_t PSF1_SEPARATOR = 0xffff;
+static const uint16_t PSF1_STARTSEQ  = 0xfffe;
+/* PSF2 unicode table: end of the entries of a glyph and start of a sequence */
+static const uint8_t PSF2_SEPARATOR = 0xff;
+static const uint8_t PSF2_STARTSEQ  = 0xfe;
+
+/** Entry of map[] without a glyph */
+static const uint16_t UNMAPPED = 0xffff;
+
+/**
+ * Map a code point to a glyph, the first glyph listed for it wins
+ */
+static void
+map_code(psf2 &font, uint32_t code, uint32_t glyph)
+{
+    if (code < 256 && font.map[code] == UNMAPPED)
+        font.map[code] = glyph;
+}
+
+/**
+ * Decode an UTF-8 code point
+ *
+ * @param str pointer to the code point, advanced past it
+ * @param end end of the buffer
+ * @return the code point (0xfffd if the encoding is invalid or cut by the end)
+ */
+static uint32_t
+utf8_decode(const uint8_t *&str, const uint8_t *end)
+{
+    uint8_t first = *str++;
+    if (first < 0x80)
+        return first;
+
+    uint32_t extra = first >= 0xf0 ? 3 : first >= 0xe0 ? 2 : first >= 0xc0 ? 1 : 0;
+    if (extra == 0)
+        return 0xfffd;
+
+    uint32_t code = first & (0x3f >> extra);
+    for (uint32_t i = 0; i < extra; i++) {
+        if (str == end || (*str & 0xc0) != 0x80)
+            return 0xfffd;
+        code = (code << 6) | (*str++ & 0x3f);
+    }
+    return code;
+}
+
+/**
+ * Fill map[] from a PSF2 unicode table (UTF-8, sequences of combining characters are skipped)
+ *
+ * A table cut by the end of the file maps the glyphs it got to
+ */
+static void
+psf2_table(psf2 &font, const uint8_t *table, const uint8_t *end)
+{
+    for (uint32_t glyph = 0; glyph < font.length && table < end; glyph++) {
+        bool sequence = false;
+        while (table < end && *table != PSF2_SEPARATOR) {
+            if (*table == PSF2_STARTSEQ) {
+                sequence = true;
+                table++;
+                continue;
+            }
+
+            uint32_t code = utf8_decode(table, end);
+            if (!sequence)
+                map_code(font, code, glyph);
+        }
+        table++;
+    }
+}
+
+/**
+ * Fill map[] from a PSF1 unicode table (UCS-2, sequences of combining characters are skipped)
+ *
+ * A table cut by the end of the file maps the glyphs it got to
+ */
+static void
+psf1_table(psf2 &font, const uint16_t *table, const uint16_t *end)
+{
+    for (uint32_t glyph = 0; glyph < font.length && table < end; glyph++) {
+        bool sequence = false;
+        for (; table < end && *table != PSF1_SEPARATOR; table++) {
+            if (*table == PSF1_STARTSEQ)
+                sequence = true;
+            else if (!sequence)
+                map_code(font, *table, glyph);
+        }
+        table++;
+    }
+}
+
+/**
+ * Read a PSF2 or PSF1 font
+ *
+ * Characters are mapped to glyphs with the unicode table of the font, if it has one, otherwise
+ * character n is glyph n. Characters without a glyph are drawn as '?' (or glyph 0)
+ *
+ * @param data font file
+ * @param size bytes of the font file, nothing past them is read
+ * @param font metrics, glyph buffer and character map of the font
+ * @return false if data isn't a PSF font or its glyphs don't fit in size
+ */
+bool
+parse(const void *data, uint64_t size, psf2 &font)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    if (bytes == nullptr || size < sizeof(psf1_header))
+        return false;
+    const uint8_t *end = bytes + size;
+
+    for (uint32_t i = 0; i < 256; i++)
+        font.map[i] = UNMAPPED;
+
+    const auto *header = static_cast<const psf2_header *>(data);
+    if (size >= sizeof(psf2_header) && header->magic == PSF2_MAGIC) {
+        if (header->width == 0 || header->height == 0 || header->length == 0)
+            return false;
+        if (header->headersize < sizeof(psf2_header) ||
+            header->headersize + (uint64_t)header->length * header->charsize > size)
+            return false;
+
+        font.buffer   = bytes + header->headersize;
+        font.length   = header->length;
+        font.charsize = header->charsize;
+        font.row_size = (header->width + 7) / 8;
+        font.glyph_x  = header->width;
+        font.glyph_y  = header->height;
+        if (font.row_size * font.glyph_y > font.charsize)
+            return false;
+
+        if (header->flags & PSF2_HAS_UNICODE_TABLE)
+            psf2_table(font, font.buffer + (uint64_t)font.length * font.charsize, end);
+    } else if (bytes[0] == PSF1_MAGIC0 && bytes[1] == PSF1_MAGIC1) {
+        const auto *old = static_cast<const psf1_header *>(data);
+        if (old->charsize == 0)
+            return false;
+
+        font.buffer   = bytes + sizeof(psf1_header);
+        font.length   = old->mode & PSF1_MODE512 ? 512 : 256;
+        font.charsize = old->charsize;
+        font.row_size = 1;
+        font.glyph_x  = 8;
+        font.glyph_y  = old->charsize;
+        if (sizeof(psf1_header) + (uint64_t)font.length * font.charsize > size)
+            return false;
+
+        if (old->mode & PSF1_MODEHASTAB) {
+            const uint8_t *table = font.buffer + font.length * font.charsize;
+            psf1_table(font,
+                       (const uint16_t *)table,
+                       (const uint16_t *)table + (end - table) / sizeof(uint16_t));
+        }
+    } else {
+        return false;
+    }
+
+    /* No table: identity. Characters the table doesn't list: '?' */
+    bool table = false;
+    for (uint32_t i = 0; i < 256 && !table; i++)
+        table = font.map[i] != UNMAPPED;
+
+    uint16_t fallback = table && font.map['?'] != UNMAPPED ? font.map['?'] : 0;
+    for (uint32_t i = 0; i < 256; i++) {
+        if (font.map[i] == UNMAPPED)
+            font.map[i] = !table && i < font.length ? i : fallback;
+    }
+
+    return true;
+}
+
+} // namespace specification
+} // namespace fonts
+} // namespace screen
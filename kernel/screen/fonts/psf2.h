@@ -0,0 +1,180 @@
+/**
+ * PSF2 fonts (any glyph size)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "screen/colors.h"
+#include "screen/fonts/atlas.h"
+#include "screen/fonts/psf1.h"
+#include "screen/framebuffer.h"
+#include "screen/text_renderer.h"
+#include <stdint.h>
+
+namespace screen {
+
+namespace fonts {
+
+namespace specification {
+
+/** 0x72b54a86, little endian */
+const uint32_t PSF2_MAGIC = 0x864ab572;
+/** The font has a unicode table */
+const uint32_t PSF2_HAS_UNICODE_TABLE = 0x01;
+
+struct psf2_header
+{
+    uint32_t magic;
+    uint32_t version;
+    /** offset of the glyph buffer */
+    uint32_t headersize;
+    uint32_t flags;
+    /** number of glyphs */
+    uint32_t length;
+    /** size of each glyph in the glyph buffer */
+    uint32_t charsize;
+    /** glyph y size in pixels */
+    uint32_t height;
+    /** glyph x size in pixels */
+    uint32_t width;
+};
+
+/**
+ * Loaded font (PSF2 or PSF1), glyph metrics read from its header
+ *
+ * Glyph rows are (width + 7) / 8 bytes, leftmost pixel in the highest bit
+ */
+struct psf2
+{
+    /** glyph buffer */
+    const uint8_t *buffer = nullptr;
+    /** number of glyphs */
+    uint32_t length = 0;
+    /** size of each glyph in the glyph buffer */
+    uint32_t charsize = 0;
+    /** bytes of a glyph row */
+    uint32_t row_size = 0;
+    /** Glyph x size in pixels */
+    uint32_t glyph_x = 0;
+    /** Glyph y size in pixels */
+    uint32_t glyph_y = 0;
+    /** Glyph of each character (latin-1 code point), from the unicode table */
+    uint16_t map[256] = {};
+};
+
+bool parse(const void *, uint64_t, psf2 &);
+
+} // namespace specification
+
+/**
+ * Renderer with PSF2 (or PSF1) fonts, the glyph size comes from the font
+ *
+ * Glyphs are drawn through the atlas like psf1, a wide or tall font costs a bigger tile copy, not
+ * a test of every bit of its bitmap
+ */
+class psf2 : public text_renderer<psf2>
+{
+  public:
+    psf2(screen::framebuffer fb,
+         const screen::fonts::specification::psf2 &font,
+         unsigned int x_offset = 0,
+         unsigned int y_offset = 0,
+         color_e color         = color_e::WHITE)
+      : text_renderer(fb, x_offset, y_offset, color, font.glyph_x, font.glyph_y)
+      , font(font)
+    {
+        this->glyphs.init(this->glyph_x(), this->glyph_y());
+    }
+
+    psf2() = default;
+
+    psf2 &operator=(psf2 &&rhs)
+    {
+        text_renderer::operator=(rhs);
+        this->font   = rhs.font;
+        this->glyphs = rhs.glyphs;
+        return *this;
+    }
+
+    /**
+     * Draw a character
+     *
+     * The glyph is rasterized with the current colors the first time, then copied from the atlas.
+     * 8x16 fonts (the usual console size) copy it with constant sizes, unrolled like psf1
+     */
+    void draw(const char character)
+    {
+        uint32_t glyph = this->font.map[static_cast<unsigned char>(character)];
+        uint32_t *tile = this->glyphs.find(glyph, this->color, this->background);
+        if (tile == nullptr) {
+            tile = this->glyphs.insert(glyph, this->color, this->background);
+            if (tile == nullptr) [[unlikely]] {
+                this->draw_bits(glyph);
+                return;
+            }
+            this->rasterize(glyph, tile);
+        }
+
+        if (this->glyph_x() == COMMON_X && this->glyph_y() == COMMON_Y) [[likely]]
+            this->draw_tile(tile, COMMON_X, COMMON_Y);
+        else
+            this->draw_tile(tile, this->glyph_x(), this->glyph_y());
+    }
+
+    ///** renderer glyph x size */
+    unsigned int glyph_x() const
+    {
+        return this->font.glyph_x;
+    }
+    ///** renderer glyph y size */
+    unsigned int glyph_y() const
+    {
+        return this->font.glyph_y;
+    }
+
+  private:
+    /** Glyph size with a compile time tile copy */
+    static const unsigned int COMMON_X = fonts::specification::psf1::glyph_x;
+    static const unsigned int COMMON_Y = fonts::specification::psf1::glyph_y;
+
+    /**
+     * Expand a glyph bitmap to a tile of the current colors
+     */
+    void rasterize(uint32_t glyph, uint32_t *tile)
+    {
+        const uint8_t *chr = this->font.buffer + glyph * this->font.charsize;
+
+        for (unsigned int y = 0; y < this->glyph_y(); y++, chr += this->font.row_size) {
+            for (unsigned int x = 0; x < this->glyph_x(); x++) {
+                *tile++ = static_cast<uint32_t>((chr[x / 8] & (0b10000000 >> (x % 8)))
+                                                  ? this->color
+                                                  : this->background);
+            }
+        }
+    }
+
+    /**
+     * Draw a glyph pixel by pixel (atlas without memory), only its set bits
+     */
+    void draw_bits(uint32_t glyph)
+    {
+        const uint8_t *chr = this->font.buffer + glyph * this->font.charsize;
+
+        for (unsigned int y = 0; y < this->glyph_y(); y++, chr += this->font.row_size) {
+            for (unsigned int x = 0; x < this->glyph_x(); x++) {
+                if (chr[x / 8] & (0b10000000 >> (x % 8)))
+                    this->draw_pixel(this->x_offset + x, this->y_offset + y);
+            }
+        }
+    }
+
+    /** Font to use */
+    fonts::specification::psf2 font;
+    /** Rasterized glyphs */
+    fonts::atlas glyphs;
+};
+
+} // namespace fonts
+} // namespace screen
@@ -14,6 +14,9 @@ namespace screen {
 
 /**
  * Interface to output to the screen
+ *
+ * The font renderers don't implement it (text_renderer.h is resolved at compile time), code that
+ * has to pick a renderer at run time wraps one in a renderer_ref
  */
 class renderer_i
 {
@@ -41,4 +44,122 @@ class renderer_i
     virtual uint32_t get_height()                    = 0;
 };
 
+/**
+ * Type-erased reference to a renderer R (one virtual call per operation instead of per character)
+ */
+template<typename R>
+class renderer_ref : public renderer_i
+{
+  public:
+    renderer_ref(R &renderer)
+      : renderer(renderer)
+    {}
+
+    void draw(const char c)
+    {
+        this->renderer.draw(c);
+    }
+
+    void put(const char c)
+    {
+        this->renderer.put(c);
+    }
+
+    void print(const char *str, int64_t n = -1)
+    {
+        this->renderer.print(str, n);
+    }
+
+    void println(const char *str)
+    {
+        this->renderer.println(str);
+    }
+
+    void newline()
+    {
+        this->renderer.newline();
+    }
+
+    void clear()
+    {
+        this->renderer.clear();
+    }
+
+    void scroll()
+    {
+        this->renderer.scroll();
+    }
+
+    void setColor(color_e color)
+    {
+        this->renderer.setColor(color);
+    }
+
+    color_e getColor()
+    {
+        return this->renderer.getColor();
+    }
+
+    void pushColor(color_e color)
+    {
+        this->renderer.pushColor(color);
+    }
+
+    void popColor()
+    {
+        this->renderer.popColor();
+    }
+
+    void pushCoords(uint32_t x, uint32_t y)
+    {
+        this->renderer.pushCoords(x, y);
+    }
+
+    void popCoords()
+    {
+        this->renderer.popCoords();
+    }
+
+    uint32_t get_x()
+    {
+        return this->renderer.get_x();
+    }
+
+    uint32_t get_y()
+    {
+        return this->renderer.get_y();
+    }
+
+    void set_x(uint32_t value)
+    {
+        this->renderer.set_x(value);
+    }
+
+    void set_y(uint32_t value)
+    {
+        this->renderer.set_y(value);
+    }
+
+    uint32_t get_width()
+    {
+        return this->renderer.get_width();
+    }
+
+    uint32_t get_height()
+    {
+        return this->renderer.get_height();
+    }
+
+    void fmt(const char *fmtstr, ...)
+    {
+        va_list args;
+        va_start(args, fmtstr);
+        this->renderer.vfmt(fmtstr, args);
+        va_end(args);
+    }
+
+  private:
+    R &renderer;
+};
+
 } // namespace screen
@@ -0,0 +1,336 @@
+/**
+ * Text renderer specialised for a font at compile time
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "screen/console.h"
+#include "screen/fast_renderer_i.h"
+#include <stdarg.h>
+#include <stdint.h>
+
+namespace screen {
+
+/**
+ * Text output on top of the screen cache, for the font renderer Derived (CRTP)
+ *
+ * Derived provides draw(char), drawing a glyph at the current offsets, and glyph_x() / glyph_y().
+ * The cell loop calls draw() directly, so there's no virtual call per character. Fonts of a fixed
+ * size (psf1) make glyph_x() / glyph_y() static constexpr and the compiler inlines the glyph copy
+ * with its row count and width unrolled. Fonts measured at run time (psf2) read them from the
+ * font, and take the same constant copy when the font is 8x16. renderer_ref (renderer_i.h) wraps a renderer for code that needs to choose one at run time
+ *
+ * Output goes to the virtual console of the writing thread (sched::thread::console) and is only
+ * stored there as cells (console.h), writing to a console costs a couple of stores per character.
+ * At the end of every print the shown console is rendered: the cache scrolls as many lines as the
+ * console did (moving the cache ring), then the rows the console changed are compared with the
+ * grid of cells on the screen and only the cells that differ are drawn. Clearing, switching
+ * consoles (show()) and browsing the scrollback (scroll_view()) are compares of every row, the
+ * cells that are the same on both sides aren't drawn again
+ */
+template<typename Derived>
+class text_renderer : public fast_renderer_i
+{
+  public:
+    text_renderer(framebuffer video_memory,
+                  unsigned int init_x,
+                  unsigned int init_y,
+                  color_e init_color,
+                  unsigned int cell_x,
+                  unsigned int cell_y)
+      : fast_renderer_i(video_memory, init_x, init_y, init_color, cell_x, cell_y)
+    {
+        uint32_t columns = this->video_cache.width / cell_x;
+        uint32_t rows    = this->video_cache.height / cell_y;
+        for (uint32_t i = 0; i < CONSOLES; i++)
+            this->consoles[i].init(columns, rows);
+        this->shown.init(columns, rows);
+    }
+
+    text_renderer() = default;
+
+    /**
+     * Draw a character to the screen
+     *
+     * Increases x_offset and y_offset, also recognises special chars as '\n'
+     *
+     * @param character Char to print
+     */
+    void put(const char character)
+    {
+        char aux[2] = { character, '\0' };
+        this->print(aux);
+    }
+
+    /**
+     * Print a string without default newline
+     *
+     * Increases x_offset and y_offset, also recognises special chars as '\n'
+     *
+     * @param str string to print
+     * @param n characters to print at most (-1 for the whole string)
+     */
+    void print(const char *str, int64_t n = -1)
+    {
+        auto flags = this->lock.lock_irqsave();
+        this->write(str, n);
+        this->present(flags);
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /**
+     * Print a string with a default newline
+     *
+     * @param str string to print
+     */
+    void println(const char *str)
+    {
+        auto flags = this->lock.lock_irqsave();
+        this->write(str);
+        this->write("\n");
+        this->present(flags);
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    void newline()
+    {
+        this->println("");
+    }
+
+    /**
+     * Scroll the console of the caller by 1 line (font glyph_y() pixels)
+     */
+    void scroll()
+    {
+        auto flags = this->lock.lock_irqsave();
+        this->consoles[caller_console()].scroll();
+        this->present(flags);
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /**
+     * Common fmt function (vaargs support), with a default newline
+     */
+    void fmt(const char *fmtstr, ...)
+    {
+        va_list args;
+        va_start(args, fmtstr);
+        this->vfmt(fmtstr, args);
+        va_end(args);
+    }
+
+    /**
+     * fmt() of a va_list
+     */
+    void vfmt(const char *fmtstr, va_list args)
+    {
+        auto flags = this->lock.lock_irqsave();
+        this->format(fmtstr, args, write_fragment);
+        this->write("\n");
+        this->present(flags);
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /**
+     * Clear the console of the caller
+     */
+    void clear()
+    {
+        auto flags = this->lock.lock_irqsave();
+        this->consoles[caller_console()].clear();
+        if (caller_console() == this->active)
+            this->view = 0;
+        this->present(flags);
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /**
+     * Erase the last characters written to the console of the caller (keyboard echo)
+     *
+     * @param n characters to erase, they can span lines
+     */
+    void erase(uint32_t n)
+    {
+        auto flags   = this->lock.lock_irqsave();
+        console *vc  = &this->consoles[caller_console()];
+        uint8_t attr = attributes(this->color, this->background);
+        for (uint32_t i = 0; i < n && vc->backspace(attr); i++)
+            ;
+        this->present(flags);
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /**
+     * Show a console
+     *
+     * @param index console number (0 to CONSOLES - 1)
+     */
+    void show(uint32_t index)
+    {
+        if (index >= CONSOLES)
+            return;
+
+        auto flags   = this->lock.lock_irqsave();
+        this->active = index;
+        this->view   = 0;
+        this->consoles[index].damage_all();
+        this->render();
+        this->flush_rows();
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /**
+     * Move the view of the shown console through its scrollback
+     *
+     * @param lines lines to go back (negative to go forward), the view stops at both ends
+     */
+    void scroll_view(int32_t lines)
+    {
+        auto flags  = this->lock.lock_irqsave();
+        console *vc = &this->consoles[this->active];
+        int64_t to  = (int64_t)this->view + lines;
+        if (to < 0)
+            to = 0;
+        if (to > vc->get_history())
+            to = vc->get_history();
+
+        if ((uint32_t)to != this->view) {
+            this->view = to;
+            vc->damage_all();
+            this->render();
+            this->flush_rows();
+        }
+        this->lock.unlock_irqrestore(flags);
+    }
+
+    /** Gets the console shown */
+    uint32_t get_active() const
+    {
+        return this->active;
+    }
+
+    /** Gets the lines the view is scrolled back */
+    uint32_t get_view() const
+    {
+        return this->view;
+    }
+
+    /** Gets a console */
+    const console &get_console(uint32_t index) const
+    {
+        return this->consoles[index];
+    }
+
+  protected:
+    /**
+     * Write a string to the console of the caller (print() without the lock and the render)
+     *
+     * ANSI escape sequences are interpreted by the console (console.h)
+     *
+     * @param str string to write
+     */
+    void write(const char *str, int64_t n = -1)
+    {
+        console *vc  = &this->consoles[caller_console()];
+        uint8_t attr = attributes(this->color, this->background);
+
+        for (int i = 0; str[i] && n != 0; i++, n--)
+            vc->write(str[i], attr);
+    }
+
+    /**
+     * End of a print: render the shown console and flush or arm the deferred flush (lock held)
+     */
+    void present(uint64_t flags)
+    {
+        this->render();
+        this->commit(flags);
+    }
+
+    /**
+     * Bring the cache up to date with the shown console (lock held)
+     *
+     * While the view is scrolled back it stays on the same lines as new output comes, and every
+     * row is compared
+     */
+    void render()
+    {
+        console *vc = &this->consoles[this->active];
+        uint32_t first, last, scrolled;
+        if (!vc->take_damage(first, last, scrolled))
+            return;
+
+        if (this->view != 0) {
+            this->view += scrolled;
+            if (this->view > vc->get_history())
+                this->view = vc->get_history();
+            first    = 0;
+            last     = vc->get_rows() - 1;
+            scrolled = 0;
+        }
+
+        for (uint32_t i = 0; i < scrolled; i++) {
+            this->scroll_cache();
+            this->shown.scroll();
+        }
+        this->pending_lines += scrolled;
+
+        if (first <= last)
+            this->draw_rows(vc, first, last);
+    }
+
+    /**
+     * Draw the cells of some rows of the shown console that differ from the screen (lock held)
+     */
+    void draw_rows(const console *vc, uint32_t first, uint32_t last)
+    {
+        Derived *font = static_cast<Derived *>(this);
+        color_e fg    = this->color;
+        color_e bg    = this->background;
+
+        for (uint32_t row = first; row <= last; row++) {
+            const cell *line = vc->line(row, this->view);
+            cell *on_screen  = this->shown.row(row);
+            if (line == nullptr)
+                break;
+
+            for (uint32_t column = 0; column < vc->get_columns(); column++) {
+                if (on_screen != nullptr && line[column] == on_screen[column])
+                    continue;
+
+                this->color      = foreground(line[column].attr);
+                this->background = screen::background(line[column].attr);
+                this->x_offset   = column * font->glyph_x();
+                this->y_offset   = row * font->glyph_y();
+                font->draw(line[column].character);
+                if (on_screen != nullptr)
+                    on_screen[column] = line[column];
+            }
+        }
+
+        this->color      = fg;
+        this->background = bg;
+        this->x_offset   = vc->get_column() * font->glyph_x();
+        this->y_offset   = vc->get_row() * font->glyph_y();
+    }
+
+    /**
+     * Sink of format(), the expanded pieces go to the character loop of Derived
+     */
+    static void write_fragment(fast_renderer_i *self, const char *str, int64_t n)
+    {
+        static_cast<text_renderer *>(self)->write(str, n);
+    }
+
+    /** Virtual consoles, one of them is shown */
+    console consoles[CONSOLES];
+    uint32_t active = 0;
+    /** Lines the shown console is scrolled back (0: following the output) */
+    uint32_t view = 0;
+    /** Cells on the screen */
+    grid shown;
+};
+
+} // namespace screen
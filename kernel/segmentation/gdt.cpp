@@ -0,0 +1,53 @@
+/**
+ * Global Descriptor Table managing
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "segmentation/gdt.h"
+#include "lib/string.h"
+
+namespace segmentation {
+
+/**
+ * Build the GDT + TSS of the calling CPU and load them
+ *
+ * Must be called only once per CPU, ltr faults if the TSS descriptor is already busy
+ *
+ * @param rsp0 stack used when an interrupt comes from ring 3
+ * @param fault_stack stack of the IST_FAULT vectors
+ */
+void
+cpu_tables::load(uint64_t rsp0, uint64_t fault_stack)
+{
+    /* Flat segments */
+    for (uint16_t i = 0; i < SEGMENTS; i++)
+        this->entries[i] = table[i];
+
+    /* Empty TSS without I/O bitmap */
+    memset(&this->task, 0, sizeof(tss));
+    this->task.rsp[0]             = rsp0;
+    this->task.ist[IST_FAULT - 1] = fault_stack;
+    this->task.iomap_base         = sizeof(tss);
+
+    uint64_t base  = (uint64_t)&this->task;
+    uint32_t limit = sizeof(tss) - 1;
+
+    this->tss_entry.limit_low   = limit & 0xffff;
+    this->tss_entry.base_low    = base & 0xffff;
+    this->tss_entry.base_middle = (base >> 16) & 0xff;
+    this->tss_entry.access      = 0x89;
+    this->tss_entry.granularity = (limit >> 16) & 0x0f;
+    this->tss_entry.base_high   = (base >> 24) & 0xff;
+    this->tss_entry.base_upper  = base >> 32;
+    this->tss_entry.reserved    = 0;
+
+    this->pointer.size   = sizeof(this->entries) + sizeof(this->tss_entry) - 1;
+    this->pointer.offset = (uint64_t)&this->entries;
+
+    /* Load it (assembly) and the task register */
+    load_gdt(&this->pointer);
+    asm volatile("ltr %0" : : "r"(TSS_SELECTOR));
+}
+
+} // namespace segmentation
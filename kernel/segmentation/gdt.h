@@ -118,16 +118,21 @@ const gdt_entry table[] = {
 	 * 	- Seg Leng = 0
 	 */
 	{ 0, 0, 0, 0x92, 0xa0, 0 },
-	/** User null descriptor */
+	/**
+	 * User null descriptor
+	 *
+	 * Would be the 32 bit user code segment, SYSRET loads CS from STAR + 16 and SS from STAR + 8
+	 * (see USER_CS, USER_DS)
+	 */
 	{ 0, 0, 0, 0, 0, 0 },
 	/** 
-	 * User code 
+	 * User data
 	 *
 	 * Access:
 	 * 	- Present? = 1
-	 * 	- Ring = 0
+	 * 	- Ring = 3
 	 * 	- Type? = 1
-	 * 	- Which Type = 1010
+	 * 	- Which Type = 0010
 	 *
 	 * Granularity:
 	 * 	- Granularity = 1 (4kbyte)
@@ -136,15 +141,15 @@ const gdt_entry table[] = {
 	 * 	- Available for system (0) = 0
 	 * 	- Seg Leng = 0
 	 */
-	{ 0, 0, 0, 0x9a, 0xa0, 0 },
+	{ 0, 0, 0, 0xf2, 0xa0, 0 },
 	/** 
-	 * User data
+	 * User code 
 	 *
 	 * Access:
 	 * 	- Present? = 1
-	 * 	- Ring = 0
+	 * 	- Ring = 3
 	 * 	- Type? = 1
-	 * 	- Which Type = 0010
+	 * 	- Which Type = 1010
 	 *
 	 * Granularity:
 	 * 	- Granularity = 1 (4kbyte)
@@ -153,9 +158,87 @@ const gdt_entry table[] = {
 	 * 	- Available for system (0) = 0
 	 * 	- Seg Leng = 0
 	 */
-	{ 0, 0, 0, 0x92, 0xa0, 0 },
+	{ 0, 0, 0, 0xfa, 0xa0, 0 },
 };
-// clang-format off
+// clang-format on
+
+/** Number of flat segment descriptors in the GDT */
+const uint16_t SEGMENTS = sizeof(table) / sizeof(gdt_entry);
+
+/** Kernel code and data selectors */
+const uint16_t KERNEL_CS = 0x08;
+const uint16_t KERNEL_DS = 0x10;
+/** User data and code selectors (RPL 3) */
+const uint16_t USER_DS = 0x20 | 3;
+const uint16_t USER_CS = 0x28 | 3;
+
+/**
+ * STAR MSR: SYSCALL loads CS = KERNEL_CS and SS = KERNEL_CS + 8, SYSRET (64 bit) loads
+ * CS = base + 16 and SS = base + 8 with base the user null descriptor
+ */
+const uint64_t STAR = ((uint64_t)(0x18 | 3) << 48) | ((uint64_t)KERNEL_CS << 32);
+
+/** Selector of the TSS descriptor, placed right after the flat segments */
+const uint16_t TSS_SELECTOR = SEGMENTS * sizeof(gdt_entry);
+
+/** Interrupt Stack Table entry used by faults that can happen on a broken stack (double fault) */
+const uint8_t IST_FAULT = 1;
+
+/**
+ * 64 bit Task State Segment
+ *
+ * No hardware task switching in long mode, only holds the stacks loaded on privilege level changes
+ * and the Interrupt Stack Table
+ */
+struct tss
+{
+    uint32_t reserved0;
+    /** Stack loaded when entering ring 0-2 from a less privileged ring */
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    /** Interrupt Stack Table */
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    /** Offset of the I/O permission bitmap (sizeof(tss) means none) */
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+/**
+ * TSS descriptor
+ *
+ * System descriptors are 16 bytes long in long mode (2 GDT slots)
+ */
+struct tss_descriptor
+{
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t base_middle;
+    /** Present, DPL 0, type 0x9 (available 64 bit TSS) */
+    uint8_t access;
+    uint8_t granularity;
+    uint8_t base_high;
+    uint32_t base_upper;
+    uint32_t reserved;
+} __attribute__((packed));
+
+/**
+ * Per CPU descriptor tables
+ *
+ * Every CPU needs its own TSS (ltr marks the descriptor busy and the stacks are per CPU) so every
+ * CPU also gets its own copy of the GDT holding the TSS descriptor
+ */
+struct cpu_tables
+{
+    /** Copy of table[] */
+    gdt_entry entries[SEGMENTS];
+    /** Must follow entries[] (selector TSS_SELECTOR) */
+    tss_descriptor tss_entry;
+    gdt_ptr pointer;
+    tss task;
+
+    void load(uint64_t rsp0, uint64_t fault_stack);
+} __attribute__((aligned(16)));
 
 /**
  * Load our GDT
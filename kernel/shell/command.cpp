@@ -5,10 +5,20 @@
  */
 
 #include "shell/command.h"
+#include "async/event.h"
+#include "async/task.h"
 #include "bootstrap/stivale_hdrs.h"
+#include "cpu/cpu.h"
 #include "kernel.h"
+#include "klog/klog.h"
 #include "lib/stdlib.h"
+#include "paging/pcid.h"
+#include "paging/tlb.h"
+#include "sched/thread.h"
 #include "shell/interpreter.h"
+#include "sync/rcu.h"
+#include "sync/stats.h"
+#include "user/process.h"
 
 namespace shell {
 
@@ -50,7 +60,7 @@ shell(int argc, char **argv)
         kernel::tty.pushColor(screen::color_e::GREEN);
         kernel::tty.print("$ ");
         kernel::tty.popColor();
-        kernel::keyboard.scanf(inter.get_buffer(), inter.BUFFER_SIZE);
+        io::PS2::local().scanf(inter.get_buffer(), inter.BUFFER_SIZE);
         auto ret = inter.process(inter.get_buffer());
         if (ret == 127) {
             kernel::tty.pushColor(screen::color_e::RED);
@@ -73,10 +83,13 @@ int
 pci(int argc, char **argv)
 {
     char buffer[256];
-    for (pci::pci_device *i = kernel::devices; i != nullptr; i = i->next) {
+    sync::rcu_read_lock();
+    for (auto i = sync::rcu_dereference(kernel::devices); i != nullptr;
+         i = sync::rcu_dereference(i->next)) {
         hstr(i->header->vendor, buffer);
         kernel::tty.fmt("* %p - %p", i->header->vendor, i->header->id);
     }
+    sync::rcu_read_unlock();
 
     return 0;
 }
@@ -104,7 +117,9 @@ getmac(int argc, char **argv)
 {
 
     char mac_addr[32];
-    for (pci::pci_device *i = kernel::devices; i != nullptr; i = i->next) {
+    sync::rcu_read_lock();
+    for (auto i = sync::rcu_dereference(kernel::devices); i != nullptr;
+         i = sync::rcu_dereference(i->next)) {
         if (i->header->id == 0x8139 && i->header->header_type == 0x0) {
 
             pci::header_t0 *ext_hdr = (pci::header_t0 *)i->header_ext;
@@ -123,6 +138,7 @@ getmac(int argc, char **argv)
             break;
         }
     }
+    sync::rcu_read_unlock();
     mac_addr[17] = '\0';
     kernel::tty.println(mac_addr);
 
@@ -411,7 +427,7 @@ sendpacket(int argc, char **argv)
     kernel::tty.print("> ");
 
     char text[256];
-    kernel::keyboard.scanf(text, 256);
+    io::PS2::local().scanf(text, 256);
 
     buffer->dsta[0] = 0xca;
     buffer->dsta[1] = 0xfe;
@@ -459,6 +475,276 @@ acpi(int argc, char **argv)
     return 0;
 }
 
+int
+heap(int argc, char **argv)
+{
+    bool lazy = kernel::heap.get_expansion() == heap::simple_allocator::expansion_e::lazy;
+
+    uint64_t reserved = kernel::heap.get_reserved() / 1024;
+    uint64_t resident = kernel::heap.get_resident() * kernel::page_size / 1024;
+
+    kernel::tty.fmt("mode: %s", lazy ? "lazy" : "eager");
+    kernel::tty.fmt("reserved: %i KiB", (int)reserved);
+    kernel::tty.fmt("resident: %i KiB", (int)resident);
+
+    return 0;
+}
+
+int
+clock(int argc, char **argv)
+{
+    if (!kernel::clock.is_calibrated()) {
+        kernel::tty.println("Clock not available");
+        return 1;
+    }
+
+    const char *invariant = kernel::clock.is_invariant() ? " (invariant)" : "";
+    const char *deadline  = kernel::timer.has_deadline() ? " (tsc-deadline)" : "";
+
+    kernel::tty.fmt("uptime: %i ms", (int)(kernel::clock.now() / time::NS_PER_MS));
+    kernel::tty.fmt("tsc: %i kHz%s", (int)(kernel::clock.get_frequency() / 1000), invariant);
+    kernel::tty.fmt("hpet: %i fs/tick", (int)kernel::hpet.get_period());
+    kernel::tty.fmt("apic timer: %i kHz%s", (int)(kernel::timer.get_frequency() / 1000), deadline);
+
+    return 0;
+}
+
+/**
+ * Expiration of the timer armed by the timers command
+ */
+static void
+alarm(time::timer *)
+{
+    kernel::tty.println("timer expired");
+}
+
+int
+timers(int argc, char **argv)
+{
+    static time::timer timer(alarm);
+
+    if (!kernel::clock.is_calibrated()) {
+        kernel::tty.println("Clock not available");
+        return 1;
+    }
+
+    /* Arm a one-shot timer with 1% slack */
+    if (argc >= 2) {
+        uint64_t delay = strol(argv[1], 10) * time::NS_PER_MS;
+
+        /* No migration between picking the wheel and arming, the shell may move between CPUs */
+        auto flags = cpu::irq_save();
+        bool armed = time::local().add(&timer, kernel::clock.now() + delay, delay / 100);
+        cpu::irq_restore(flags);
+
+        if (!armed) {
+            kernel::tty.println("timer pending on another CPU");
+            return 1;
+        }
+        kernel::tty.fmt("timer armed in %s ms", argv[1]);
+        return 0;
+    }
+
+    auto &wheel = time::local();
+    kernel::tty.fmt("pending: %i", (int)wheel.get_pending());
+    kernel::tty.fmt("expired: %i", (int)wheel.get_expired());
+    kernel::tty.fmt("hardware reprograms: %i", (int)wheel.get_programmed());
+    if (wheel.get_next() != time::wheel::NONE)
+        kernel::tty.fmt("next event: tick %i", (int)wheel.get_next());
+
+    return 0;
+}
+
+int
+cpus(int argc, char **argv)
+{
+    kernel::tty.fmt("%i CPUs online, running on CPU %i", (int)smp::count(), (int)smp::id());
+
+    for (uint32_t i = 0; i < smp::present(); i++) {
+        smp::processor *proc = &kernel::cpus[i];
+        const char *state    = proc->online.load() ? "online" : "offline";
+        uint64_t events      = *percpu::on(time::timer_events, i);
+        uint64_t switches    = *percpu::on(sched::switches, i);
+        uint64_t steals      = *percpu::on(sched::steals, i);
+        uint64_t sleeps      = *percpu::on(sched::idle_sleeps, i);
+        const char *idle     = *percpu::on(sched::use_mwait, i) ? "mwait" : "hlt";
+
+        kernel::tty.fmt("cpu %i: lapic %i %s, %i timer irqs",
+                        (int)proc->id,
+                        (int)proc->lapic_id,
+                        state,
+                        (int)events);
+        kernel::tty.fmt("       %i switches, %i steals", (int)switches, (int)steals);
+        kernel::tty.fmt("       %i idle periods (%s)", (int)sleeps, idle);
+    }
+
+    return 0;
+}
+
+int
+threads(int argc, char **argv)
+{
+    static const char *states[] = { "ready", "running", "blocked", "dead" };
+
+    auto flags = cpu::irq_save();
+    for (sched::thread *t = sched::threads(); t != nullptr; t = t->all_next) {
+        const char *state = states[static_cast<int>(t->state.load())];
+        kernel::tty.fmt("%i %s: %s on cpu %i", (int)t->id, t->name, state, (int)t->cpu);
+    }
+    cpu::irq_restore(flags);
+
+    return 0;
+}
+
+int
+locks(int argc, char **argv)
+{
+    for (sync::lock_stats *s = sync::all_stats(); s != nullptr; s = s->next) {
+        uint64_t acquires  = s->acquires.load(std::memory_order_relaxed);
+        uint64_t contended = s->contended.load(std::memory_order_relaxed);
+        uint64_t cycles    = s->spin_cycles.load(std::memory_order_relaxed);
+        uint64_t average   = contended == 0 ? 0 : cycles / contended;
+
+        kernel::tty.fmt("%s: %i acquires, %i contended, %i cycles per contended wait",
+                        s->name,
+                        (int)acquires,
+                        (int)contended,
+                        (int)average);
+    }
+
+    return 0;
+}
+
+int
+rcu(int argc, char **argv)
+{
+    kernel::tty.fmt("%i grace periods, %i callbacks pending",
+                    (int)sync::rcu_grace_periods(),
+                    (int)sync::rcu_pending());
+    return 0;
+}
+
+int
+tlb(int argc, char **argv)
+{
+    kernel::tty.fmt("%i shootdowns", (int)paging::tlb::shootdowns());
+    if (paging::pcid::enabled())
+        kernel::tty.fmt("pcid generation %i, %i in use%s",
+                        (int)paging::pcid::generation(),
+                        (int)paging::pcid::in_use(),
+                        paging::pcid::invpcid() ? ", invpcid" : "");
+    else
+        kernel::tty.println("pcid not supported");
+
+    for (uint32_t i = 0; i < smp::present(); i++) {
+        kernel::tty.fmt("cpu %i: %i shootdown irqs, %i full flushes",
+                        (int)i,
+                        (int)paging::tlb::ipis(i),
+                        (int)paging::tlb::full_flushes(i));
+    }
+
+    return 0;
+}
+
+/**
+ * Test flow: sleeps 10ms a few times
+ */
+static async::task<>
+ticker(uint32_t rounds)
+{
+    for (uint32_t i = 0; i < rounds; i++)
+        co_await async::sleep(10 * time::NS_PER_MS);
+}
+
+int
+async(int argc, char **argv)
+{
+    if (argc > 1) {
+        uint32_t count   = strol(argv[1], 10);
+        uint32_t spawned = 0;
+        while (spawned < count && async::spawn(ticker(10)))
+            spawned++;
+        kernel::tty.fmt("spawned %i flows", (int)spawned);
+    }
+
+    kernel::tty.fmt("%i workers, %i flows running, %i resumes",
+                    (int)async::workers(),
+                    (int)async::flows(),
+                    (int)async::resumes());
+    return 0;
+}
+
+int
+exec(int argc, char **argv)
+{
+    if (argc < 2) {
+        kernel::tty.println("usage: exec <module>");
+        return 1;
+    }
+
+    user::process *proc = user::spawn(argv[1]);
+    if (proc == nullptr) {
+        kernel::tty.fmt("can't run %s (no such module or no memory)", argv[1]);
+        return 1;
+    }
+
+    int64_t code = user::wait(proc);
+    kernel::tty.fmt("%s exited with %i", argv[1], (int)code);
+    return 0;
+}
+
+int
+dmesg(int argc, char **argv)
+{
+    /* Lowest severity to show */
+    klog::level_e level = klog::level_e::debug;
+    if (argc > 1) {
+        while (level < klog::level_e::error && strcmp(klog::level_name(level), argv[1]) != 0)
+            level = (klog::level_e)((uint8_t)level + 1);
+        if (strcmp(klog::level_name(level), argv[1]) != 0) {
+            kernel::tty.println("usage: dmesg [debug|info|warn|error]");
+            return 1;
+        }
+    }
+
+    uint64_t cursor = klog::oldest();
+    uint64_t lost   = 0;
+    klog::record rec;
+    char line[klog::LINE_SIZE];
+    while (klog::read(cursor, rec, &lost)) {
+        if (rec.level < level)
+            continue;
+        klog::render(rec, line);
+        kernel::tty.println(line);
+    }
+
+    kernel::tty.fmt("%i records logged, %i overwritten while reading",
+                    (int)klog::logged(),
+                    (int)lost);
+    return 0;
+}
+
+int
+serial(int argc, char **argv)
+{
+    if (!kernel::serial.is_present()) {
+        kernel::tty.println("no serial port");
+        return 1;
+    }
+
+    if (argc > 1 && !kernel::serial.set_baud(strol(argv[1], 10))) {
+        kernel::tty.fmt("%s bauds is not a divisor of %i", argv[1], (int)io::UART_BASE_BAUD);
+        return 1;
+    }
+
+    kernel::tty.fmt("COM1: %i bauds, %i byte FIFO, %i bytes sent (%i polled)",
+                    (int)kernel::serial.get_baud(),
+                    (int)kernel::serial.get_fifo(),
+                    (int)kernel::serial.get_sent(),
+                    (int)kernel::serial.get_polled());
+    return 0;
+}
+
 } // namespace commands
 
 } // namespace shell
@@ -35,6 +35,18 @@ int checknet(int, char **);
 int sendpacket(int, char **);
 int screen(int, char **);
 int acpi(int, char **);
+int heap(int, char **);
+int clock(int, char **);
+int timers(int, char **);
+int cpus(int, char **);
+int threads(int, char **);
+int locks(int, char **);
+int rcu(int, char **);
+int tlb(int, char **);
+int async(int, char **);
+int exec(int, char **);
+int dmesg(int, char **);
+int serial(int, char **);
 
 } // namespace commands
 
@@ -59,6 +71,18 @@ static const command kernel_commands[] = {
     { "sendpacket" , &commands::sendpacket},
     { "screen"     , &commands::screen},
     { "acpi"       , &commands::acpi},
+    { "heap"       , &commands::heap},
+    { "clock"      , &commands::clock},
+    { "timers"     , &commands::timers},
+    { "cpus"       , &commands::cpus},
+    { "threads"    , &commands::threads},
+    { "locks"      , &commands::locks},
+    { "rcu"        , &commands::rcu},
+    { "tlb"        , &commands::tlb},
+    { "async"      , &commands::async},
+    { "exec"       , &commands::exec},
+    { "dmesg"      , &commands::dmesg},
+    { "serial"     , &commands::serial},
     { nullptr , nullptr }
 };
 // clang-format on
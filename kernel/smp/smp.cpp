@@ -0,0 +1,174 @@
+/**
+ * Symmetric multiprocessing
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "smp/smp.h"
+#include "cpu/cpu.h"
+#include "interrupts/interrupts.h"
+#include "kernel.h"
+#include "klog/klog.h"
+#include "paging/pcid.h"
+#include "sched/thread.h"
+#include "user/syscall.h"
+
+namespace smp {
+
+DEFINE_PERCPU(processor *, this_cpu) = nullptr;
+DEFINE_PERCPU(uint32_t, cpu_id)       = 0;
+
+/** CPUs that reached their idle loop (BSP included) */
+static std::atomic<uint32_t> online_cpus = 0;
+/** CPUs with a processor block (BSP included) */
+static uint32_t present_cpus = 1;
+
+/**
+ * Set up the processor block of the calling CPU: load its GDT/TSS, its per CPU area and the
+ * SYSCALL MSRs
+ *
+ * @warning the per CPU area must have been created (percpu::create)
+ * @param proc processor block of the calling CPU (stack and fault_stack already set)
+ * @param id dense CPU index
+ */
+void
+init(processor *proc, uint32_t id)
+{
+    proc->id = id;
+    proc->tables.load(proc->stack, proc->fault_stack);
+
+    /* load_gdt reloads gs, so the base has to be set afterwards */
+    percpu::load(id);
+    percpu::write(this_cpu, proc);
+    percpu::write(cpu_id, id);
+
+    /* Ring 3 enters the kernel with SYSCALL */
+    user::init_cpu();
+}
+
+/**
+ * Allocate a CPU stack from the frame allocator
+ *
+ * @return top of the stack or 0 if there is no memory
+ */
+uint64_t
+alloc_stack(uint32_t pages)
+{
+    void *stack = kernel::allocator.request_cont_page(pages);
+    if (stack == nullptr)
+        return 0;
+    return (uint64_t)stack + pages * kernel::page_size;
+}
+
+/**
+ * Start every AP reported by the bootloader and wait for them to check in
+ *
+ * @param tag stivale2 SMP tag (nullptr if the bootloader didn't provide it)
+ */
+void
+start(stivale2_struct_tag_smp *tag)
+{
+    processor *bsp = current();
+    bsp->lapic_id  = kernel::lapic.id();
+    bsp->online.store(true);
+    online_cpus.fetch_add(1);
+
+    if (tag == nullptr)
+        return;
+
+    uint32_t next = 1;
+    for (uint64_t i = 0; i < tag->cpu_count && next < cpu::MAX_CPUS; i++) {
+        stivale2_smp_info *info = &tag->smp_info[i];
+        if (info->lapic_id == tag->bsp_lapic_id)
+            continue;
+
+        uint64_t stack       = alloc_stack(STACK_PAGES);
+        uint64_t fault_stack = alloc_stack(FAULT_STACK_PAGES);
+        if (stack == 0 || fault_stack == 0 || !percpu::create(next)) {
+            klog::fmt(klog::level_e::error, "smp: out of memory for AP stacks");
+            break;
+        }
+
+        processor *proc   = &kernel::cpus[next];
+        proc->id          = next++;
+        proc->lapic_id    = info->lapic_id;
+        proc->stack       = stack;
+        proc->fault_stack = fault_stack;
+
+        info->target_stack   = proc->stack;
+        info->extra_argument = (uint64_t)proc;
+
+        /* The AP polls goto_address, everything else must be visible before it */
+        __atomic_store_n(&info->goto_address, (uint64_t)&ap_entry, __ATOMIC_RELEASE);
+    }
+    present_cpus = next;
+
+    /* Wait for the APs to reach their idle loop (bounded spin if there is no clock) */
+    uint64_t deadline = kernel::clock.now() + BOOT_TIMEOUT_NS;
+    for (uint64_t spins = 0; online_cpus.load(std::memory_order_acquire) < next; spins++) {
+        if (kernel::clock.is_calibrated() ? kernel::clock.now() >= deadline : spins >= BOOT_SPINS)
+            break;
+        cpu::pause();
+    }
+
+    if (online_cpus.load() < next)
+        klog::fmt(klog::level_e::warning, "smp: some APs did not check in");
+}
+
+/**
+ * Number of CPUs with a processor block (kernel::cpus[0, present()))
+ */
+uint32_t
+present()
+{
+    return present_cpus;
+}
+
+/**
+ * Number of online CPUs
+ */
+uint32_t
+count()
+{
+    return online_cpus.load(std::memory_order_relaxed);
+}
+
+/**
+ * AP entry point, jumped to by the bootloader with the stack we provided
+ *
+ * The AP is already in long mode with the bootloader GDT, no IDT and interrupts disabled
+ */
+extern "C" [[noreturn]] void
+ap_entry(stivale2_smp_info *info)
+{
+    processor *proc = (processor *)info->extra_argument;
+
+    /* Same address space as the BSP */
+    kernel::translator.load(proc->id);
+    paging::pcid::init_cpu();
+    cpu::enable_sse();
+
+    /* Own GDT/TSS, gs base and the shared IDT */
+    init(proc, proc->id);
+    asm volatile("lidt %0" : : "m"(kernel::idtr));
+
+    /* Local APIC (same MMIO address, every CPU sees its own registers) */
+    kernel::lapic.enable(static_cast<uint8_t>(interrupts::vector_e::apic_spurious));
+
+    /*
+     * The LAPIC timer runs at the same frequency on every core, so the BSP calibration is reused.
+     * The TSC is assumed to be synchronized between cores (invariant TSC)
+     */
+    if (kernel::clock.is_calibrated())
+        time::local().start(&kernel::clock, &kernel::timer);
+
+    /* This flow becomes the idle thread of the AP */
+    sched::init_cpu();
+
+    proc->online.store(true);
+    online_cpus.fetch_add(1, std::memory_order_release);
+
+    sched::idle();
+}
+
+} // namespace smp
@@ -0,0 +1,81 @@
+/**
+ * Symmetric multiprocessing
+ *
+ * The bootloader (stivale2 SMP tag) wakes the application processors (APs) and parks them until we
+ * write their goto_address. Every CPU gets a processor structure with its own GDT/TSS and its
+ * own per CPU area
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include "percpu/percpu.h"
+#include "segmentation/gdt.h"
+#include "stivale2.h"
+#include <stdint.h>
+
+namespace smp {
+
+/** Pages of each AP kernel stack */
+const uint32_t STACK_PAGES = 4;
+/** Pages of each CPU double fault stack */
+const uint32_t FAULT_STACK_PAGES = 1;
+
+/** Time given to the APs to check in */
+const uint64_t BOOT_TIMEOUT_NS = 1000000000UL;
+/** Fallback for BOOT_TIMEOUT_NS when the clock is not calibrated */
+const uint64_t BOOT_SPINS = 100000000UL;
+
+/**
+ * CPU control block
+ */
+struct processor
+{
+    /** Dense index (0 = BSP), used to index per CPU arrays */
+    uint32_t id;
+    /** Local APIC id */
+    uint32_t lapic_id;
+    /** Top of the kernel stack the CPU booted with */
+    uint64_t stack;
+    /** Top of the double fault stack */
+    uint64_t fault_stack;
+    /** The CPU reached its idle loop */
+    std::atomic<bool> online;
+    /** GDT and TSS of the CPU */
+    segmentation::cpu_tables tables;
+};
+
+/** Processor block of each CPU */
+DECLARE_PERCPU(processor *, this_cpu);
+/** Index of each CPU */
+DECLARE_PERCPU(uint32_t, cpu_id);
+
+/**
+ * Processor block of the calling CPU
+ */
+inline processor *
+current()
+{
+    return percpu::read(this_cpu);
+}
+
+/**
+ * Index of the calling CPU
+ */
+inline uint32_t
+id()
+{
+    return percpu::read(cpu_id);
+}
+
+void init(processor *, uint32_t);
+uint64_t alloc_stack(uint32_t);
+void start(stivale2_struct_tag_smp *);
+uint32_t count();
+uint32_t present();
+
+extern "C" [[noreturn]] void ap_entry(stivale2_smp_info *);
+
+} // namespace smp
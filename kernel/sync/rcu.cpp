@@ -0,0 +1,172 @@
+/**
+ * Read-copy-update
+ *
+ * Grace periods are numbered. Every CPU remembers the last number it saw at a quiescent state, a
+ * grace period is over when every online CPU saw its number (or a later one). CPUs that don't
+ * report on their own (halted or running a long thread) get a reschedule IPI, which ends in a
+ * preemption point
+ *
+ * Readers don't need a fence: on x86 their loads are not reordered with the later store that
+ * reports the quiescent state, and the writer increments the grace period counter with a locked
+ * instruction after unpublishing the old version
+ *
+ * call_rcu() callbacks run in the "rcu" kernel thread, in batches after a grace period
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "sync/rcu.h"
+#include "kernel.h"
+#include "klog/klog.h"
+#include "lib/atomic.h"
+#include "smp/smp.h"
+#include "sync/wait.h"
+
+namespace sync {
+
+/** Last grace period started */
+static std::atomic<uint64_t> gp_seq = 0;
+/** Grace periods completed */
+static std::atomic<uint64_t> gp_done = 0;
+/** Grace period number seen by each CPU at its last quiescent state */
+DEFINE_PERCPU(uint64_t, rcu_seen) = 0;
+
+/** Callbacks waiting for a grace period (lock-free stack, newest first) */
+static std::atomic<rcu_head *> callbacks = nullptr;
+static std::atomic<uint64_t> queued      = 0;
+/** The rcu thread sleeps here while there are no callbacks */
+static wait_queue callback_waiters;
+
+/**
+ * Report a quiescent state of the calling CPU (called outside any read-side section)
+ */
+void
+rcu_quiescent()
+{
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    percpu::write(rcu_seen, gp_seq.load(std::memory_order_relaxed));
+}
+
+/**
+ * Every online CPU reported a quiescent state for grace period gp
+ *
+ * @param kick send a reschedule IPI to the CPUs that didn't
+ */
+static bool
+grace_period_over(uint64_t gp, bool kick)
+{
+    bool over = true;
+    for (uint32_t cpu = 0; cpu < smp::present(); cpu++) {
+        if (!kernel::cpus[cpu].online.load(std::memory_order_acquire))
+            continue;
+        if (__atomic_load_n(percpu::on(rcu_seen, cpu), __ATOMIC_ACQUIRE) >= gp)
+            continue;
+        over = false;
+        if (kick)
+            sched::resched_cpu(cpu);
+    }
+    return over;
+}
+
+/**
+ * Wait until every read-side section running at the call has finished
+ *
+ * @warning must not be called inside a read-side section
+ */
+void
+synchronize_rcu()
+{
+    uint64_t gp = gp_seq.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+    /* The caller is outside any read-side section, and every yield below goes through schedule() */
+    rcu_quiescent();
+
+    bool kicked = false;
+    while (!grace_period_over(gp, !kicked)) {
+        kicked = true;
+        if (sched::current() != nullptr)
+            sched::yield();
+        else
+            cpu::pause();
+    }
+
+    gp_done.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Run callback(head) after a grace period (can be called from interrupt context)
+ */
+void
+call_rcu(rcu_head *head, void (*callback)(rcu_head *))
+{
+    head->callback = callback;
+
+    rcu_head *top = callbacks.load(std::memory_order_relaxed);
+    do {
+        head->next = top;
+    } while (!callbacks.compare_exchange_weak(top, head, std::memory_order_release));
+    queued.fetch_add(1, std::memory_order_relaxed);
+
+    callback_waiters.wake_one();
+}
+
+/**
+ * Callback thread: waits a grace period for every batch of callbacks and runs them
+ */
+static void
+rcu_thread(void *)
+{
+    while (true) {
+        callback_waiters.wait(
+          [] { return callbacks.load(std::memory_order_relaxed) != nullptr; });
+
+        rcu_head *batch = callbacks.exchange(nullptr, std::memory_order_acquire);
+        synchronize_rcu();
+
+        /* The stack is newest first, run them in call order */
+        rcu_head *fifo = nullptr;
+        while (batch != nullptr) {
+            rcu_head *next = batch->next;
+            batch->next    = fifo;
+            fifo           = batch;
+            batch          = next;
+        }
+
+        while (fifo != nullptr) {
+            rcu_head *next = fifo->next;
+            fifo->callback(fifo);
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            fifo = next;
+        }
+    }
+}
+
+/**
+ * Start the callback thread (the scheduler must be initialised)
+ */
+void
+rcu_init()
+{
+    if (sched::create("rcu", rcu_thread, nullptr) == nullptr)
+        klog::fmt(klog::level_e::error, "rcu: can't create the callback thread");
+}
+
+/**
+ * Number of completed grace periods
+ */
+uint64_t
+rcu_grace_periods()
+{
+    return gp_done.load(std::memory_order_relaxed);
+}
+
+/**
+ * Number of callbacks waiting to run
+ */
+uint64_t
+rcu_pending()
+{
+    return queued.load(std::memory_order_relaxed);
+}
+
+} // namespace sync
@@ -0,0 +1,76 @@
+/**
+ * Read-copy-update
+ *
+ * For read-mostly data reached through a pointer (lists, tables). Readers only disable preemption,
+ * no atomic operation and no shared cache line is written. Writers publish a new version with
+ * rcu_assign_pointer() and free the old one once every CPU went through a quiescent state (a
+ * point outside any read-side section: context switch, idle loop, preemption point), which is
+ * when no reader can still hold it
+ *
+ * @warning read-side sections can't sleep
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "sched/thread.h"
+#include <stdint.h>
+
+namespace sync {
+
+/**
+ * Deferred free, embedded in the object to reclaim
+ */
+struct rcu_head
+{
+    rcu_head *next               = nullptr;
+    void (*callback)(rcu_head *) = nullptr;
+};
+
+/**
+ * Start a read-side section (nestable)
+ */
+inline void
+rcu_read_lock()
+{
+    sched::preempt_disable();
+}
+
+/**
+ * End a read-side section
+ */
+inline void
+rcu_read_unlock()
+{
+    sched::preempt_enable();
+}
+
+/**
+ * Load a pointer protected by RCU (inside a read-side section)
+ */
+template<typename T>
+inline T *
+rcu_dereference(T *const &ptr)
+{
+    return __atomic_load_n(&ptr, __ATOMIC_CONSUME);
+}
+
+/**
+ * Publish a pointer, the pointed object is initialised before readers can see it
+ */
+template<typename T>
+inline void
+rcu_assign_pointer(T *&ptr, T *value)
+{
+    __atomic_store_n(&ptr, value, __ATOMIC_RELEASE);
+}
+
+void rcu_init();
+void rcu_quiescent();
+void synchronize_rcu();
+void call_rcu(rcu_head *, void (*)(rcu_head *));
+uint64_t rcu_grace_periods();
+uint64_t rcu_pending();
+
+} // namespace sync
@@ -0,0 +1,308 @@
+/**
+ * Lock-free bounded ring queues
+ *
+ * - spsc_ring: one producer, one consumer (e.g. an interrupt handler and the thread reading it)
+ * - mpsc_ring: any number of producers (CPUs, interrupts), one consumer
+ * - mpmc_ring: any number of producers and consumers
+ *
+ * Capacity is a power of two fixed at compile time, no allocation. Producer and consumer indices
+ * live in different cache lines so the two sides don't bounce a line on every operation. push()
+ * fails when the ring is full and pop() when it is empty, callers decide whether to drop, retry
+ * or sleep
+ *
+ * T must be trivially copyable
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include <stdint.h>
+
+namespace sync {
+
+/**
+ * Single producer single consumer ring
+ *
+ * Each side keeps a private copy of the other side index and only reloads it when the ring looks
+ * full (producer) or empty (consumer)
+ */
+template<typename T, uint64_t N>
+class spsc_ring
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    spsc_ring() = default;
+    spsc_ring(const spsc_ring &) = delete;
+    spsc_ring &operator=(const spsc_ring &) = delete;
+
+    /**
+     * Append an element (producer)
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &value)
+    {
+        uint64_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - this->cached_head == N) {
+            this->cached_head = this->head.load(std::memory_order_acquire);
+            if (tail - this->cached_head == N)
+                return false;
+        }
+
+        this->buffer[tail & MASK] = value;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Take the oldest element (consumer)
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T &value)
+    {
+        uint64_t head = this->head.load(std::memory_order_relaxed);
+        if (head == this->cached_tail) {
+            this->cached_tail = this->tail.load(std::memory_order_acquire);
+            if (head == this->cached_tail)
+                return false;
+        }
+
+        value = this->buffer[head & MASK];
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Nothing to pop (exact for the consumer, a hint for anyone else) */
+    bool empty() const
+    {
+        return this->head.load(std::memory_order_relaxed) ==
+               this->tail.load(std::memory_order_acquire);
+    }
+
+    /** Elements in the ring (a snapshot) */
+    uint64_t size() const
+    {
+        return this->tail.load(std::memory_order_acquire) -
+               this->head.load(std::memory_order_acquire);
+    }
+
+    static const uint64_t CAPACITY = N;
+
+  private:
+    static const uint64_t MASK = N - 1;
+
+    /** Consumer line */
+    alignas(64) std::atomic<uint64_t> head = 0;
+    uint64_t cached_tail                   = 0;
+    /** Producer line */
+    alignas(64) std::atomic<uint64_t> tail = 0;
+    uint64_t cached_head                   = 0;
+
+    alignas(64) T buffer[N];
+};
+
+/**
+ * Ring slot of the multi producer rings
+ *
+ * sequence tells the state of the slot for the lap of an index: pos (free for the producer of
+ * pos), pos + 1 (filled, ready for the consumer of pos)
+ */
+template<typename T>
+struct ring_slot
+{
+    std::atomic<uint64_t> sequence = 0;
+    T value;
+};
+
+/**
+ * Multi producer multi consumer ring (Vyukov's bounded queue)
+ *
+ * Producers and consumers claim an index with a compare exchange and then wait for nobody, the
+ * per slot sequence tells whether the slot of a claimed index is ready
+ */
+template<typename T, uint64_t N>
+class mpmc_ring
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    mpmc_ring()
+    {
+        for (uint64_t i = 0; i < N; i++)
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mpmc_ring(const mpmc_ring &) = delete;
+    mpmc_ring &operator=(const mpmc_ring &) = delete;
+
+    /**
+     * Append an element (any producer)
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &value)
+    {
+        uint64_t pos = this->tail.load(std::memory_order_relaxed);
+        while (true) {
+            ring_slot<T> *slot = &this->slots[pos & MASK];
+            uint64_t sequence  = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff       = (int64_t)(sequence - pos);
+
+            if (diff == 0) {
+                if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot->value = value;
+                    slot->sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                /* The slot still holds the element of the previous lap */
+                return false;
+            } else {
+                pos = this->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest element (any consumer)
+     *
+     * @return false if the ring is empty
+     */
+    bool pop(T &value)
+    {
+        uint64_t pos = this->head.load(std::memory_order_relaxed);
+        while (true) {
+            ring_slot<T> *slot = &this->slots[pos & MASK];
+            uint64_t sequence  = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff       = (int64_t)(sequence - (pos + 1));
+
+            if (diff == 0) {
+                if (this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = slot->value;
+                    slot->sequence.store(pos + N, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = this->head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Nothing to pop (a snapshot) */
+    bool empty() const
+    {
+        return this->size() == 0;
+    }
+
+    /** Elements in the ring (a snapshot, claimed slots included) */
+    uint64_t size() const
+    {
+        return this->tail.load(std::memory_order_acquire) -
+               this->head.load(std::memory_order_acquire);
+    }
+
+    static const uint64_t CAPACITY = N;
+
+  private:
+    static const uint64_t MASK = N - 1;
+
+    alignas(64) std::atomic<uint64_t> head = 0;
+    alignas(64) std::atomic<uint64_t> tail = 0;
+    alignas(64) ring_slot<T> slots[N];
+};
+
+/**
+ * Multi producer single consumer ring
+ *
+ * Producers work like in mpmc_ring, the consumer owns the head and needs no compare exchange
+ */
+template<typename T, uint64_t N>
+class mpsc_ring
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+  public:
+    mpsc_ring()
+    {
+        for (uint64_t i = 0; i < N; i++)
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mpsc_ring(const mpsc_ring &) = delete;
+    mpsc_ring &operator=(const mpsc_ring &) = delete;
+
+    /**
+     * Append an element (any producer)
+     *
+     * @return false if the ring is full
+     */
+    bool push(const T &value)
+    {
+        uint64_t pos = this->tail.load(std::memory_order_relaxed);
+        while (true) {
+            ring_slot<T> *slot = &this->slots[pos & MASK];
+            uint64_t sequence  = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff       = (int64_t)(sequence - pos);
+
+            if (diff == 0) {
+                if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot->value = value;
+                    slot->sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = this->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Take the oldest element (consumer)
+     *
+     * @return false if the ring is empty or its oldest slot is claimed but not yet filled
+     */
+    bool pop(T &value)
+    {
+        uint64_t pos       = this->head.load(std::memory_order_relaxed);
+        ring_slot<T> *slot = &this->slots[pos & MASK];
+        if (slot->sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+
+        value = slot->value;
+        slot->sequence.store(pos + N, std::memory_order_release);
+        this->head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Nothing to pop (exact for the consumer, a hint for anyone else) */
+    bool empty() const
+    {
+        uint64_t pos = this->head.load(std::memory_order_relaxed);
+        return this->slots[pos & MASK].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    /** Elements in the ring (a snapshot, claimed slots included) */
+    uint64_t size() const
+    {
+        return this->tail.load(std::memory_order_acquire) -
+               this->head.load(std::memory_order_acquire);
+    }
+
+    static const uint64_t CAPACITY = N;
+
+  private:
+    static const uint64_t MASK = N - 1;
+
+    /** Only written by the consumer */
+    alignas(64) std::atomic<uint64_t> head = 0;
+    alignas(64) std::atomic<uint64_t> tail = 0;
+    alignas(64) ring_slot<T> slots[N];
+};
+
+} // namespace sync
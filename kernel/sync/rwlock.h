@@ -0,0 +1,122 @@
+/**
+ * Reader-writer spinlock
+ *
+ * Many readers or one writer. A waiting writer stops new readers from getting in (writer
+ * preference), otherwise a steady stream of readers would starve it
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "cpu/cpu.h"
+#include "lib/atomic.h"
+#include "sched/thread.h"
+#include "sync/stats.h"
+#include <stdint.h>
+
+namespace sync {
+
+class rwlock
+{
+  public:
+    constexpr rwlock(lock_stats *stats = nullptr)
+      : stats(stats)
+    {}
+    rwlock(const rwlock &) = delete;
+    rwlock &operator=(const rwlock &) = delete;
+
+    void read_lock()
+    {
+        sched::preempt_disable();
+
+        uint64_t start = 0;
+        uint32_t state = this->state.load(std::memory_order_relaxed);
+        while (true) {
+            if ((state & (WRITER | WAITING)) == 0 &&
+                this->state.compare_exchange_weak(state, state + 1, std::memory_order_acquire))
+                break;
+            if (start == 0)
+                start = cpu::rdtsc();
+            cpu::pause();
+            state = this->state.load(std::memory_order_relaxed);
+        }
+
+        if (this->stats != nullptr)
+            this->stats->record(start == 0 ? 0 : cpu::rdtsc() - start + 1);
+    }
+
+    void read_unlock()
+    {
+        this->state.fetch_sub(1, std::memory_order_release);
+        sched::preempt_enable();
+    }
+
+    void write_lock()
+    {
+        sched::preempt_disable();
+
+        uint64_t start = 0;
+        uint32_t state = this->state.load(std::memory_order_relaxed);
+        while (true) {
+            /* Free (maybe with a waiting writer, us or another one): take it and clear WAITING */
+            if ((state & ~WAITING) == 0 &&
+                this->state.compare_exchange_weak(state, WRITER, std::memory_order_acquire))
+                break;
+            if ((state & WAITING) == 0)
+                this->state.fetch_or(WAITING, std::memory_order_relaxed);
+            if (start == 0)
+                start = cpu::rdtsc();
+            cpu::pause();
+            state = this->state.load(std::memory_order_relaxed);
+        }
+
+        if (this->stats != nullptr)
+            this->stats->record(start == 0 ? 0 : cpu::rdtsc() - start + 1);
+    }
+
+    void write_unlock()
+    {
+        /* Other writers may have flagged themselves as waiting meanwhile, keep that bit */
+        this->state.fetch_and(~WRITER, std::memory_order_release);
+        sched::preempt_enable();
+    }
+
+    uint64_t read_lock_irqsave()
+    {
+        auto flags = cpu::irq_save();
+        this->read_lock();
+        return flags;
+    }
+
+    void read_unlock_irqrestore(uint64_t flags)
+    {
+        this->state.fetch_sub(1, std::memory_order_release);
+        cpu::irq_restore(flags);
+        sched::preempt_enable();
+    }
+
+    uint64_t write_lock_irqsave()
+    {
+        auto flags = cpu::irq_save();
+        this->write_lock();
+        return flags;
+    }
+
+    void write_unlock_irqrestore(uint64_t flags)
+    {
+        this->state.fetch_and(~WRITER, std::memory_order_release);
+        cpu::irq_restore(flags);
+        sched::preempt_enable();
+    }
+
+  private:
+    static const uint32_t WRITER  = 1U << 31;
+    static const uint32_t WAITING = 1U << 30;
+
+    /** WRITER | WAITING | number of readers */
+    std::atomic<uint32_t> state = 0;
+    lock_stats *stats           = nullptr;
+};
+
+} // namespace sync
@@ -0,0 +1,288 @@
+/**
+ * Spinlocks
+ *
+ * - ticket_lock: FIFO spinlock, two 16 bit counters (next ticket, ticket being served). Fair,
+ *   every waiter spins on the same line, fine for short and lightly contended sections
+ * - mcs_lock: queue lock, every waiter spins on its own node so a release only touches the cache
+ *   line of the next waiter. For hot locks shared by many CPUs
+ *
+ * Holding a spinlock disables preemption. The _irqsave variants also disable interrupts on the
+ * calling CPU, they are required for locks also taken from interrupt handlers
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "cpu/cpu.h"
+#include "lib/atomic.h"
+#include "sched/thread.h"
+#include "sync/stats.h"
+#include <stdint.h>
+
+namespace sync {
+
+/**
+ * Ticket spinlock
+ */
+class ticket_lock
+{
+  public:
+    constexpr ticket_lock(lock_stats *stats = nullptr)
+      : stats(stats)
+    {}
+
+    /**
+     * Copies are new unlocked locks with the same statistics (objects holding a lock are built by
+     * assignment during boot)
+     */
+    ticket_lock(const ticket_lock &other)
+      : stats(other.stats)
+    {}
+
+    ticket_lock &operator=(const ticket_lock &other)
+    {
+        this->next.store(0, std::memory_order_relaxed);
+        this->owner.store(0, std::memory_order_relaxed);
+        this->stats = other.stats;
+        return *this;
+    }
+
+    void lock()
+    {
+        sched::preempt_disable();
+        this->acquire();
+    }
+
+    bool try_lock()
+    {
+        sched::preempt_disable();
+        uint16_t owner = this->owner.load(std::memory_order_relaxed);
+        uint16_t next  = owner;
+        if (this->next.compare_exchange_strong(next, owner + 1, std::memory_order_acquire)) {
+            if (this->stats != nullptr)
+                this->stats->record(0);
+            return true;
+        }
+        sched::preempt_enable();
+        return false;
+    }
+
+    void unlock()
+    {
+        this->release();
+        sched::preempt_enable();
+    }
+
+    /** Lock with interrupts disabled, returns the flags for unlock_irqrestore() */
+    uint64_t lock_irqsave()
+    {
+        auto flags = cpu::irq_save();
+        this->lock();
+        return flags;
+    }
+
+    void unlock_irqrestore(uint64_t flags)
+    {
+        this->release();
+        cpu::irq_restore(flags);
+        sched::preempt_enable();
+    }
+
+    bool is_locked() const
+    {
+        return this->next.load(std::memory_order_relaxed) !=
+               this->owner.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void acquire()
+    {
+        uint16_t ticket = this->next.fetch_add(1, std::memory_order_relaxed);
+        if (this->owner.load(std::memory_order_acquire) == ticket) {
+            if (this->stats != nullptr)
+                this->stats->record(0);
+            return;
+        }
+
+        uint64_t start = cpu::rdtsc();
+        while (this->owner.load(std::memory_order_acquire) != ticket)
+            cpu::pause();
+        if (this->stats != nullptr)
+            this->stats->record(cpu::rdtsc() - start + 1);
+    }
+
+    void release()
+    {
+        /* Only the holder writes owner, no read-modify-write needed */
+        uint16_t owner = this->owner.load(std::memory_order_relaxed);
+        this->owner.store(owner + 1, std::memory_order_release);
+    }
+
+    std::atomic<uint16_t> next  = 0;
+    std::atomic<uint16_t> owner = 0;
+    lock_stats *stats           = nullptr;
+};
+
+/**
+ * Queue node of an mcs_lock waiter, provided by the caller (usually on its stack) and valid until
+ * the unlock
+ */
+struct alignas(64) mcs_node
+{
+    std::atomic<mcs_node *> next = nullptr;
+    std::atomic<bool> locked     = false;
+};
+
+/**
+ * MCS queue spinlock
+ */
+class mcs_lock
+{
+  public:
+    constexpr mcs_lock(lock_stats *stats = nullptr)
+      : stats(stats)
+    {}
+    mcs_lock(const mcs_lock &) = delete;
+    mcs_lock &operator=(const mcs_lock &) = delete;
+
+    void lock(mcs_node &node)
+    {
+        sched::preempt_disable();
+        this->acquire(node);
+    }
+
+    void unlock(mcs_node &node)
+    {
+        this->release(node);
+        sched::preempt_enable();
+    }
+
+    uint64_t lock_irqsave(mcs_node &node)
+    {
+        auto flags = cpu::irq_save();
+        this->lock(node);
+        return flags;
+    }
+
+    void unlock_irqrestore(mcs_node &node, uint64_t flags)
+    {
+        this->release(node);
+        cpu::irq_restore(flags);
+        sched::preempt_enable();
+    }
+
+  private:
+    void acquire(mcs_node &node)
+    {
+        node.next.store(nullptr, std::memory_order_relaxed);
+        node.locked.store(true, std::memory_order_relaxed);
+
+        mcs_node *prev = this->tail.exchange(&node, std::memory_order_acq_rel);
+        if (prev == nullptr) {
+            if (this->stats != nullptr)
+                this->stats->record(0);
+            return;
+        }
+
+        /* Queue behind prev and spin on our own line until it hands the lock over */
+        uint64_t start = cpu::rdtsc();
+        prev->next.store(&node, std::memory_order_release);
+        while (node.locked.load(std::memory_order_acquire))
+            cpu::pause();
+        if (this->stats != nullptr)
+            this->stats->record(cpu::rdtsc() - start + 1);
+    }
+
+    void release(mcs_node &node)
+    {
+        mcs_node *successor = node.next.load(std::memory_order_acquire);
+        if (successor == nullptr) {
+            /* No known successor, release unless somebody is enqueueing right now */
+            mcs_node *expected = &node;
+            if (this->tail.compare_exchange_strong(expected, nullptr, std::memory_order_release))
+                return;
+            while ((successor = node.next.load(std::memory_order_acquire)) == nullptr)
+                cpu::pause();
+        }
+
+        successor->locked.store(false, std::memory_order_release);
+    }
+
+    std::atomic<mcs_node *> tail = nullptr;
+    lock_stats *stats            = nullptr;
+};
+
+/**
+ * Scoped lock of any lock with lock()/unlock()
+ */
+template<typename L>
+class lock_guard
+{
+  public:
+    explicit lock_guard(L &lock)
+      : lock(lock)
+    {
+        this->lock.lock();
+    }
+    lock_guard(const lock_guard &) = delete;
+    lock_guard &operator=(const lock_guard &) = delete;
+
+    ~lock_guard()
+    {
+        this->lock.unlock();
+    }
+
+  private:
+    L &lock;
+};
+
+/**
+ * Scoped lock with interrupts disabled
+ */
+template<typename L>
+class irq_guard
+{
+  public:
+    explicit irq_guard(L &lock)
+      : lock(lock)
+      , flags(lock.lock_irqsave())
+    {}
+    irq_guard(const irq_guard &) = delete;
+    irq_guard &operator=(const irq_guard &) = delete;
+
+    ~irq_guard()
+    {
+        this->lock.unlock_irqrestore(this->flags);
+    }
+
+  private:
+    L &lock;
+    uint64_t flags;
+};
+
+/**
+ * Scoped MCS lock, the guard holds the queue node
+ */
+class mcs_guard
+{
+  public:
+    explicit mcs_guard(mcs_lock &lock)
+      : lock(lock)
+    {
+        this->lock.lock(this->node);
+    }
+    mcs_guard(const mcs_guard &) = delete;
+    mcs_guard &operator=(const mcs_guard &) = delete;
+
+    ~mcs_guard()
+    {
+        this->lock.unlock(this->node);
+    }
+
+  private:
+    mcs_lock &lock;
+    mcs_node node;
+};
+
+} // namespace sync
@@ -0,0 +1,35 @@
+/**
+ * Lock statistics
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "sync/stats.h"
+
+namespace sync {
+
+/** Every lock_stats ever constructed (they are never destroyed, they live in static storage) */
+static std::atomic<lock_stats *> stats_list = nullptr;
+
+/**
+ * Register the counters in the global list
+ */
+lock_stats::lock_stats(const char *name)
+  : name(name)
+{
+    lock_stats *head = stats_list.load(std::memory_order_relaxed);
+    do {
+        this->next = head;
+    } while (!stats_list.compare_exchange_weak(head, this, std::memory_order_release));
+}
+
+/**
+ * First registered lock_stats (follow next)
+ */
+lock_stats *
+all_stats()
+{
+    return stats_list.load(std::memory_order_acquire);
+}
+
+} // namespace sync
@@ -0,0 +1,52 @@
+/**
+ * Lock statistics
+ *
+ * Optional per lock counters (acquisitions, contended acquisitions and cycles spent spinning). A
+ * lock only pays for them when it is given a lock_stats, every lock_stats is linked in a global
+ * list so the shell can dump them
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include <stdint.h>
+
+namespace sync {
+
+/**
+ * Counters of a lock (or of a group of locks sharing the same lock_stats)
+ */
+struct lock_stats
+{
+    lock_stats(const char *);
+    lock_stats(const lock_stats &) = delete;
+    lock_stats &operator=(const lock_stats &) = delete;
+
+    const char *name;
+    std::atomic<uint64_t> acquires    = 0;
+    std::atomic<uint64_t> contended   = 0;
+    std::atomic<uint64_t> spin_cycles = 0;
+
+    /** Global list */
+    lock_stats *next = nullptr;
+
+    /**
+     * Account an acquisition
+     *
+     * @param cycles tsc cycles spent waiting (0 if the lock was free)
+     */
+    void record(uint64_t cycles)
+    {
+        this->acquires.fetch_add(1, std::memory_order_relaxed);
+        if (cycles == 0)
+            return;
+        this->contended.fetch_add(1, std::memory_order_relaxed);
+        this->spin_cycles.fetch_add(cycles, std::memory_order_relaxed);
+    }
+};
+
+lock_stats *all_stats();
+
+} // namespace sync
@@ -0,0 +1,219 @@
+/**
+ * Sleeping synchronisation
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "sync/wait.h"
+
+namespace sync {
+
+/**
+ * Append a waiter (queue lock held)
+ */
+void
+wait_queue::push(waiter *w)
+{
+    w->next = nullptr;
+    if (this->tail == nullptr)
+        this->head = w;
+    else
+        this->tail->next = w;
+    this->tail = w;
+}
+
+/**
+ * Remove the oldest waiter (queue lock held)
+ *
+ * @return the waiter or nullptr if the queue is empty
+ */
+waiter *
+wait_queue::pop()
+{
+    waiter *w = this->head;
+    if (w == nullptr)
+        return nullptr;
+
+    this->head = w->next;
+    if (this->head == nullptr)
+        this->tail = nullptr;
+    return w;
+}
+
+/**
+ * Unlink a waiter if it is still queued (queue lock held)
+ */
+void
+wait_queue::remove(waiter *w)
+{
+    waiter *prev = nullptr;
+    for (waiter *i = this->head; i != nullptr; prev = i, i = i->next) {
+        if (i != w)
+            continue;
+        if (prev == nullptr)
+            this->head = w->next;
+        else
+            prev->next = w->next;
+        if (this->tail == w)
+            this->tail = prev;
+        return;
+    }
+}
+
+/**
+ * Queue the running thread and sleep until a waker pops it (queue lock held, taken with
+ * lock_irqsave(), released here)
+ */
+void
+wait_queue::sleep(waiter *w, uint64_t flags)
+{
+    this->push(w);
+    sched::prepare_block();
+    this->lock.unlock();
+    sched::block();
+    cpu::irq_restore(flags);
+}
+
+/**
+ * Wake the oldest waiter
+ */
+void
+wait_queue::wake_one()
+{
+    auto flags = this->lock.lock_irqsave();
+    waiter *w  = this->pop();
+    /* w lives on the stack of the sleeper, it can't be touched after the wake */
+    if (w != nullptr && w->thread != nullptr)
+        sched::wake(w->thread);
+    this->lock.unlock_irqrestore(flags);
+}
+
+/**
+ * Wake every waiter
+ */
+void
+wait_queue::wake_all()
+{
+    auto flags = this->lock.lock_irqsave();
+    waiter *w;
+    while ((w = this->pop()) != nullptr) {
+        if (w->thread != nullptr)
+            sched::wake(w->thread);
+    }
+    this->lock.unlock_irqrestore(flags);
+}
+
+/**
+ * Take a unit, sleeping until there is one
+ */
+void
+semaphore::down()
+{
+    auto flags = this->queue.lock.lock_irqsave();
+    if (this->count > 0) {
+        this->count--;
+        this->queue.lock.unlock_irqrestore(flags);
+        return;
+    }
+
+    /* up() hands its unit to us instead of incrementing the count */
+    waiter self{ sched::current(), nullptr };
+    this->queue.sleep(&self, flags);
+}
+
+/**
+ * Take a unit if there is one
+ */
+bool
+semaphore::try_down()
+{
+    auto flags = this->queue.lock.lock_irqsave();
+    bool taken = this->count > 0;
+    if (taken)
+        this->count--;
+    this->queue.lock.unlock_irqrestore(flags);
+    return taken;
+}
+
+/**
+ * Release a unit (can be called from interrupt context)
+ */
+void
+semaphore::up()
+{
+    auto flags = this->queue.lock.lock_irqsave();
+    waiter *w  = this->queue.pop();
+    if (w != nullptr)
+        sched::wake(w->thread);
+    else
+        this->count++;
+    this->queue.lock.unlock_irqrestore(flags);
+}
+
+/**
+ * Take the mutex, sleeping while another thread holds it
+ */
+void
+mutex::lock()
+{
+    uint64_t self     = (uint64_t)sched::current();
+    uint64_t expected = 0;
+    if (this->owner.compare_exchange_strong(expected, self, std::memory_order_acquire))
+        return;
+
+    /* Flag the owner so its unlock() looks at the queue, unless the mutex got free meanwhile */
+    auto flags   = this->queue.lock.lock_irqsave();
+    uint64_t cur = this->owner.load(std::memory_order_relaxed);
+    while (true) {
+        if (cur == 0) {
+            if (this->owner.compare_exchange_weak(cur, self, std::memory_order_acquire)) {
+                this->queue.lock.unlock_irqrestore(flags);
+                return;
+            }
+            continue;
+        }
+        if ((cur & WAITERS) != 0 ||
+            this->owner.compare_exchange_weak(cur, cur | WAITERS, std::memory_order_relaxed))
+            break;
+    }
+
+    /* unlock() makes us the owner before waking us */
+    waiter node{ sched::current(), nullptr };
+    this->queue.sleep(&node, flags);
+}
+
+/**
+ * Take the mutex if it is free
+ */
+bool
+mutex::try_lock()
+{
+    uint64_t expected = 0;
+    return this->owner.compare_exchange_strong(
+      expected, (uint64_t)sched::current(), std::memory_order_acquire);
+}
+
+/**
+ * Release the mutex, ownership goes to the oldest waiter
+ */
+void
+mutex::unlock()
+{
+    uint64_t self = (uint64_t)sched::current();
+    if (this->owner.compare_exchange_strong(self, 0, std::memory_order_release))
+        return;
+
+    /* WAITERS is set and only changes with the queue lock held */
+    auto flags = this->queue.lock.lock_irqsave();
+    waiter *w  = this->queue.pop();
+    if (w != nullptr) {
+        uint64_t more = this->queue.head != nullptr ? WAITERS : 0;
+        this->owner.store((uint64_t)w->thread | more, std::memory_order_release);
+        sched::wake(w->thread);
+    } else {
+        this->owner.store(0, std::memory_order_release);
+    }
+    this->queue.lock.unlock_irqrestore(flags);
+}
+
+} // namespace sync
@@ -0,0 +1,145 @@
+/**
+ * Sleeping synchronisation
+ *
+ * - wait_queue: threads sleep until a condition becomes true, wakers call wake_one()/wake_all()
+ *   after changing it
+ * - semaphore: counting semaphore
+ * - mutex: sleeping lock with an owner. Uncontended lock and unlock are a single compare exchange
+ *
+ * Semaphores and mutexes hand the unit/ownership directly to the thread they wake, so a thread
+ * that keeps retaking the lock can't starve the sleepers. They can only be used from threads,
+ * wait_queue::wait() also works before the scheduler starts and from idle threads (they halt
+ * until the next interrupt instead of sleeping)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "cpu/cpu.h"
+#include "lib/atomic.h"
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+#include <stdint.h>
+
+namespace sync {
+
+/**
+ * Sleeping thread, lives on its stack while it waits
+ */
+struct waiter
+{
+    sched::thread *thread = nullptr;
+    waiter *next          = nullptr;
+};
+
+/**
+ * FIFO of sleeping threads
+ *
+ * Wakers may run in interrupt context, the internal lock always disables interrupts
+ */
+class wait_queue
+{
+  public:
+    wait_queue() = default;
+    wait_queue(const wait_queue &) = delete;
+    wait_queue &operator=(const wait_queue &) = delete;
+
+    /**
+     * Sleep until condition() is true
+     *
+     * The condition is evaluated with the queue lock held, so a waker that changes it and then
+     * calls wake_*() can't be missed
+     */
+    template<typename F>
+    void wait(F condition)
+    {
+        while (true) {
+            auto flags = this->lock.lock_irqsave();
+            if (condition()) {
+                this->lock.unlock_irqrestore(flags);
+                return;
+            }
+
+            waiter self{ sched::current(), nullptr };
+            this->push(&self);
+            sched::prepare_block();
+            /* Interrupts stay disabled until we are asleep */
+            this->lock.unlock();
+            sched::block();
+
+            /* Idle threads return from block() without being woken, still queued */
+            this->lock.lock();
+            this->remove(&self);
+            this->lock.unlock_irqrestore(flags);
+        }
+    }
+
+    void wake_one();
+    void wake_all();
+
+  private:
+    friend class semaphore;
+    friend class mutex;
+
+    void push(waiter *);
+    waiter *pop();
+    void remove(waiter *);
+    void sleep(waiter *, uint64_t);
+
+    ticket_lock lock;
+    waiter *head = nullptr;
+    waiter *tail = nullptr;
+};
+
+/**
+ * Counting semaphore
+ */
+class semaphore
+{
+  public:
+    semaphore(int64_t count = 0)
+      : count(count)
+    {}
+    semaphore(const semaphore &) = delete;
+    semaphore &operator=(const semaphore &) = delete;
+
+    void down();
+    bool try_down();
+    void up();
+
+  private:
+    wait_queue queue;
+    int64_t count;
+};
+
+/**
+ * Sleeping mutual exclusion lock
+ */
+class mutex
+{
+  public:
+    mutex() = default;
+    mutex(const mutex &) = delete;
+    mutex &operator=(const mutex &) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+    /** Holder (nullptr if free) */
+    sched::thread *get_owner() const
+    {
+        return (sched::thread *)(this->owner.load(std::memory_order_relaxed) & ~WAITERS);
+    }
+
+  private:
+    /** Owner flag: there are threads in the queue, unlock has to go through the slow path */
+    static const uint64_t WAITERS = 1;
+
+    /** Owner thread | WAITERS (0 if free) */
+    std::atomic<uint64_t> owner = 0;
+    wait_queue queue;
+};
+
+} // namespace sync
@@ -0,0 +1,80 @@
+/**
+ * Clocksource (monotonic nanosecond clock)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "time/clock.h"
+#include "cpu/cpu.h"
+#include "lib/math.h"
+
+namespace time {
+
+/**
+ * Calibrate the TSC against the HPET
+ *
+ * Counts TSC cycles during a fixed HPET window and derives the frequency. From then on now() only
+ * needs a rdtsc and a multiplication
+ *
+ * @return false if there is no HPET to calibrate against
+ */
+bool
+clocksource::calibrate(hpet &reference)
+{
+    if (!reference.present())
+        return false;
+
+    this->invariant = cpu::has_invariant_tsc();
+
+    uint64_t hpet_start = reference.ns();
+    uint64_t tsc_start  = cpu::rdtsc();
+    reference.spin(clocksource::CALIBRATION_NS);
+    uint64_t tsc_end  = cpu::rdtsc();
+    uint64_t hpet_end = reference.ns();
+
+    this->frequency = muldiv(tsc_end - tsc_start, NS_PER_SEC, hpet_end - hpet_start);
+    this->mult      = muldiv(NS_PER_SEC, 1UL << clocksource::SHIFT, this->frequency);
+
+    /* Time 0 is the end of the calibration */
+    this->tsc_base = tsc_end;
+
+    return true;
+}
+
+/**
+ * Nanoseconds since the clocksource was calibrated
+ */
+uint64_t
+clocksource::now()
+{
+    return this->cycles_to_ns(cpu::rdtsc() - this->tsc_base);
+}
+
+/**
+ * Convert TSC cycles to nanoseconds
+ */
+uint64_t
+clocksource::cycles_to_ns(uint64_t cycles)
+{
+    return mulshift(cycles, this->mult, clocksource::SHIFT);
+}
+
+/**
+ * Convert nanoseconds to TSC cycles
+ */
+uint64_t
+clocksource::ns_to_cycles(uint64_t ns)
+{
+    return muldiv(ns, this->frequency, NS_PER_SEC);
+}
+
+/**
+ * Convert a now() timestamp to an absolute TSC value (for TSC-deadline)
+ */
+uint64_t
+clocksource::ns_to_tsc(uint64_t ns)
+{
+    return this->tsc_base + this->ns_to_cycles(ns);
+}
+
+} // namespace time
@@ -0,0 +1,68 @@
+/**
+ * Clocksource (monotonic nanosecond clock)
+ *
+ * Reads the TSC and converts it to nanoseconds with a fixed point multiplier, the TSC frequency is
+ * calibrated once against the HPET at boot
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "time/hpet.h"
+#include <stdint.h>
+
+namespace time {
+
+/** Nanoseconds in a second */
+const uint64_t NS_PER_SEC = 1000000000;
+/** Nanoseconds in a millisecond */
+const uint64_t NS_PER_MS = 1000000;
+
+/**
+ * TSC based clocksource
+ */
+class clocksource
+{
+  public:
+    clocksource() = default;
+    bool calibrate(hpet &);
+    uint64_t now();
+    uint64_t cycles_to_ns(uint64_t);
+    uint64_t ns_to_cycles(uint64_t);
+    uint64_t ns_to_tsc(uint64_t);
+
+    /** Gets the TSC frequency in Hz */
+    uint64_t get_frequency() const
+    {
+        return this->frequency;
+    }
+
+    /** TSC keeps a constant rate across P/C states */
+    bool is_invariant() const
+    {
+        return this->invariant;
+    }
+
+    /** The TSC frequency is known */
+    bool is_calibrated() const
+    {
+        return this->frequency != 0;
+    }
+
+  private:
+    /** TSC value at time 0 */
+    uint64_t tsc_base = 0;
+    /** TSC frequency in Hz */
+    uint64_t frequency = 0;
+    /** cycles to ns fixed point multiplier (ns = cycles * mult >> SHIFT) */
+    uint64_t mult = 0;
+    /** TSC is invariant */
+    bool invariant = false;
+
+    static const uint8_t SHIFT = 32;
+    /** Calibration window */
+    static const uint64_t CALIBRATION_NS = 20 * NS_PER_MS;
+};
+
+} // namespace time
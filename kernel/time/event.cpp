@@ -0,0 +1,130 @@
+/**
+ * Clock events (programmable timer interrupts)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "time/event.h"
+#include "cpu/cpu.h"
+#include "lib/math.h"
+
+namespace time {
+
+DEFINE_PERCPU(uint64_t, timer_events) = 0;
+
+/**
+ * Calibrate the LAPIC timer against the clocksource
+ *
+ * Lets the timer count down from its maximum during a fixed window and derives the frequency.
+ * Also detects TSC-deadline support
+ *
+ * @param lapic local APIC of the calibrating CPU
+ * @param clock calibrated clocksource
+ * @param vector interrupt vector raised by the timer
+ */
+void
+clockevent::calibrate(apic::lapic *lapic, clocksource *clock, uint8_t vector)
+{
+    this->lapic        = lapic;
+    this->clock        = clock;
+    this->vector       = vector;
+    this->tsc_deadline = cpu::has_tsc_deadline() && clock->is_invariant();
+
+    /* Count down masked, we only want the elapsed ticks */
+    this->lapic->timer(apic::timer_e::oneshot, vector);
+    this->lapic->write(apic::reg_e::lvt_timer, apic::LVT_MASKED | vector);
+    this->lapic->timer_count(0xffffffff);
+
+    uint64_t start = clock->now();
+    while (clock->now() - start < clockevent::CALIBRATION_NS) {
+        cpu::pause();
+    }
+    uint32_t elapsed = 0xffffffff - this->lapic->timer_current();
+    uint64_t window  = clock->now() - start;
+
+    this->lapic->timer_mask();
+
+    this->frequency = muldiv(elapsed, NS_PER_SEC, window);
+}
+
+/**
+ * Convert nanoseconds to LAPIC timer ticks (clamped to the 32 bit counter)
+ */
+uint32_t
+clockevent::ns_to_count(uint64_t ns)
+{
+    uint64_t count = muldiv(ns, this->frequency, NS_PER_SEC);
+    if (count == 0)
+        return 1;
+    if (count > 0xffffffff)
+        return 0xffffffff;
+    return count;
+}
+
+/**
+ * Raise a single interrupt after ns nanoseconds
+ */
+void
+clockevent::oneshot(uint64_t ns)
+{
+    this->lapic->timer(apic::timer_e::oneshot, this->vector);
+    this->lapic->timer_count(this->ns_to_count(ns));
+}
+
+/**
+ * Raise an interrupt every ns nanoseconds
+ */
+void
+clockevent::periodic(uint64_t ns)
+{
+    this->lapic->timer(apic::timer_e::periodic, this->vector);
+    this->lapic->timer_count(this->ns_to_count(ns));
+}
+
+/**
+ * Raise a single interrupt at an absolute clocksource time
+ *
+ * Uses TSC-deadline mode when available (no conversion drift, no 32 bit limit), otherwise falls
+ * back to a one-shot relative to now()
+ */
+void
+clockevent::deadline(uint64_t when)
+{
+    if (this->tsc_deadline) {
+        this->lapic->timer(apic::timer_e::deadline, this->vector);
+        /* Order the LVT write before the MSR write (Intel SDM 10.5.4.1) */
+        asm volatile("mfence" : : : "memory");
+        cpu::wrmsr(cpu::MSR_TSC_DEADLINE, this->clock->ns_to_tsc(when));
+        return;
+    }
+
+    uint64_t now = this->clock->now();
+    this->oneshot(when > now ? when - now : 0);
+}
+
+/**
+ * Disarm the timer
+ */
+void
+clockevent::stop()
+{
+    if (this->tsc_deadline)
+        cpu::wrmsr(cpu::MSR_TSC_DEADLINE, 0);
+    this->lapic->timer_mask();
+}
+
+/**
+ * Timer interrupt entry point
+ *
+ * Acknowledges the LAPIC and runs the registered handler
+ */
+void
+clockevent::handle()
+{
+    percpu::add(timer_events, 1UL);
+    this->lapic->eoi();
+    if (this->handler != nullptr)
+        this->handler();
+}
+
+} // namespace time
@@ -0,0 +1,71 @@
+/**
+ * Clock events (programmable timer interrupts)
+ *
+ * Drives the LAPIC timer in one-shot, periodic or TSC-deadline mode. The timer frequency is
+ * calibrated against the clocksource
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "apic/lapic.h"
+#include "percpu/percpu.h"
+#include "time/clock.h"
+#include <stdint.h>
+
+namespace time {
+
+/** Timer interrupts handled by each CPU */
+DECLARE_PERCPU(uint64_t, timer_events);
+
+/**
+ * LAPIC timer clock event device
+ */
+class clockevent
+{
+  public:
+    clockevent() = default;
+    void calibrate(apic::lapic *, clocksource *, uint8_t);
+    void oneshot(uint64_t);
+    void periodic(uint64_t);
+    void deadline(uint64_t);
+    void stop();
+    void handle();
+
+    /** Set the function called on each expiration (interrupt context) */
+    void set_handler(void (*handler)())
+    {
+        this->handler = handler;
+    }
+
+    /** Gets the LAPIC timer frequency (after the divider) in Hz */
+    uint64_t get_frequency() const
+    {
+        return this->frequency;
+    }
+
+    /** Timer can be armed with an absolute TSC value */
+    bool has_deadline() const
+    {
+        return this->tsc_deadline;
+    }
+
+  private:
+    uint32_t ns_to_count(uint64_t);
+
+    apic::lapic *lapic = nullptr;
+    clocksource *clock = nullptr;
+    void (*handler)()  = nullptr;
+    /** LAPIC timer frequency in Hz */
+    uint64_t frequency = 0;
+    /** Interrupt vector raised by the timer */
+    uint8_t vector = 0;
+    /** TSC-deadline mode available */
+    bool tsc_deadline = false;
+
+    /** Calibration window */
+    static const uint64_t CALIBRATION_NS = 10 * NS_PER_MS;
+};
+
+} // namespace time
@@ -0,0 +1,75 @@
+/**
+ * High Precision Event Timer (HPET)
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "time/hpet.h"
+#include "lib/math.h"
+
+namespace time {
+
+/** Femtoseconds in a nanosecond */
+const uint64_t FS_PER_NS = 1000000;
+
+/**
+ * Construct the HPET from its ACPI table and start the main counter
+ *
+ * The register block is below 4GiB (identity mapped by the bootloader)
+ */
+hpet::hpet(acpi::sdt *table)
+{
+    if (table == nullptr || !table->check_signature(HPET_SIGN))
+        return;
+
+    auto *hdr = (hpet_table *)table;
+
+    /* Only memory mapped HPETs are supported */
+    if (hdr->base.address_space != 0)
+        return;
+
+    this->base = hdr->base.address;
+
+    /* Counter period lives in the upper 32 bits of the capabilities register */
+    this->period = this->read(hpet_reg_e::capabilities) >> 32;
+
+    /* Start the main counter without legacy replacement routing */
+    uint64_t config = this->read(hpet_reg_e::config);
+    config &= ~HPET_LEGACY;
+    this->write(hpet_reg_e::config, config | HPET_ENABLE);
+}
+
+/**
+ * Read the main counter
+ */
+uint64_t
+hpet::counter()
+{
+    return this->read(hpet_reg_e::counter);
+}
+
+/**
+ * Main counter in nanoseconds
+ */
+uint64_t
+hpet::ns()
+{
+    return muldiv(this->counter(), this->period, FS_PER_NS);
+}
+
+/**
+ * Busy wait for a number of nanoseconds
+ *
+ * Only meant for calibration, everything else should use the clock events
+ */
+void
+hpet::spin(uint64_t ns)
+{
+    uint64_t ticks = muldiv(ns, FS_PER_NS, this->period);
+    uint64_t start = this->counter();
+    while (this->counter() - start < ticks) {
+        asm volatile("pause");
+    }
+}
+
+} // namespace time
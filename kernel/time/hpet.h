@@ -0,0 +1,104 @@
+/**
+ * High Precision Event Timer (HPET)
+ *
+ * Only the main counter is used, as a stable reference to calibrate the TSC and the LAPIC timer
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "acpi/acpi.h"
+#include <stdint.h>
+
+namespace time {
+
+/** HPET table signature */
+const char HPET_SIGN[] = { 'H', 'P', 'E', 'T' };
+
+/**
+ * ACPI Generic Address Structure
+ */
+struct generic_address
+{
+    /** 0 = system memory, 1 = system I/O */
+    uint8_t address_space;
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __attribute__((packed));
+
+/**
+ * HPET ACPI table
+ */
+struct hpet_table
+{
+    acpi::sdt header;
+    /** hardware revision, comparators, counter size, vendor */
+    uint32_t event_timer_block;
+    /** register block location */
+    generic_address base;
+    uint8_t hpet_number;
+    /** minimum clock ticks in periodic mode without losing interrupts */
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed));
+
+/**
+ * HPET register offsets
+ */
+enum class hpet_reg_e
+{
+    capabilities = 0x0,
+    config       = 0x10,
+    counter      = 0xf0,
+};
+
+/** General configuration: counter enable */
+const uint64_t HPET_ENABLE = 1 << 0;
+/** General configuration: legacy replacement route */
+const uint64_t HPET_LEGACY = 1 << 1;
+
+/**
+ * HPET device
+ */
+class hpet
+{
+  public:
+    hpet() = default;
+    hpet(acpi::sdt *);
+    uint64_t counter();
+    uint64_t ns();
+    void spin(uint64_t);
+
+    /** The HPET was found in the ACPI tables */
+    bool present() const
+    {
+        return this->base != 0;
+    }
+
+    /** Gets the counter period in femtoseconds */
+    uint64_t get_period() const
+    {
+        return this->period;
+    }
+
+  private:
+    /** MMIO base address */
+    uint64_t base = 0;
+    /** Counter tick period in femtoseconds */
+    uint64_t period = 0;
+
+    uint64_t read(hpet_reg_e reg)
+    {
+        return *(volatile uint64_t *)(this->base + static_cast<uint64_t>(reg));
+    }
+
+    void write(hpet_reg_e reg, uint64_t value)
+    {
+        *(volatile uint64_t *)(this->base + static_cast<uint64_t>(reg)) = value;
+    }
+};
+
+} // namespace time
@@ -0,0 +1,323 @@
+/**
+ * Hierarchical timing wheel
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "time/wheel.h"
+#include "cpu/cpu.h"
+#include "kernel.h"
+
+namespace time {
+
+/** Timers of each CPU */
+DEFINE_PERCPU(wheel, local_wheel);
+
+/**
+ * Rotate a slot bitmap so that bit 0 corresponds to slot start
+ */
+static uint64_t
+rotate(uint64_t bitmap, uint64_t start)
+{
+    start &= 63;
+    if (start == 0)
+        return bitmap;
+    return (bitmap >> start) | (bitmap << (64 - start));
+}
+
+/**
+ * Attach the wheel to the CPU clocksource and clock event device
+ */
+void
+wheel::start(clocksource *clock, clockevent *event)
+{
+    this->clock   = clock;
+    this->event   = event;
+    this->current = clock->now() / TICK_NS;
+}
+
+/**
+ * Arm a timer
+ *
+ * The expiration is rounded up to the wheel resolution (timers never fire early). With slack the
+ * timer may fire up to slack ns later: the tick with most trailing zeros inside the window is
+ * picked, so timers with nearby deadlines land in the same slot and share an interrupt
+ *
+ * @param t timer to arm (re-armed if already pending)
+ * @param expires absolute clocksource time in ns
+ * @param slack tolerated delay in ns
+ * @return false if the timer is pending on the wheel of another CPU (left as it is)
+ */
+bool
+wheel::add(timer *t, uint64_t expires, uint64_t slack)
+{
+    auto flags = cpu::irq_save();
+
+    if (t->pending() && t->base != this) {
+        cpu::irq_restore(flags);
+        return false;
+    }
+
+    if (t->pending()) {
+        this->unlink(t);
+        this->pending--;
+    }
+
+    uint64_t tick  = (expires + TICK_NS - 1) / TICK_NS;
+    uint64_t limit = (expires + slack) / TICK_NS;
+
+    if (limit > tick) {
+        /* Highest bit where both differ, round down the limit to it */
+        uint64_t bit = 63 - __builtin_clzll(tick ^ limit);
+        tick         = limit & ~((1UL << bit) - 1);
+    }
+
+    t->expires = tick;
+    t->base    = this;
+    this->enqueue(t);
+    this->pending++;
+
+    /* Tickless: the hardware only needs to be touched if this timer comes first */
+    if (tick < this->programmed)
+        this->program();
+
+    cpu::irq_restore(flags);
+    return true;
+}
+
+/**
+ * Disarm a timer
+ *
+ * The hardware timer is not reprogrammed, at worst it fires once for nothing
+ *
+ * @return true if the timer was pending (on this wheel, one pending on another CPU is left as it is)
+ */
+bool
+wheel::cancel(timer *t)
+{
+    auto flags = cpu::irq_save();
+
+    bool was_pending = t->pending() && t->base == this;
+    if (was_pending) {
+        this->unlink(t);
+        this->pending--;
+    }
+
+    cpu::irq_restore(flags);
+    return was_pending;
+}
+
+/**
+ * Process every tick up to now (clock event handler)
+ *
+ * Jumps straight to the ticks where something happens, so long idle periods cost nothing
+ */
+void
+wheel::run()
+{
+    auto flags = cpu::irq_save();
+
+    /* The programmed event has fired */
+    this->programmed = wheel::NONE;
+
+    uint64_t now = this->clock->now() / TICK_NS;
+    while (this->current <= now) {
+        uint64_t next = this->next_event();
+        if (next > now) {
+            this->current = now + 1;
+            break;
+        }
+        this->current = next;
+
+        /* Cascade every level whose slot starts at this tick */
+        for (uint8_t level = 1; level < wheel::LEVELS; level++) {
+            uint8_t shift = level * wheel::LEVEL_BITS;
+            if ((this->current & ((1UL << shift) - 1)) != 0)
+                break;
+            this->cascade(level, (this->current >> shift) & wheel::MASK);
+        }
+
+        this->expire(this->current);
+        this->current++;
+    }
+
+    this->program();
+
+    cpu::irq_restore(flags);
+}
+
+/**
+ * Insert a timer in the slot covering its expiration
+ */
+void
+wheel::enqueue(timer *t)
+{
+    /* Already expired timers run on the next processed tick */
+    uint64_t expires = (t->expires < this->current) ? this->current : t->expires;
+    uint64_t delta   = expires - this->current;
+
+    uint8_t level = 0;
+    if (delta >= wheel::SLOTS) {
+        level = (63 - __builtin_clzll(delta)) / wheel::LEVEL_BITS;
+        /* Out of range: park it in the farthest slot, it will be re-cascaded */
+        if (level >= wheel::LEVELS) {
+            level   = wheel::LEVELS - 1;
+            expires = this->current + (1UL << (wheel::LEVELS * wheel::LEVEL_BITS)) - 1;
+        }
+    }
+
+    uint64_t slot = (expires >> (level * wheel::LEVEL_BITS)) & wheel::MASK;
+    timer **head  = &this->slots[level][slot];
+
+    t->next = *head;
+    if (t->next != nullptr)
+        t->next->pprev = &t->next;
+    *head    = t;
+    t->pprev = head;
+
+    this->occupied[level] |= (1UL << slot);
+}
+
+/**
+ * Remove a timer from its list
+ *
+ * If it was the last timer of a wheel slot, the slot is marked as empty
+ */
+void
+wheel::unlink(timer *t)
+{
+    timer **pprev = t->pprev;
+
+    *pprev = t->next;
+    if (t->next != nullptr)
+        t->next->pprev = pprev;
+
+    t->next  = nullptr;
+    t->pprev = nullptr;
+
+    /* pprev points to a slot head: update the bitmap */
+    timer **first = &this->slots[0][0];
+    if (pprev >= first && pprev < first + wheel::LEVELS * wheel::SLOTS && *pprev == nullptr) {
+        uint64_t index = pprev - first;
+        this->occupied[index / wheel::SLOTS] &= ~(1UL << (index % wheel::SLOTS));
+    }
+}
+
+/**
+ * Re-add the timers of a slot, they fall into lower levels
+ */
+void
+wheel::cascade(uint8_t level, uint64_t slot)
+{
+    timer *t = this->slots[level][slot];
+
+    this->slots[level][slot] = nullptr;
+    this->occupied[level] &= ~(1UL << slot);
+
+    while (t != nullptr) {
+        timer *next = t->next;
+        this->enqueue(t);
+        t = next;
+    }
+}
+
+/**
+ * Run the timers of a level 0 slot
+ *
+ * The slot is detached first, so callbacks can re-arm (even in the past) or cancel timers safely
+ */
+void
+wheel::expire(uint64_t tick)
+{
+    uint64_t slot = tick & wheel::MASK;
+    timer *list   = this->slots[0][slot];
+
+    this->slots[0][slot] = nullptr;
+    this->occupied[0] &= ~(1UL << slot);
+
+    if (list != nullptr)
+        list->pprev = &list;
+
+    while (list != nullptr) {
+        timer *t = list;
+        this->unlink(t);
+        this->pending--;
+        this->expired++;
+        t->callback(t);
+    }
+}
+
+/**
+ * Next tick where a timer expires or a slot must be cascaded
+ *
+ * @return tick or NONE if the wheel is empty
+ */
+uint64_t
+wheel::next_event()
+{
+    if (this->pending == 0)
+        return wheel::NONE;
+
+    uint64_t next = wheel::NONE;
+
+    /* Level 0 slots map 1:1 to the next SLOTS ticks */
+    if (this->occupied[0] != 0)
+        next = this->current + __builtin_ctzll(rotate(this->occupied[0], this->current));
+
+    /* Higher levels are processed at the start of their slots */
+    for (uint8_t level = 1; level < wheel::LEVELS; level++) {
+        if (this->occupied[level] == 0)
+            continue;
+
+        uint8_t shift  = level * wheel::LEVEL_BITS;
+        uint64_t start = (this->current + (1UL << shift) - 1) >> shift;
+        uint64_t when  = (start + __builtin_ctzll(rotate(this->occupied[level], start))) << shift;
+
+        if (when < next)
+            next = when;
+    }
+
+    return next;
+}
+
+/**
+ * Program the clock event for the next event (or stop it)
+ */
+void
+wheel::program()
+{
+    if (this->event == nullptr)
+        return;
+
+    uint64_t next = this->next_event();
+    if (next == this->programmed)
+        return;
+
+    this->programmed = next;
+    this->reprograms++;
+
+    if (next == wheel::NONE)
+        this->event->stop();
+    else
+        this->event->deadline(next * TICK_NS);
+}
+
+/**
+ * Wheel of the running CPU
+ */
+wheel &
+local()
+{
+    return *percpu::ptr(local_wheel);
+}
+
+/**
+ * Clock event handler
+ */
+void
+tick()
+{
+    local().run();
+}
+
+} // namespace time
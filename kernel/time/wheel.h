@@ -0,0 +1,148 @@
+/**
+ * Hierarchical timing wheel
+ *
+ * Kernel timers (retransmissions, timeouts, watchdogs...) are kept in a hierarchy of circular
+ * arrays of intrusive lists. Adding and cancelling a timer are O(1), and the cost of running the
+ * wheel depends on the expired timers, not on the pending ones.
+ *
+ * Level n has SLOTS slots of SLOTS^n ticks each. Timers are placed in the lowest level that covers
+ * their distance to the current tick, and are cascaded (re-added) to a lower level when the wheel
+ * reaches the start of their slot.
+ *
+ * The wheel is tickless: the hardware timer is only programmed for the next tick where something
+ * happens (an expiration or a cascade), idle periods don't generate interrupts.
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "time/clock.h"
+#include "time/event.h"
+#include <stdint.h>
+
+namespace time {
+
+/** Wheel resolution */
+const uint64_t TICK_NS = NS_PER_MS;
+
+class wheel;
+
+/**
+ * Kernel timer
+ *
+ * Embedded in the structure that owns it, the wheel never allocates
+ */
+struct timer
+{
+    timer() = default;
+    timer(void (*callback)(timer *), void *data = nullptr)
+      : callback(callback)
+      , data(data){};
+
+    /** Function called on expiration (interrupt context) */
+    void (*callback)(timer *) = nullptr;
+    /** Owner data for the callback */
+    void *data = nullptr;
+
+    /** The timer is armed */
+    bool pending() const
+    {
+        return this->pprev != nullptr;
+    }
+
+  private:
+    friend class wheel;
+
+    /** Intrusive list */
+    timer *next   = nullptr;
+    timer **pprev = nullptr;
+    /** Expiration tick */
+    uint64_t expires = 0;
+    /** Wheel where the timer is armed */
+    wheel *base = nullptr;
+};
+
+/**
+ * Timing wheel (one per CPU)
+ *
+ * @warning operations on a wheel must run on the CPU that owns it, interrupts are disabled
+ * internally to protect against the timer interrupt. A timer pending on the wheel of another CPU
+ * can't be re-armed or cancelled (its lists aren't ours to touch), add() and cancel() leave it as
+ * it is
+ */
+class wheel
+{
+  public:
+    wheel() = default;
+    void start(clocksource *, clockevent *);
+    bool add(timer *, uint64_t, uint64_t slack = 0);
+    bool cancel(timer *);
+    void run();
+
+    /** Gets the number of armed timers */
+    uint64_t get_pending() const
+    {
+        return this->pending;
+    }
+
+    /** Gets the number of expired timers */
+    uint64_t get_expired() const
+    {
+        return this->expired;
+    }
+
+    /** Gets the number of times the hardware timer was programmed */
+    uint64_t get_programmed() const
+    {
+        return this->reprograms;
+    }
+
+    /** The wheel is attached to a clock event device (timers fire) */
+    bool is_started() const
+    {
+        return this->event != nullptr;
+    }
+
+    /** Gets the next tick the hardware is programmed for (NONE if stopped) */
+    uint64_t get_next() const
+    {
+        return this->programmed;
+    }
+
+    static const uint64_t NONE = ~0UL;
+
+  private:
+    static const uint8_t LEVEL_BITS = 6;
+    static const uint8_t LEVELS     = 5;
+    static const uint64_t SLOTS     = 1 << LEVEL_BITS;
+    static const uint64_t MASK      = SLOTS - 1;
+
+    void enqueue(timer *);
+    void unlink(timer *);
+    void cascade(uint8_t, uint64_t);
+    void expire(uint64_t);
+    void program();
+    uint64_t next_event();
+
+    /** Slot list heads */
+    timer *slots[LEVELS][SLOTS] = {};
+    /** Non-empty slots bitmap per level */
+    uint64_t occupied[LEVELS] = {};
+    /** Next tick to process (every timer before it already ran) */
+    uint64_t current = 0;
+    /** Tick the hardware timer is armed for */
+    uint64_t programmed = NONE;
+
+    uint64_t pending    = 0;
+    uint64_t expired    = 0;
+    uint64_t reprograms = 0;
+
+    clocksource *clock = nullptr;
+    clockevent *event  = nullptr;
+};
+
+wheel &local();
+void tick();
+
+} // namespace time
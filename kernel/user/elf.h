@@ -0,0 +1,83 @@
+/**
+ * ELF64 executables
+ *
+ * Only what the process loader needs: the file header and the program headers of statically
+ * linked x86-64 executables
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace user {
+
+namespace elf {
+
+/** e_ident: 0x7f 'E' 'L' 'F' */
+const uint32_t MAGIC = 0x464c457f;
+/** e_ident[EI_CLASS]: 64 bit objects */
+const uint8_t CLASS_64 = 2;
+/** e_ident[EI_DATA]: little endian */
+const uint8_t DATA_LSB = 1;
+/** e_type: executable file */
+const uint16_t TYPE_EXEC = 2;
+/** e_machine: x86-64 */
+const uint16_t MACHINE_X86_64 = 0x3e;
+/** p_type: loadable segment */
+const uint32_t PT_LOAD = 1;
+
+/**
+ * File header (Elf64_Ehdr)
+ */
+struct header
+{
+    uint32_t magic;
+    uint8_t file_class;
+    uint8_t data;
+    uint8_t version;
+    uint8_t abi;
+    uint8_t abi_version;
+    uint8_t padding[7];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t file_version;
+    /** Entry point */
+    uint64_t entry;
+    /** File offset of the program headers */
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    /** Size of every program header */
+    uint16_t phentsize;
+    /** Number of program headers */
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed));
+
+/**
+ * Program header (Elf64_Phdr)
+ */
+struct program_header
+{
+    uint32_t type;
+    uint32_t flags;
+    /** File offset of the segment */
+    uint64_t offset;
+    /** Address of the segment in memory */
+    uint64_t vaddr;
+    uint64_t paddr;
+    /** Bytes in the file */
+    uint64_t filesz;
+    /** Bytes in memory (the rest is zeroed, .bss) */
+    uint64_t memsz;
+    uint64_t align;
+} __attribute__((packed));
+
+} // namespace elf
+
+} // namespace user
@@ -0,0 +1,146 @@
+;;
+; Ring 3 entry and exit
+;
+; @author Ernesto Martínez García <me@ecomaikgolf.com>
+;
+
+; tell nasm we need 64 bit instructions
+[bits 64]
+
+USER_CS equ 0x2b
+USER_DS equ 0x23
+; interrupts enabled (bit 1 is always set)
+USER_RFLAGS equ 0x202
+
+section .text
+
+;
+; SYSCALL target (LSTAR)
+;
+; The CPU only loaded cs/ss, saved rip in rcx and rflags in r11 and masked rflags with SFMASK
+; (interrupts disabled): the stack is still the user one and gs still has the user base
+;
+; Returning with SYSRET to a non canonical rcx faults in ring 0 on the user stack. The only way
+; to get one is a syscall instruction ending at the top of the lower half, user::USER_END keeps
+; that page out of processes
+;
+syscall_entry:
+	swapgs
+	mov [gs:user_stack], rsp
+	mov rsp, [gs:syscall_stack]
+	push qword [gs:user_stack] ; saved before anything can switch threads
+	push r11
+	push rcx
+	push rdi
+	push rsi
+	push rdx
+	push r10
+	push r8
+	push r9
+	sub rsp, 8 ; 16 byte aligned at the call
+	sti
+	call dispatch
+	cli
+	add rsp, 8
+	pop r9
+	pop r8
+	pop r10
+	pop rdx
+	pop rsi
+	pop rdi
+	pop rcx
+	pop r11
+	pop rsp
+	swapgs
+	o64 sysret
+
+;
+; int 0x80 gate (DPL 3, interrupts disabled on entry), same registers as SYSCALL
+;
+; rcx and r11 are preserved on this path
+;
+syscall_int80:
+	test byte [rsp + 8], 3
+	jz .kernel
+	swapgs
+.kernel:
+	cld
+	push rdi
+	push rsi
+	push rdx
+	push r10
+	push r8
+	push r9
+	push rcx
+	push r11
+	sub rsp, 8
+	sti
+	call dispatch
+	cli
+	add rsp, 8
+	pop r11
+	pop rcx
+	pop r9
+	pop r8
+	pop r10
+	pop rdx
+	pop rsi
+	pop rdi
+	test byte [rsp + 8], 3
+	jz .return
+	swapgs
+.return:
+	iretq
+
+;
+; Jump to the handler of system call rax, arguments already in place except the fourth one (r10
+; instead of rcx). The handler returns to our caller
+;
+dispatch:
+	cmp rax, [syscall_count]
+	jae .unknown
+	mov rcx, r10
+	jmp [syscall_table + rax * 8]
+.unknown:
+	mov rax, -1
+	ret
+
+;
+; void enter_user(uint64_t rip, uint64_t rsp)
+;
+; Drop the calling thread to ring 3, it comes back to the kernel only through system calls and
+; interrupts (on the top of its kernel stack). No kernel value is left in the registers
+;
+enter_user:
+	cli
+	push USER_DS
+	push rsi
+	push USER_RFLAGS
+	push USER_CS
+	push rdi
+	xor eax, eax
+	xor ebx, ebx
+	xor ecx, ecx
+	xor edx, edx
+	xor esi, esi
+	xor edi, edi
+	xor ebp, ebp
+	xor r8d, r8d
+	xor r9d, r9d
+	xor r10d, r10d
+	xor r11d, r11d
+	xor r12d, r12d
+	xor r13d, r13d
+	xor r14d, r14d
+	xor r15d, r15d
+	swapgs
+	iretq
+
+; make it accessible for other code
+GLOBAL syscall_entry
+GLOBAL syscall_int80
+GLOBAL enter_user
+EXTERN syscall_table
+EXTERN syscall_count
+EXTERN syscall_stack
+EXTERN user_stack
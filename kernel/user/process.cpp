@@ -0,0 +1,372 @@
+/**
+ * User processes
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "user/process.h"
+#include "bootstrap/stivale_hdrs.h"
+#include "cpu/cpu.h"
+#include "kernel.h"
+#include "klog/klog.h"
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+#include "sync/wait.h"
+#include "user/elf.h"
+#include "user/syscall.h"
+
+namespace user {
+
+using namespace paging::translator;
+
+/** PML4 entries of the user window */
+static const uint16_t FIRST_SLOT = USER_BASE >> 39;
+static const uint16_t LAST_SLOT  = (USER_END - 1) >> 39;
+
+static process table[MAX_PROCESSES];
+static sync::lock_stats table_stats("processes");
+/** Protects the slot states */
+static sync::ticket_lock table_lock(&table_stats);
+static uint64_t next_pid = 1;
+/** Parents waiting for a process to exit */
+static sync::wait_queue exits;
+
+/**
+ * Process run by the calling thread
+ *
+ * @return the process or nullptr for kernel threads
+ */
+process *
+current()
+{
+    sched::thread *self = sched::current();
+    return self != nullptr ? self->process : nullptr;
+}
+
+/**
+ * Find a bootloader module by its string
+ *
+ * @return false if there is no such module
+ */
+static bool
+find_module(const char *name, stivale2_module **found)
+{
+    auto *mods = (stivale2_struct_tag_modules *)stivale2_get_tag(
+      &kernel::internal::stivalehdr, STIVALE2_STRUCT_TAG_MODULES_ID);
+    if (mods == nullptr)
+        return false;
+
+    for (uint64_t i = 0; i < mods->module_count; i++) {
+        if (strcmp(mods->modules[i].string, name) == 0) {
+            *found = &mods->modules[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * The range lies in the user window
+ */
+static bool
+in_window(uint64_t addr, uint64_t length)
+{
+    return addr >= USER_BASE && addr < USER_END && length <= USER_END - addr;
+}
+
+/**
+ * The calling process can read the range (user window and mapped)
+ */
+bool
+readable(uint64_t addr, uint64_t length)
+{
+    process *self = current();
+    if (self == nullptr || !in_window(addr, length))
+        return false;
+
+    for (uint64_t page = addr & ~(kernel::page_size - 1); page < addr + length;
+         page += kernel::page_size) {
+        if (!self->space.is_mapped(page))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Map zeroed pages over a range of the calling process (pages already mapped are kept)
+ *
+ * @return false if there is no memory
+ */
+static bool
+map_zeroed(process *self, uint64_t addr, uint64_t length)
+{
+    for (uint64_t page = addr & ~(kernel::page_size - 1); page < addr + length;
+         page += kernel::page_size) {
+        if (self->space.is_mapped(page))
+            continue;
+
+        void *frame = kernel::allocator.request_page();
+        if (frame == nullptr)
+            return false;
+        memset(frame, 0, kernel::page_size);
+        self->space.map(page, (uint64_t)frame);
+    }
+    return true;
+}
+
+/**
+ * Load the executable of the calling process into its user window (its tables are loaded)
+ *
+ * @return entry point or 0 if the image is not a valid executable
+ */
+static uint64_t
+load(process *self)
+{
+    auto *header = (const elf::header *)self->image;
+    if (self->image_size < sizeof(elf::header) || header->magic != elf::MAGIC ||
+        header->file_class != elf::CLASS_64 || header->data != elf::DATA_LSB ||
+        header->type != elf::TYPE_EXEC || header->machine != elf::MACHINE_X86_64 ||
+        header->phentsize < sizeof(elf::program_header))
+        return 0;
+
+    if (header->phoff > self->image_size ||
+        (uint64_t)header->phnum * header->phentsize > self->image_size - header->phoff)
+        return 0;
+
+    for (uint16_t i = 0; i < header->phnum; i++) {
+        auto *segment = (const elf::program_header *)(self->image + header->phoff +
+                                                       i * header->phentsize);
+        if (segment->type != elf::PT_LOAD)
+            continue;
+
+        if (segment->filesz > segment->memsz || segment->offset > self->image_size ||
+            segment->filesz > self->image_size - segment->offset ||
+            !in_window(segment->vaddr, segment->memsz))
+            return 0;
+
+        /* Fresh pages are zeroed, the part past the file contents is the .bss */
+        if (!map_zeroed(self, segment->vaddr, segment->memsz))
+            return 0;
+        memcpy((void *)segment->vaddr, self->image + segment->offset, segment->filesz);
+    }
+
+    if (!in_window(header->entry, 1))
+        return 0;
+    return header->entry;
+}
+
+/**
+ * Thread of a process: load the executable, map the stack and drop to ring 3
+ */
+static void
+run(void *arg)
+{
+    process *self  = (process *)arg;
+    uint64_t entry = load(self);
+    if (entry == 0) {
+        klog::fmt(klog::level_e::error, "%s is not a valid x86-64 executable", self->name);
+        exit(-1);
+    }
+
+    uint64_t stack = USER_END - STACK_PAGES * kernel::page_size;
+    if (!map_zeroed(self, stack, STACK_PAGES * kernel::page_size)) {
+        klog::fmt(klog::level_e::error, "no memory to load %s", self->name);
+        exit(-1);
+    }
+
+    enter_user(entry, USER_END);
+}
+
+/**
+ * Create the tables of a process: an empty user window and the kernel PML4 entries
+ *
+ * The kernel entries are copied without the user bit, which hides everything below them from
+ * ring 3. Kernel PML4 entries created later are copied on the first kernel fault (sync_kernel())
+ *
+ * @return false if there is no memory
+ */
+static bool
+create_space(process *proc)
+{
+    auto *tables = (PGDT_wrapper *)kernel::allocator.request_page();
+    if (tables == nullptr)
+        return false;
+
+    page_global_dir_entry_t *kernel_dir = kernel::translator.get_PGDT();
+    for (uint16_t i = 0; i < PTM::page_size; i++) {
+        tables->PGDT[i] = kernel_dir[i];
+        if (i >= FIRST_SLOT && i <= LAST_SLOT)
+            tables->PGDT[i] = {};
+        else
+            tables->PGDT[i].user_access = false;
+    }
+
+    proc->space.set_PGDT(tables);
+    return true;
+}
+
+/**
+ * Free the user window and the tables of a process no CPU runs anymore
+ */
+static void
+destroy_space(process *proc)
+{
+    page_global_dir_entry_t *dir = proc->space.get_PGDT();
+
+    for (uint16_t i = FIRST_SLOT; i <= LAST_SLOT; i++) {
+        if (!dir[i].present)
+            continue;
+
+        auto PUDT = (page_upper_dir_entry_t *)((uint64_t)dir[i].page_ppn << 12);
+        for (uint16_t j = 0; j < PTM::page_size; j++) {
+            if (!PUDT[j].present)
+                continue;
+
+            auto PMDT = (page_mid_dir_entry_t *)((uint64_t)PUDT[j].page_ppn << 12);
+            for (uint16_t k = 0; k < PTM::page_size; k++) {
+                if (!PMDT[k].present)
+                    continue;
+
+                auto PTDT = (page_table_entry_t *)((uint64_t)PMDT[k].page_ppn << 12);
+                for (uint16_t l = 0; l < PTM::page_size; l++) {
+                    if (PTDT[l].present)
+                        kernel::allocator.free_page((void *)((uint64_t)PTDT[l].page_ppn << 12));
+                }
+                kernel::allocator.free_page(PTDT);
+            }
+            kernel::allocator.free_page(PMDT);
+        }
+        kernel::allocator.free_page(PUDT);
+    }
+
+    kernel::allocator.free_page(dir);
+    proc->space.retire();
+}
+
+/**
+ * Start a process running a bootloader module
+ *
+ * @return the process (to wait() for) or nullptr if there is no such module or no memory
+ */
+process *
+spawn(const char *module)
+{
+    stivale2_module *image;
+    if (!find_module(module, &image))
+        return nullptr;
+
+    process *proc = nullptr;
+    auto flags    = table_lock.lock_irqsave();
+    for (uint32_t i = 0; i < MAX_PROCESSES && proc == nullptr; i++) {
+        if (table[i].state.load(std::memory_order_relaxed) == state_e::free) {
+            proc = &table[i];
+            proc->state.store(state_e::running, std::memory_order_relaxed);
+            proc->pid = next_pid++;
+        }
+    }
+    table_lock.unlock_irqrestore(flags);
+    if (proc == nullptr)
+        return nullptr;
+
+    proc->name       = image->string;
+    proc->image      = (const uint8_t *)image->begin;
+    proc->image_size = image->end - image->begin;
+    proc->exit_code  = 0;
+
+    if (!create_space(proc)) {
+        proc->state.store(state_e::free, std::memory_order_release);
+        return nullptr;
+    }
+
+    if (sched::create(proc->name, run, proc, proc) == nullptr) {
+        destroy_space(proc);
+        proc->state.store(state_e::free, std::memory_order_release);
+        return nullptr;
+    }
+
+    return proc;
+}
+
+/**
+ * Wait for a process to exit and free its slot
+ *
+ * @return its exit code
+ */
+int64_t
+wait(process *proc)
+{
+    exits.wait([proc] { return proc->state.load() == state_e::exited; });
+
+    int64_t code = proc->exit_code;
+    proc->state.store(state_e::free, std::memory_order_release);
+    return code;
+}
+
+/**
+ * End the calling process
+ *
+ * The thread goes back to the kernel tables, frees the process memory and exits
+ */
+[[noreturn]] void
+exit(int64_t code)
+{
+    sched::thread *thread = sched::current();
+    process *self         = thread->process;
+
+    /* From now on the thread is switched in with the kernel tables */
+    auto flags      = cpu::irq_save();
+    thread->process = nullptr;
+    kernel::translator.activate();
+    cpu::irq_restore(flags);
+
+    destroy_space(self);
+
+    self->exit_code = code;
+    self->state.store(state_e::exited);
+    exits.wake_all();
+
+    sched::exit();
+}
+
+/**
+ * End the calling process after a fault in ring 3
+ */
+[[noreturn]] void
+kill(const char *reason, uint64_t addr)
+{
+    process *self = current();
+
+    klog::fmt(klog::level_e::error,
+              "%s (pid %i) killed: %s at %p",
+              self->name,
+              (int)self->pid,
+              reason,
+              addr);
+
+    exit(-1);
+}
+
+/**
+ * Copy a kernel PML4 entry created after the calling process (kernel page fault)
+ *
+ * @return true if the fault was resolved
+ */
+bool
+sync_kernel(uint64_t addr)
+{
+    process *self = current();
+    uint16_t slot = (addr >> 39) & (PTM::page_size - 1);
+    if (self == nullptr || (slot >= FIRST_SLOT && slot <= LAST_SLOT))
+        return false;
+
+    page_global_dir_entry_t *dir  = self->space.get_PGDT();
+    page_global_dir_entry_t entry = kernel::translator.get_PGDT()[slot];
+    if (!entry.present || dir[slot].present)
+        return false;
+
+    entry.user_access = false;
+    dir[slot]         = entry;
+    return true;
+}
+
+} // namespace user
@@ -0,0 +1,63 @@
+/**
+ * User processes
+ *
+ * A process is a statically linked ELF executable (a bootloader module) running in ring 3 on a
+ * kernel thread. Every process has its own page tables: the user window (a private range of the
+ * lower half) plus the kernel PML4 entries, shared with the kernel tables but not accessible from
+ * ring 3
+ *
+ * Processes end with the exit system call or when they fault, the thread frees the user memory and
+ * the tables before exiting. The process slot is given back by wait()
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "lib/atomic.h"
+#include "paging/PTM.h"
+#include <stdint.h>
+
+namespace user {
+
+/** User window: PML4 entries 224-255 belong to the process */
+const uint64_t USER_BASE = 0x0000700000000000;
+/** End of the user window, the last lower half page is never mapped (see entry.asm) */
+const uint64_t USER_END = 0x00007ffffffff000;
+/** Pages of the user stack, right below USER_END */
+const uint32_t STACK_PAGES = 4;
+/** Processes that can exist at the same time */
+const uint32_t MAX_PROCESSES = 16;
+
+enum class state_e
+{
+    free,
+    running,
+    exited,
+};
+
+/**
+ * Process control block
+ */
+struct process
+{
+    uint64_t pid               = 0;
+    const char *name           = nullptr;
+    std::atomic<state_e> state = state_e::free;
+    /** Executable (bootloader module) */
+    const uint8_t *image = nullptr;
+    uint64_t image_size  = 0;
+    int64_t exit_code    = 0;
+    /** Page tables of the process */
+    paging::translator::PTM space;
+};
+
+process *spawn(const char *);
+int64_t wait(process *);
+process *current();
+[[noreturn]] void exit(int64_t);
+[[noreturn]] void kill(const char *, uint64_t);
+bool readable(uint64_t, uint64_t);
+bool sync_kernel(uint64_t);
+
+} // namespace user
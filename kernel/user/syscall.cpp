@@ -0,0 +1,101 @@
+/**
+ * System calls
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#include "user/syscall.h"
+#include "cpu/cpu.h"
+#include "kernel.h"
+#include "sched/thread.h"
+#include "segmentation/gdt.h"
+#include "user/process.h"
+
+namespace user {
+
+extern "C" {
+DEFINE_PERCPU(uint64_t, syscall_stack) = 0;
+DEFINE_PERCPU(uint64_t, user_stack)    = 0;
+}
+
+/** Bytes of a write copied (and printed) at once */
+static const uint64_t WRITE_CHUNK = 128;
+
+/**
+ * exit(code)
+ */
+static int64_t
+sys_exit(uint64_t code, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    exit((int64_t)code);
+}
+
+/**
+ * write(buffer, length)
+ *
+ * The buffer is copied to the kernel stack before printing, it must be mapped in the process.
+ * Output goes to the tty and to the serial port (headless runs)
+ */
+static int64_t
+sys_write(uint64_t buffer, uint64_t length, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    if (!readable(buffer, length))
+        return SYSCALL_ERROR;
+
+    char chunk[WRITE_CHUNK];
+    for (uint64_t done = 0; done < length; done += WRITE_CHUNK) {
+        uint64_t size = length - done < WRITE_CHUNK ? length - done : WRITE_CHUNK;
+        memcpy(chunk, (const void *)(buffer + done), size);
+        kernel::tty.print(chunk, size);
+        kernel::serial.write(chunk, size);
+    }
+
+    return length;
+}
+
+/**
+ * yield()
+ */
+static int64_t
+sys_yield(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    sched::yield();
+    return 0;
+}
+
+/**
+ * null()
+ */
+static int64_t
+sys_null(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t)
+{
+    return 0;
+}
+
+/** Indexed by syscall_e */
+const syscall_fn syscall_table[] = {
+    sys_exit,
+    sys_write,
+    sys_yield,
+    sys_null,
+};
+
+const uint64_t syscall_count = sizeof(syscall_table) / sizeof(syscall_fn);
+
+/**
+ * Enable SYSCALL/SYSRET on the calling CPU
+ *
+ * SFMASK clears IF (the entry code runs on the user stack until it switches), TF, DF (the kernel
+ * expects it clear) and AC. The user gs base starts at 0
+ */
+void
+init_cpu()
+{
+    cpu::wrmsr(cpu::MSR_STAR, segmentation::STAR);
+    cpu::wrmsr(cpu::MSR_LSTAR, (uint64_t)&syscall_entry);
+    cpu::wrmsr(cpu::MSR_SFMASK, cpu::RFLAGS_IF | cpu::RFLAGS_TF | cpu::RFLAGS_DF | cpu::RFLAGS_AC);
+    cpu::wrmsr(cpu::MSR_KERNEL_GS_BASE, 0);
+    cpu::wrmsr(cpu::MSR_EFER, cpu::rdmsr(cpu::MSR_EFER) | cpu::EFER_SCE);
+}
+
+} // namespace user
@@ -0,0 +1,57 @@
+/**
+ * System calls
+ *
+ * Ring 3 enters the kernel with SYSCALL (entry.asm): number in rax, arguments in rdi, rsi, rdx,
+ * r10, r8 and r9, result in rax. rcx and r11 are clobbered (return address and rflags), every
+ * other register is preserved. int 0x80 takes the same registers and is kept as a slower fallback
+ * (and to compare both paths, see the bench program)
+ *
+ * The entry code switches to the kernel stack of the running thread and dispatches through
+ * syscall_table with interrupts enabled, so system calls can block and be preempted
+ *
+ * @author Ernesto Martínez García <me@ecomaikgolf.com>
+ */
+
+#pragma once
+
+#include "percpu/percpu.h"
+#include <stdint.h>
+
+namespace user {
+
+/** System call numbers */
+enum class syscall_e : uint64_t
+{
+    /** exit(code): end the process */
+    exit = 0,
+    /** write(buffer, length): print to the tty, returns the bytes written or -1 */
+    write = 1,
+    /** yield(): give the CPU up */
+    yield = 2,
+    /** null(): returns 0 right away (round trip measurements) */
+    null = 3,
+};
+
+/** Returned by system calls on error (and for unknown numbers) */
+const int64_t SYSCALL_ERROR = -1;
+
+using syscall_fn = int64_t (*)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+/* Used by entry.asm */
+extern "C" {
+/** Handlers indexed by system call number */
+extern const syscall_fn syscall_table[];
+extern const uint64_t syscall_count;
+/** Top of the kernel stack of the user thread running on each CPU */
+DECLARE_PERCPU(uint64_t, syscall_stack);
+/** User stack pointer of a SYSCALL, until it is saved on the kernel stack */
+DECLARE_PERCPU(uint64_t, user_stack);
+
+void syscall_entry();
+void syscall_int80();
+[[noreturn]] void enter_user(uint64_t, uint64_t);
+}
+
+void init_cpu();
+
+} // namespace user
@@ -0,0 +1,152 @@
+;;
+; System call round trip benchmark (user program)
+;
+; Runs the null system call ROUNDS times through SYSCALL and through int 0x80 and prints the
+; average cycles (rdtsc) of a round trip of each
+;
+; @author Ernesto Martínez García <me@ecomaikgolf.com>
+;
+
+; tell nasm we need 64 bit instructions
+[bits 64]
+
+; system call numbers (kernel/user/syscall.h)
+SYS_EXIT equ 0
+SYS_WRITE equ 1
+SYS_NULL equ 3
+
+ROUNDS equ 100000
+; decimal digits of a 64 bit value
+DIGITS equ 20
+
+;
+; rax = time stamp counter (clobbers rdx)
+;
+%macro TSC 0
+	lfence
+	rdtsc
+	shl rdx, 32
+	or rax, rdx
+%endmacro
+
+section .text
+
+_start:
+	; warm up both paths
+	mov eax, SYS_NULL
+	syscall
+	mov eax, SYS_NULL
+	int 0x80
+
+	TSC
+	mov r12, rax
+	mov r13, ROUNDS
+.syscall_loop:
+	mov eax, SYS_NULL
+	syscall
+	dec r13
+	jnz .syscall_loop
+	TSC
+	sub rax, r12
+	xor edx, edx
+	mov rcx, ROUNDS
+	div rcx
+	lea rdi, [rel syscall_label]
+	mov rsi, syscall_label_len
+	mov rdx, rax
+	call report
+
+	TSC
+	mov r12, rax
+	mov r13, ROUNDS
+.int_loop:
+	mov eax, SYS_NULL
+	int 0x80
+	dec r13
+	jnz .int_loop
+	TSC
+	sub rax, r12
+	xor edx, edx
+	mov rcx, ROUNDS
+	div rcx
+	lea rdi, [rel int_label]
+	mov rsi, int_label_len
+	mov rdx, rax
+	call report
+
+	mov eax, SYS_EXIT
+	xor edi, edi
+	syscall
+	ud2 ; exit never returns
+
+;
+; Print "<label><value> cycles per round trip\n"
+;
+; rdi = label, rsi = label length, rdx = value
+;
+report:
+	lea r8, [rel line]
+	xor ecx, ecx
+.label:
+	cmp rcx, rsi
+	je .number
+	mov al, [rdi + rcx]
+	mov [r8], al
+	inc r8
+	inc rcx
+	jmp .label
+.number:
+	; digits are produced backwards, from the end of the digits buffer
+	lea r9, [rel digits + DIGITS]
+	mov rax, rdx
+	mov r10, 10
+.digit:
+	xor edx, edx
+	div r10
+	add dl, '0'
+	dec r9
+	mov [r9], dl
+	test rax, rax
+	jnz .digit
+	lea r10, [rel digits + DIGITS]
+.append:
+	cmp r9, r10
+	je .suffix
+	mov al, [r9]
+	mov [r8], al
+	inc r8
+	inc r9
+	jmp .append
+.suffix:
+	lea rsi, [rel suffix]
+	mov ecx, suffix_len
+.tail:
+	mov al, [rsi]
+	mov [r8], al
+	inc rsi
+	inc r8
+	dec ecx
+	jnz .tail
+	lea rdi, [rel line]
+	mov rsi, r8
+	sub rsi, rdi
+	mov eax, SYS_WRITE
+	syscall
+	ret
+
+section .rodata
+
+syscall_label: db "syscall:  "
+syscall_label_len equ $ - syscall_label
+int_label: db "int 0x80: "
+int_label_len equ $ - int_label
+suffix: db " cycles per round trip", 10
+suffix_len equ $ - suffix
+
+section .bss
+
+line: resb 128
+digits: resb DIGITS
+
+; entry point
+GLOBAL _start